@@ -4,29 +4,114 @@
 /**************************************************************************
  * A CPPFile is a storage media that uses the C++ file utilities to write to
  * and read from a file.
+ *
+ * By default every write is flushed to the os straight away. For lots of
+ * small writes that flush dominates, so the durability can be relaxed to
+ * only flushing on sync(), or to group commit where writes are flushed
+ * together once enough bytes or enough time has built up. The time is only
+ * checked when writing, there is no background thread.
+ *
+ * In positional mode the file is accessed through a file descriptor with
+ * pread and pwrite instead of a stream, so there is no shared file
+ * position and any number of threads can read and write at once. Writes
+ * go straight to the os in this mode, so the durability has no effect.
+ * From several threads, use the overloads that take the callers buffer,
+ * allocating a new SharedData isn't thread safe.
+ *
+ * Direct mode opens the file with O_DIRECT so transfers skip the page
+ * cache, which keeps large images from evicting everything else and gives
+ * steadier latency. The os only accepts aligned offsets, sizes and
+ * buffers, so the aligned middle of a transfer goes straight to the file
+ * while unaligned edges (or a misaligned buffer) go through a bounce
+ * buffer, with a read-modify-write for partial blocks. Calls must not
+ * overlap in this mode. Filesystems without O_DIRECT fall back to plain
+ * pread and pwrite.
+ *
+ * initialize() creates an empty file unless setInitialSize() was called
+ * first, in which case the file is grown to that size straight away,
+ * either as a sparse image or with the space allocated up front so the
+ * filesystem can lay it out contiguously instead of piece by piece as
+ * writes at higher offsets come in. If the file can't be created or grown,
+ * needsInitialization() keeps returning true afterwards.
 **************************************************************************/
 
 #include "IStorageMedia.hpp"
+#include <chrono>
 #include <fstream>
 
+enum class CPP_FILE_DURABILITY
+{
+	FLUSH_EVERY_WRITE,
+	FLUSH_ON_SYNC,
+	GROUP_COMMIT
+};
+
+enum class CPP_FILE_IO
+{
+	STREAM, 	// one std::fstream, calls must not overlap
+	POSITIONAL, 	// pread and pwrite on a file descriptor, safe to call from several threads at once
+	DIRECT 		// like positional but bypassing the page cache, calls must not overlap
+};
+
+enum class CPP_FILE_ALLOCATION
+{
+	SPARSE, 	// only takes disk space once written
+	PREALLOCATE 	// reserves all the disk space when the file is created
+};
+
 class CPPFile : public IStorageMedia
 {
 	public:
-		CPPFile (const std::string& fileName);
+		CPPFile (const std::string& fileName, const CPP_FILE_DURABILITY& durability = CPP_FILE_DURABILITY::FLUSH_EVERY_WRITE,
+				const CPP_FILE_IO& io = CPP_FILE_IO::STREAM);
 		~CPPFile() override;
 
 		void writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes) override;
 		SharedData<uint8_t> readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes) override;
 		void readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data) override;
 
+		void writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes) override;
+		void readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data) override;
+
 		bool needsInitialization() override;
 		void initialize() override;
 		void afterInitialize() override;
 
+		IStorageMediaInfo getMediaInfo() override;
+
+		void sync(); // flushes any buffered writes
+
+		void setDurability (const CPP_FILE_DURABILITY& durability) { m_Durability = durability; }
+		// a group is flushed once either limit is reached, a limit of 0 is ignored
+		void setGroupCommitLimits (unsigned int sizeInBytes, unsigned int intervalInMs);
+
+		// only has an effect on the next initialize(), a size of 0 creates an empty file
+		void setInitialSize (uint64_t sizeInBytes, const CPP_FILE_ALLOCATION& allocation = CPP_FILE_ALLOCATION::PREALLOCATE);
+
 	private:
 		std::fstream m_File;
 		std::string  m_FileName;
 		bool         m_NeedsInitialization;
+		CPP_FILE_IO  m_IO;
+		int          m_FileDescriptor; // only used in positional and direct mode
+		uint8_t*     m_BounceBuffer; // only used in direct mode
+
+		CPP_FILE_DURABILITY 			m_Durability;
+		unsigned int 				m_GroupCommitSizeInBytes;
+		std::chrono::milliseconds 		m_GroupCommitInterval;
+		uint64_t 				m_UnflushedBytes;
+		std::chrono::steady_clock::time_point 	m_LastFlushTime;
+		uint64_t 				m_WritePosition; // where the file position is after the last write
+
+		uint64_t 				m_InitialSizeInBytes;
+		CPP_FILE_ALLOCATION 			m_InitialAllocation;
+
+		void openFile (bool create); // create truncates the file
+		void closeFile();
+		bool allocateInitialSize();
+
+		bool transferDirect (bool writing, uint8_t* data, uint64_t sizeInBytes, uint64_t offsetInBytes);
 };
 
 #endif // CPPFILE_HPP
@@ -0,0 +1,29 @@
+#ifndef CHECKSUM_HPP
+#define CHECKSUM_HPP
+
+/**************************************************************************
+ * Checksum provides the crcs used for storage and the sd card protocol.
+ * All of them are table driven, with the tables generated at compile time
+ * so they live in flash. Crc32 processes 8 bytes per step (slicing-by-8)
+ * so it can keep up with block transfers.
+ *
+ * Crc16 and Crc32 can be calculated over several pieces of data by
+ * passing the previous result back in.
+**************************************************************************/
+
+#include <stdint.h>
+
+class Checksum
+{
+	public:
+		// the sd card command crc (polynomial 0x09), returned in the upper 7 bits with the end bit set as it's sent on the bus
+		static uint8_t Crc7 (const uint8_t* data, unsigned int sizeInBytes);
+
+		// crc16-ccitt (polynomial 0x1021, initial value 0, as used for sd card data blocks)
+		static uint16_t Crc16 (const uint8_t* data, unsigned int sizeInBytes, uint16_t previousCrc = 0);
+
+		// the standard crc32 (reflected polynomial 0xEDB88320, as used by zip, ethernet and gpt)
+		static uint32_t Crc32 (const uint8_t* data, unsigned int sizeInBytes, uint32_t previousCrc = 0);
+};
+
+#endif // CHECKSUM_HPP
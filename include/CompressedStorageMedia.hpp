@@ -0,0 +1,93 @@
+#ifndef COMPRESSEDSTORAGEMEDIA_HPP
+#define COMPRESSEDSTORAGEMEDIA_HPP
+
+/**************************************************************************
+ * A CompressedStorageMedia transparently compresses the data written to
+ * it in fixed size logical blocks, using an LzBlockCodec. It's meant for
+ * media where the bus is the bottleneck rather than the cpu, since only
+ * the compressed bytes of a block ever cross the bus.
+ *
+ * Every logical block keeps a fixed slot on the child media, so blocks
+ * can be rewritten in place. A block map at the start of the child holds
+ * the compressed length of each block (0 for an all zero block that was
+ * never stored, the block size for a block stored uncompressed). It takes
+ * 4 bytes per block on the child (1MB per GB with 4KB blocks), but only a
+ * window of it is held in ram, paged in as blocks are touched, so the ram
+ * cost doesn't grow with the capacity. Changes are written through.
+ *
+ * Reads only decompress the blocks they touch, and whole blocks are
+ * decompressed straight into the callers buffer. The last decompressed
+ * block is kept so small sequential reads don't decompress it again.
+ * Partial block writes read, merge and recompress the block.
+ *
+ * Call mount() (or afterInitialize()) before use, it formats the child if
+ * it doesn't contain a block map for the same geometry.
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+#include "LzBlockCodec.hpp"
+
+class CompressedStorageMedia : public IStorageMedia
+{
+	public:
+		// the map window costs 4 bytes of ram per entry, each entry covers one block
+		CompressedStorageMedia (IStorageMedia& child, uint64_t capacityInBytes, unsigned int blockSizeInBytes = 4096,
+					unsigned int mapWindowSizeInEntries = 1024);
+		~CompressedStorageMedia() override;
+
+		void writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes) override;
+		void readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes) override;
+		void readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes) override;
+		void discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes) override;
+
+		bool needsInitialization() override { return m_Child.needsInitialization(); }
+		void initialize() override { m_Child.initialize(); }
+		void afterInitialize() override;
+
+		IStorageMediaInfo getMediaInfo() override;
+
+		void mount(); // loads the block map, formatting the child if needed
+
+		// the size of the child media needed for a given capacity and block size
+		static uint64_t GetChildSizeInBytes (uint64_t capacityInBytes, unsigned int blockSizeInBytes);
+
+		uint64_t getStoredBytes(); // bytes of the child actually holding block data
+		uint64_t getNumBlocks() { return m_NumBlocks; }
+
+	private:
+		IStorageMedia& 			m_Child;
+		uint64_t 			m_CapacityInBytes;
+		unsigned int 			m_BlockSizeInBytes;
+		uint64_t 			m_NumBlocks;
+		uint64_t 			m_BlockMapSizeInBytes; // including the header, rounded up to a whole block
+
+		// the cached block map window, the compressed length of each block as stored on the child
+		unsigned int 			m_MapWindowSizeInEntries;
+		SharedData<uint8_t> 		m_MapWindow;
+		uint64_t 			m_MapWindowFirstBlockNum;
+		unsigned int 			m_MapWindowNumEntries; // 0 if nothing is loaded
+
+		LzBlockCodec 			m_Codec;
+		SharedData<uint8_t> 		m_BlockBuffer; // holds the last decompressed block
+		uint64_t 			m_BlockBufferNum;
+		bool 				m_BlockBufferValid;
+		SharedData<uint8_t> 		m_CompressedBuffer;
+
+		uint64_t getSlotOffset (uint64_t blockNum) { return m_BlockMapSizeInBytes + ( blockNum * m_BlockSizeInBytes ); }
+
+		// reads the whole block into dest (which must be the block size), returns false if the block is corrupt
+		bool loadBlock (uint64_t blockNum, uint8_t* dest);
+		void storeBlock (uint64_t blockNum, const uint8_t* src);
+		uint32_t getBlockMapEntry (uint64_t blockNum);
+		void setBlockMapEntry (uint64_t blockNum, uint32_t compressedSize); // writes it through to the child
+		void loadMapWindow (uint64_t blockNum);
+		void format();
+};
+
+#endif // COMPRESSEDSTORAGEMEDIA_HPP
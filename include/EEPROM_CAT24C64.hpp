@@ -16,6 +16,7 @@ class Eeprom_CAT24C64 : public IStorageMedia
 {
 	public:
 		static const int EEPROM_SIZE = 8192;
+		static const int EEPROM_PAGE_SIZE = 32; // the size of the internal page write buffer
 
 		Eeprom_CAT24C64 (const I2C_NUM& i2cNum, bool A0IsHigh = false, bool A1IsHigh = false, bool A2IsHigh = false);
 		~Eeprom_CAT24C64() override;
@@ -31,6 +32,8 @@ class Eeprom_CAT24C64 : public IStorageMedia
 		virtual void initialize() override {}
 		virtual void afterInitialize() override {}
 
+		IStorageMediaInfo getMediaInfo() override;
+
 	private:
 		uint8_t m_I2CAddress;
 		I2C_NUM m_I2CNum;
@@ -59,11 +62,14 @@ class Eeprom_CAT24C64_Manager : public IStorageMedia
 
 		void writeToMedia (const SharedData<uint8_t>& data, const unsigned int address) override;
 		SharedData<uint8_t> readFromMedia (const unsigned int sizeInBytes, const unsigned int address) override;
+		void readFromMedia (const unsigned int address, const SharedData<uint8_t>& data) override;
 
 		virtual bool needsInitialization() override { return false; }
 		virtual void initialize() override {}
 		virtual void afterInitialize() override {}
 
+		IStorageMediaInfo getMediaInfo() override;
+
 	protected:
 		std::vector<Eeprom_CAT24C64> m_Eeproms;
 };
@@ -4,14 +4,59 @@
 /**************************************************************************
  * A FakeStorageDevice simulates a physical storage device such as a
  * eeprom, sram, ect.
+ *
+ * snapshot() remembers the current contents and restore() goes back to
+ * them, so a test can reset to a golden image without copying the whole
+ * device. Snapshots are copy-on-write: the first write to a page after a
+ * snapshot saves the old page, and restoring only copies back the pages
+ * written since. Restoring a snapshot drops any taken after it.
+ *
+ * Every transfer also advances a virtual clock by what it would take on
+ * the real device, according to the timing set with setTiming(). Devices
+ * like eeproms need a command per page, while sd cards cover a contiguous
+ * run of blocks with one multi block command, paying only a data token
+ * per block and, when writing, a short busy time between blocks. A write
+ * leaves the device busy programming and the next command waits that
+ * out, and block devices transfer whole blocks, reading a partly written
+ * block first. The clock never sleeps, so benchmarks built on it are fast
+ * and deterministic.
+ * advanceVirtualTime() stands in for the time the caller spends between
+ * transfers, which overlaps with any write busy period.
 **************************************************************************/
 
 #include "IStorageMedia.hpp"
 
+#include <vector>
+
+enum class FAKE_STORAGE_TIMING
+{
+	INSTANT,
+	SRAM_23K256, 		// sequential mode on a 20MHz spi bus
+	EEPROM_CAT24C64, 	// 400kHz i2c, 32 byte pages with a 5ms write cycle
+	SD_CARD_SPI 		// 25MHz spi, a multi block command for each contiguous run of blocks
+};
+
+struct FakeStorageTiming
+{
+	uint64_t 	m_ReadCommandTimeInNs; 		// per read command: chip select, command, address and access latency
+	uint64_t 	m_WriteCommandTimeInNs; 	// the same for each write command
+	uint64_t 	m_ReadPageTimeInNs; 		// per page a read command covers, like waiting for each block's data token
+	uint64_t 	m_WritePageTimeInNs; 		// the same for write commands
+	uint64_t 	m_ByteTimeInNs; 		// bus time for every data byte
+	uint64_t 	m_WriteBusyTimeInNs; 		// how long the device is busy programming after each write command
+	uint64_t 	m_WritePageBusyTimeInNs; 	// the wait between the pages of a multi page write
+	unsigned int 	m_ReadPageSizeInBytes; 		// 0 if a read command can cover any range
+	unsigned int 	m_WritePageSizeInBytes; 	// the same for write commands
+	bool 		m_MultiPageCommands; 		// one command can cover several pages, otherwise each page needs its own
+	unsigned int 	m_BlockSizeInBytes; 		// the device only transfers whole blocks, 1 if byte addressable
+
+	FakeStorageTiming (const FAKE_STORAGE_TIMING& profile = FAKE_STORAGE_TIMING::INSTANT);
+};
+
 class FakeStorageDevice : public IStorageMedia
 {
 	public:
-		FakeStorageDevice (const unsigned int deviceSizeInBytes);
+		FakeStorageDevice (const unsigned int deviceSizeInBytes, const unsigned int snapshotPageSizeInBytes = 256);
 		~FakeStorageDevice() override;
 
 		void writeByte (uint16_t address, uint8_t data);
@@ -25,9 +70,45 @@ class FakeStorageDevice : public IStorageMedia
 		void initialize() override {}
 		void afterInitialize() override {}
 
+		IStorageMediaInfo getMediaInfo() override;
+
+		unsigned int snapshot(); // returns a handle for restore()
+		bool restore (unsigned int snapshotHandle); // false if the handle was released or dropped
+		bool releaseSnapshot (unsigned int snapshotHandle);
+
+		void setTiming (const FakeStorageTiming& timing) { m_Timing = timing; }
+		FakeStorageTiming getTiming() { return m_Timing; }
+		uint64_t getVirtualTimeInNs() { return m_VirtualTimeInNs; }
+		void advanceVirtualTime (uint64_t timeInNs) { m_VirtualTimeInNs += timeInNs; }
+		void resetVirtualTime(); // also forgets any write busy period
+
 	private:
-		unsigned int 	m_SizeInBytes;
-		uint8_t* 	m_DataArray;
+		// the pages written between this snapshot and the next one, as they were when it was taken
+		struct Snapshot
+		{
+			unsigned int 			m_Handle;
+			std::vector<bool> 		m_PageIsSaved;
+			std::vector<unsigned int> 	m_SavedPages;
+			std::vector<uint8_t> 		m_SavedData; // the saved pages back to back, in the same order
+		};
+
+		unsigned int 		m_SizeInBytes;
+		uint8_t* 		m_DataArray;
+
+		unsigned int 		m_SnapshotPageSizeInBytes;
+		unsigned int 		m_NumSnapshotPages;
+		unsigned int 		m_NextSnapshotHandle;
+		std::vector<Snapshot> 	m_Snapshots; // oldest first
+
+		FakeStorageTiming 	m_Timing;
+		uint64_t 		m_VirtualTimeInNs;
+		uint64_t 		m_BusyUntilInNs; // the end of the last write cycle
+
+		void saveSnapshotPages (unsigned int offsetInBytes, unsigned int sizeInBytes); // call before writing
+		int findSnapshot (unsigned int snapshotHandle); // -1 if not found
+
+		void addTransferTime (bool writing, unsigned int offsetInBytes, unsigned int sizeInBytes);
+		void addCommandTime (bool writing, uint64_t offsetInBytes, uint64_t sizeInBytes);
 };
 
 #endif // FAKESTORAGEDEVICE_HPP
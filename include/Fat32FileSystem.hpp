@@ -0,0 +1,150 @@
+#ifndef FAT32FILESYSTEM_HPP
+#define FAT32FILESYSTEM_HPP
+
+/**************************************************************************
+ * A Fat32FileSystem reads and writes files on a FAT32 volume stored on
+ * any IStorageMedia (usually an sd card).
+ *
+ * To avoid walking the fat for every cluster:
+ * - a window of fat sectors is cached in ram and written back lazily
+ * - a file's cluster chain is turned into a list of contiguous extents
+ *   when it's opened, so streaming a file becomes a few large reads
+ * - the results of path lookups are cached
+ *
+ * Long file names are matched when looking files up, but new files are
+ * created with 8.3 names only. Call close() on written files and flush()
+ * before removing the media so that directory entries and the fat are
+ * written back.
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define FAT32_ATTR_READ_ONLY 	0x01
+#define FAT32_ATTR_HIDDEN 	0x02
+#define FAT32_ATTR_SYSTEM 	0x04
+#define FAT32_ATTR_VOLUME_ID 	0x08
+#define FAT32_ATTR_DIRECTORY 	0x10
+#define FAT32_ATTR_ARCHIVE 	0x20
+#define FAT32_ATTR_LONG_NAME 	0x0F
+
+struct Fat32DirEntry
+{
+	uint32_t 		m_FirstCluster = 0;
+	uint32_t 		m_SizeInBytes = 0;
+	uint8_t 		m_Attributes = 0;
+	uint64_t 		m_EntryOffset = 0; // media offset of the 8.3 entry, 0 for the root directory
+	std::vector<uint64_t> 	m_LongNameEntryOffsets; // media offsets of the long name entries belonging to this entry
+
+	bool isDirectory() const { return m_Attributes & FAT32_ATTR_DIRECTORY; }
+};
+
+// a run of consecutive clusters
+struct Fat32Extent
+{
+	uint32_t 	m_FirstCluster;
+	uint32_t 	m_NumClusters;
+};
+
+class Fat32File
+{
+	public:
+		bool isOpen() const { return m_IsOpen; }
+		uint32_t getSizeInBytes() const { return m_Entry.m_SizeInBytes; }
+		uint32_t getPosition() const { return m_Position; }
+		void seek (uint32_t position) { m_Position = ( position < m_Entry.m_SizeInBytes ) ? position : m_Entry.m_SizeInBytes; }
+
+	private:
+		friend class Fat32FileSystem;
+
+		bool 				m_IsOpen = false;
+		std::string 			m_Path;
+		Fat32DirEntry 			m_Entry;
+		uint32_t 			m_Position = 0;
+		std::vector<Fat32Extent> 	m_Extents; // the cached cluster chain
+		uint32_t 			m_NumClusters = 0;
+		bool 				m_EntryChanged = false;
+};
+
+class Fat32FileSystem
+{
+	public:
+		Fat32FileSystem (IStorageMedia& media, uint64_t volumeOffsetInBytes = 0, unsigned int fatWindowSizeInSectors = 8);
+		~Fat32FileSystem();
+
+		bool mount(); // returns false if the volume isn't fat32
+		bool isMounted() { return m_IsMounted; }
+
+		// paths are absolute and separated by '/', matching is case insensitive
+		bool openFile (const std::string& path, Fat32File& file);
+		bool createFile (const std::string& path, Fat32File& file); // fails if the file exists or the name isn't 8.3
+		bool removeFile (const std::string& path);
+		bool getEntry (const std::string& path, Fat32DirEntry& entry);
+
+		unsigned int read (Fat32File& file, const SharedData<uint8_t>& data); // returns the number of bytes read
+		unsigned int write (Fat32File& file, const SharedData<uint8_t>& data); // returns the number of bytes written
+		void close (Fat32File& file);
+
+		void flush(); // writes back the fat window
+
+		uint32_t getClusterSizeInBytes() { return m_BytesPerSector * m_SectorsPerCluster; }
+
+	private:
+		IStorageMedia& 						m_Media;
+		uint64_t 						m_VolumeOffset;
+		bool 							m_IsMounted;
+
+		// volume geometry from the boot sector
+		unsigned int 						m_BytesPerSector;
+		unsigned int 						m_SectorsPerCluster;
+		uint32_t 						m_FatStartSector;
+		uint32_t 						m_SectorsPerFat;
+		unsigned int 						m_NumFats;
+		uint32_t 						m_DataStartSector;
+		uint32_t 						m_NumClusters;
+		uint32_t 						m_RootCluster;
+		uint32_t 						m_FsInfoSector;
+
+		// the cached fat window
+		unsigned int 						m_FatWindowSizeInSectors;
+		SharedData<uint8_t> 					m_FatWindow;
+		uint32_t 						m_FatWindowStartSector; // relative to the start of the fat
+		unsigned int 						m_FatWindowNumSectors; // 0 if nothing is loaded
+		bool 							m_FatWindowDirty;
+
+		uint32_t 						m_NextFreeClusterHint;
+		bool 							m_FsInfoInvalidated;
+
+		std::unordered_map<std::string, Fat32DirEntry> 	m_DirectoryCache; // keyed by upper case path
+
+		uint64_t getSectorOffset (uint32_t sectorNum) { return m_VolumeOffset + static_cast<uint64_t>( sectorNum ) * m_BytesPerSector; }
+		uint64_t getClusterOffset (uint32_t clusterNum);
+		bool isValidCluster (uint32_t clusterNum) { return clusterNum >= 2 && clusterNum < m_NumClusters + 2; }
+
+		uint32_t getFatEntry (uint32_t clusterNum);
+		void setFatEntry (uint32_t clusterNum, uint32_t value);
+		void loadFatWindow (uint32_t fatSector);
+		uint32_t allocateCluster (uint32_t previousClusterNum); // returns 0 if the volume is full
+		void freeClusterChain (uint32_t firstClusterNum, std::vector<Fat32Extent>& freedExtents); // adds the runs it freed
+		void discardExtents (const std::vector<Fat32Extent>& extents);
+		void invalidateFsInfo();
+
+		void buildExtents (Fat32File& file);
+		bool extendFile (Fat32File& file, uint32_t sizeInBytes);
+		bool locate (const Fat32File& file, uint32_t position, uint64_t& mediaOffset, uint32_t& contiguousBytes);
+
+		bool lookup (const std::string& path, Fat32DirEntry& entry);
+		bool findInDirectory (uint32_t dirCluster, const std::string& name, Fat32DirEntry& entry);
+		uint64_t findFreeDirEntry (uint32_t dirCluster); // returns 0 if the directory can't be extended
+		void writeDirEntry (const Fat32DirEntry& entry);
+
+		static std::string normalizePath (const std::string& path); // upper case, leading '/' and no trailing '/'
+		static bool splitPath (const std::string& path, std::string& parentPath, std::string& name);
+		static bool toShortName (const std::string& name, uint8_t shortName[11]); // false if the name isn't valid 8.3
+		static std::string fromShortName (const uint8_t* shortName);
+};
+
+#endif // FAT32FILESYSTEM_HPP
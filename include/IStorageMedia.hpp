@@ -10,6 +10,26 @@
 #include "SharedData.hpp"
 #include <stdint.h>
 
+// describes the geometry and capabilities of a storage media, so upper layers can align their io to it
+struct IStorageMediaInfo
+{
+	uint64_t 	m_CapacityInBytes; 		// total addressable bytes, 0 if unknown
+	unsigned int 	m_OptimalIOSizeInBytes; 	// transfers of (multiples of) this size are the most efficient
+	unsigned int 	m_AlignmentInBytes; 		// offsets aligned to this don't need any read-modify-write
+	unsigned int 	m_PageSizeInBytes; 		// largest unit the media programs at once, writes shouldn't cross these
+	unsigned int 	m_EraseSizeInBytes; 		// smallest independently erasable unit
+	bool 		m_SupportsAsync; 		// true if transfers can complete in the background (dma)
+
+	IStorageMediaInfo (uint64_t capacityInBytes, unsigned int optimalIOSizeInBytes, unsigned int alignmentInBytes,
+				unsigned int pageSizeInBytes, unsigned int eraseSizeInBytes, bool supportsAsync) :
+		m_CapacityInBytes( capacityInBytes ),
+		m_OptimalIOSizeInBytes( optimalIOSizeInBytes ),
+		m_AlignmentInBytes( alignmentInBytes ),
+		m_PageSizeInBytes( pageSizeInBytes ),
+		m_EraseSizeInBytes( eraseSizeInBytes ),
+		m_SupportsAsync( supportsAsync ) {}
+};
+
 class IStorageMedia
 {
 	public:
@@ -19,10 +39,49 @@ class IStorageMedia
 		virtual SharedData<uint8_t> readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes) = 0;
 		virtual void readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data) = 0;
 
+		// 64-bit offset variants for media larger than 4GiB, by default these forward to the 32-bit functions above and
+		// ignore any access past 4GiB instead of silently wrapping around to the start of the media
+		virtual void writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes)
+		{
+			if ( IStorageMedia::fitsIn32Bits(offsetInBytes, data.getSizeInBytes()) )
+			{
+				this->writeToMedia( data, static_cast<unsigned int>(offsetInBytes) );
+			}
+		}
+		virtual SharedData<uint8_t> readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes)
+		{
+			if ( IStorageMedia::fitsIn32Bits(offsetInBytes, sizeInBytes) )
+			{
+				return this->readFromMedia( sizeInBytes, static_cast<unsigned int>(offsetInBytes) );
+			}
+
+			return SharedData<uint8_t>::MakeSharedDataNull();
+		}
+		virtual void readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data)
+		{
+			if ( IStorageMedia::fitsIn32Bits(offsetInBytes, data.getSizeInBytes()) )
+			{
+				this->readFromMedia( static_cast<unsigned int>(offsetInBytes), data );
+			}
+		}
+
+		// tells the media that a region no longer holds anything useful, so it can be erased ahead of the next write to it instead
+		// of during it (trim). What a discarded region reads back as depends on the media. By default this does nothing
+		virtual void discard (const unsigned int /*offsetInBytes*/, const unsigned int /*sizeInBytes*/) {}
+		virtual void discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes)
+		{
+			if ( sizeInBytes <= 0xFFFFFFFF && IStorageMedia::fitsIn32Bits(offsetInBytes, static_cast<unsigned int>(sizeInBytes)) )
+			{
+				this->discard( static_cast<unsigned int>(offsetInBytes), static_cast<unsigned int>(sizeInBytes) );
+			}
+		}
+
 		virtual bool needsInitialization() = 0;
 		virtual void initialize() = 0;
 		virtual void afterInitialize() = 0;
 
+		virtual IStorageMediaInfo getMediaInfo() = 0;
+
 		bool hasMBR()
 		{
 			SharedData<uint8_t> mbrSignature = this->readFromMedia( 2, 0x1FE );
@@ -31,6 +90,11 @@ class IStorageMedia
 
 			return false;
 		}
+
+		static bool fitsIn32Bits (const uint64_t offsetInBytes, const unsigned int sizeInBytes)
+		{
+			return ( offsetInBytes + sizeInBytes ) <= 0x100000000ULL;
+		}
 };
 
 #endif // ISTORAGEMEDIA_HPP
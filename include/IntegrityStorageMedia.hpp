@@ -0,0 +1,79 @@
+#ifndef INTEGRITYSTORAGEMEDIA_HPP
+#define INTEGRITYSTORAGEMEDIA_HPP
+
+/**************************************************************************
+ * An IntegrityStorageMedia keeps a crc32 for every block written through
+ * it and checks it whenever the block is read back, so corruption
+ * anywhere between the media and the caller is noticed instead of
+ * silently handed on.
+ *
+ * The crcs are stored in a table at the start of the child media, ahead
+ * of the data blocks. Each access reads or writes the data in one
+ * transfer (block aligned parts go straight to and from the callers
+ * buffer) and the crcs of the blocks it touches in another. Blocks that
+ * were never written through this media (a crc of 0) aren't checked.
+ *
+ * Failed checks are counted and reported to the error callback, the data
+ * is still returned as read. Call mount() (or afterInitialize()) before
+ * use, it formats the child if it doesn't contain a crc table for the
+ * same geometry.
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+
+#include <functional>
+
+class IntegrityStorageMedia : public IStorageMedia
+{
+	public:
+		IntegrityStorageMedia (IStorageMedia& child, uint64_t capacityInBytes, unsigned int blockSizeInBytes = 512);
+		~IntegrityStorageMedia() override;
+
+		void writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes) override;
+		void readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes) override;
+		void readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes) override;
+		void discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes) override;
+
+		bool needsInitialization() override { return m_Child.needsInitialization(); }
+		void initialize() override { m_Child.initialize(); }
+		void afterInitialize() override;
+
+		IStorageMediaInfo getMediaInfo() override;
+
+		void mount(); // checks the crc table header, formatting the child if needed
+
+		// the size of the child media needed for a given capacity and block size
+		static uint64_t GetChildSizeInBytes (uint64_t capacityInBytes, unsigned int blockSizeInBytes);
+
+		void setErrorCallback (std::function<void(uint64_t blockNum)> callback) { m_ErrorCallback = callback; }
+		unsigned int getNumChecksumErrors() { return m_NumChecksumErrors; }
+
+	private:
+		IStorageMedia& 				m_Child;
+		uint64_t 				m_CapacityInBytes;
+		unsigned int 				m_BlockSizeInBytes;
+		uint64_t 				m_NumBlocks;
+		uint64_t 				m_TableSizeInBytes; // including the header, rounded up to a whole block
+		SharedData<uint8_t> 			m_BlockBuffer; // for partial blocks
+
+		std::function<void(uint64_t blockNum)> 	m_ErrorCallback;
+		unsigned int 				m_NumChecksumErrors;
+
+		bool isInRange (const uint64_t offsetInBytes, const unsigned int sizeInBytes)
+		{
+			return offsetInBytes <= m_CapacityInBytes && sizeInBytes <= m_CapacityInBytes - offsetInBytes;
+		}
+		uint64_t getBlockOffset (uint64_t blockNum) { return m_TableSizeInBytes + ( blockNum * m_BlockSizeInBytes ); }
+
+		SharedData<uint8_t> readChecksums (uint64_t firstBlockNum, unsigned int numBlocks);
+		void checkBlock (uint64_t blockNum, const uint8_t* blockData, const SharedData<uint8_t>& checksums, unsigned int checksumIndex);
+		void format();
+};
+
+#endif // INTEGRITYSTORAGEMEDIA_HPP
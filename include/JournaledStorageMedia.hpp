@@ -0,0 +1,98 @@
+#ifndef JOURNALEDSTORAGEMEDIA_HPP
+#define JOURNALEDSTORAGEMEDIA_HPP
+
+/**************************************************************************
+ * A JournaledStorageMedia makes groups of writes to a child media atomic,
+ * so a power loss never leaves a multi-byte structure half updated.
+ *
+ * Writes between beginTransaction() and commitTransaction() are held in
+ * ram (reads see them straight away). Committed transactions are grouped
+ * until flush() or until the group reaches the group commit size, then
+ * the whole group goes to the journal in a single write, followed by the
+ * writes to their home locations, and finally the journal is marked as
+ * applied. Writes made outside of a transaction are committed on their
+ * own, a write bigger than the journal can hold is split into journal
+ * sized chunks that are each committed on their own, so after a power loss
+ * only part of it may have landed. If the journal can't even hold a record
+ * header, writes go straight to the child with no protection.
+ *
+ * mount() (or afterInitialize()) replays a journal that was written but
+ * not marked as applied, so recovering from a power loss only costs
+ * reading the journal. A journal that was only partly written fails its
+ * crc and is ignored, leaving the media as it was before that group.
+ *
+ * The child media holds the data region first and the journal after it.
+ * If the child is too small for both, the data region is shrunk to fit.
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+
+#include <vector>
+
+class JournaledStorageMedia : public IStorageMedia
+{
+	public:
+		JournaledStorageMedia (IStorageMedia& child, uint64_t dataSizeInBytes, unsigned int journalSizeInBytes,
+					unsigned int groupCommitSizeInBytes = 0);
+		~JournaledStorageMedia() override;
+
+		void writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes) override;
+		void readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes) override;
+		void readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes) override;
+		void discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes) override;
+
+		bool needsInitialization() override { return m_Child.needsInitialization(); }
+		void initialize() override { m_Child.initialize(); }
+		void afterInitialize() override;
+
+		IStorageMediaInfo getMediaInfo() override;
+
+		bool mount(); // returns true if a journal was replayed
+
+		void beginTransaction();
+		bool commitTransaction(); // returns false (and drops the transaction) if it can't fit in the journal
+		void abortTransaction();
+		bool isInTransaction() { return m_InTransaction; }
+
+		void flush(); // writes the committed group through the journal
+
+		unsigned int getNumGroupedBytes() { return m_GroupSizeInBytes; } // journal bytes of committed but unflushed transactions
+
+	private:
+		struct JournalRecord
+		{
+			uint64_t 		m_OffsetInBytes;
+			SharedData<uint8_t> 	m_Data;
+		};
+
+		IStorageMedia& 			m_Child;
+		uint64_t 			m_DataSizeInBytes;
+		unsigned int 			m_JournalSizeInBytes;
+		unsigned int 			m_GroupCommitSizeInBytes;
+
+		std::vector<JournalRecord> 	m_Records; // the committed group followed by the open transaction
+		unsigned int 			m_NumGroupRecords;
+		unsigned int 			m_GroupSizeInBytes;
+		bool 				m_InTransaction;
+		uint32_t 			m_SequenceNum;
+
+		bool isInRange (const uint64_t offsetInBytes, const unsigned int sizeInBytes)
+		{
+			return offsetInBytes <= m_DataSizeInBytes && sizeInBytes <= m_DataSizeInBytes - offsetInBytes;
+		}
+		void addRecord (const uint8_t* data, unsigned int sizeInBytes, uint64_t offsetInBytes); // adds a copy to the open transaction
+		unsigned int getTransactionSizeInBytes(); // journal bytes the open transaction would take
+
+		void fitToChild(); // shrinks the data region if the child can't hold it and the journal
+
+		void applyRecords (const uint8_t* payload, unsigned int payloadSize);
+		void markJournalApplied();
+};
+
+#endif // JOURNALEDSTORAGEMEDIA_HPP
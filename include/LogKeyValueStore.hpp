@@ -0,0 +1,101 @@
+#ifndef LOGKEYVALUESTORE_HPP
+#define LOGKEYVALUESTORE_HPP
+
+/**************************************************************************
+ * A LogKeyValueStore is a log-structured key-value store for small blobs
+ * (presets, calibration data, state) on top of any IStorageMedia.
+ *
+ * The region it is given is split into two halves. Records are only ever
+ * appended to the active half, so every put or remove is a single
+ * sequential write and nothing is rewritten in place. An in-ram hash
+ * index from key to record location is rebuilt by mount(), so a get is a
+ * single read.
+ *
+ * Compaction copies the live records into the other half and then
+ * invalidates the old one. It can be run a few records at a time from an
+ * idle loop with compactStep(), and is otherwise run to completion when
+ * the active half fills up. An interrupted compaction is resumed on the
+ * next mount().
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+
+#include <unordered_map>
+
+class LogKeyValueStore
+{
+	public:
+		LogKeyValueStore (IStorageMedia& media, uint64_t regionOffsetInBytes, uint64_t regionSizeInBytes);
+		~LogKeyValueStore();
+
+		// rebuilds the index from the media, formatting the region if it doesn't contain a store yet
+		void mount();
+
+		bool put (uint32_t key, const SharedData<uint8_t>& value); // returns false if the store is full
+		SharedData<uint8_t> get (uint32_t key); // returns null data (size 0) if the key isn't found
+		bool contains (uint32_t key);
+		bool remove (uint32_t key); // returns false if the key isn't found or the store is full
+
+		// copies up to maxRecords live records, starting a compaction first if needsCompaction() is true
+		// returns true while there is compaction work left to do
+		bool compactStep (unsigned int maxRecords = 1);
+		void compact(); // runs a full compaction (or finishes the one in progress)
+		bool needsCompaction();
+
+		unsigned int getNumKeys() { return m_Index.size(); }
+		uint64_t getLiveBytes() { return m_LiveBytes; }
+		uint64_t getFreeBytes();
+
+	private:
+		struct RecordLocation
+		{
+			unsigned int 	m_Half;
+			uint64_t 	m_OffsetInHalf; // of the record header
+			unsigned int 	m_ValueSize;
+		};
+
+		struct RecordHeader
+		{
+			bool 		m_IsValid = false;
+			bool 		m_IsTombstone = false;
+			uint16_t 	m_Checksum = 0;
+			uint32_t 	m_Generation = 0;
+			uint32_t 	m_Key = 0;
+			uint32_t 	m_ValueSize = 0;
+		};
+
+		IStorageMedia& 					m_Media;
+		uint64_t 					m_RegionOffset;
+		uint64_t 					m_HalfSize;
+
+		std::unordered_map<uint32_t, RecordLocation> 	m_Index;
+		uint64_t 					m_LiveBytes; // record bytes referenced by the index
+
+		unsigned int 					m_ActiveHalf;
+		uint32_t 					m_ActiveGeneration;
+		uint64_t 					m_AppendOffset; // in the active half
+
+		bool 						m_Compacting;
+		uint32_t 					m_OldGeneration; // the old half is always the inactive one
+		uint64_t 					m_CompactCursor; // in the old half
+		uint64_t 					m_OldEndOffset; // end of the records in the old half
+		uint64_t 					m_OldLiveBytes; // live record bytes still in the old half
+
+		uint64_t getHalfOffset (unsigned int half) { return m_RegionOffset + ( m_HalfSize * half ); }
+		bool readHalfHeader (unsigned int half, uint32_t& generation);
+		void writeHalfHeader (unsigned int half, uint32_t generation);
+		void eraseHalfHeader (unsigned int half);
+
+		RecordHeader readRecordHeader (unsigned int half, uint64_t offsetInHalf, uint32_t generation);
+		bool verifyRecord (const RecordHeader& header, unsigned int half, uint64_t offsetInHalf);
+		void appendRecord (uint32_t key, const SharedData<uint8_t>& value, bool isTombstone);
+		uint64_t scanHalf (unsigned int half, uint32_t generation); // returns the end of the valid records
+
+		bool reserveSpace (uint64_t recordSize);
+		void startCompaction();
+		void copyNextOldRecord();
+		void finishCompaction();
+		void forgetLocation (const RecordLocation& location); // updates the live byte counts for a superseded record
+};
+
+#endif // LOGKEYVALUESTORE_HPP
@@ -0,0 +1,38 @@
+#ifndef LZBLOCKCODEC_HPP
+#define LZBLOCKCODEC_HPP
+
+/**************************************************************************
+ * An LzBlockCodec compresses independent blocks of up to 64KiB with a
+ * fast greedy LZ77 scheme using the LZ4 block format (a token byte with
+ * literal and match lengths, the literals, then a 16-bit match offset).
+ *
+ * Compression uses a small hash table owned by the codec, so nothing is
+ * allocated per block. Decompression never reads or writes outside of
+ * the buffers it's given, even for corrupt input.
+**************************************************************************/
+
+#include <stdint.h>
+#include <vector>
+
+#define LZ_BLOCK_CODEC_MAX_BLOCK_SIZE 65536
+
+class LzBlockCodec
+{
+	public:
+		LzBlockCodec (unsigned int hashTableBits = 12);
+		~LzBlockCodec();
+
+		// returns the compressed size, or 0 if the block doesn't fit in destCapacity (incompressible data)
+		unsigned int compress (const uint8_t* src, unsigned int srcSize, uint8_t* dest, unsigned int destCapacity);
+
+		// returns false if the compressed data is corrupt or doesn't decompress to exactly destSize bytes
+		static bool decompress (const uint8_t* src, unsigned int srcSize, uint8_t* dest, unsigned int destSize);
+
+	private:
+		unsigned int 		m_HashTableBits;
+		std::vector<uint16_t> 	m_HashTable; // positions in the current block, indexed by a hash of 4 bytes
+
+		unsigned int hash (const uint8_t* src) const;
+};
+
+#endif // LZBLOCKCODEC_HPP
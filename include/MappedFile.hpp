@@ -0,0 +1,75 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+/**************************************************************************
+ * A MappedFile is a storage media that maps a whole file into memory with
+ * mmap, for host side tools that work on large images.
+ *
+ * Reads that return SharedData are views straight into the mapping, so
+ * no copy is made, but they are only valid while the MappedFile exists.
+ * Writes go to the page cache and reach the file when the kernel decides,
+ * or when flush() is called. setAccessPattern() tells the kernel how the
+ * file will be read, so it can read ahead (or not) to match.
+ *
+ * Mappings can't grow, so the file is extended to sizeInBytes when it's
+ * opened and accesses past the end of the file are ignored.
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+
+#include <string>
+
+enum class MAPPED_FILE_ACCESS
+{
+	NORMAL,
+	SEQUENTIAL, // aggressive read ahead, pages can be dropped soon after they're read
+	RANDOM 	    // no read ahead
+};
+
+class MappedFile : public IStorageMedia
+{
+	public:
+		// a sizeInBytes of 0 maps the file as it is, otherwise the file is created or extended to at least this size
+		MappedFile (const std::string& fileName, uint64_t sizeInBytes = 0);
+		~MappedFile() override;
+
+		void writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes) override;
+		void readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes) override;
+		void readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes) override;
+		void discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes) override;
+
+		bool needsInitialization() override { return false; }
+		void initialize() override {}
+		void afterInitialize() override {}
+
+		IStorageMediaInfo getMediaInfo() override;
+
+		bool isOpen() { return m_Mapping != nullptr; }
+
+		bool flush (bool waitForCompletion = true); // writes every dirty page back to the file
+		bool flush (const uint64_t offsetInBytes, const uint64_t sizeInBytes, bool waitForCompletion = true);
+
+		void setAccessPattern (const MAPPED_FILE_ACCESS& accessPattern);
+		void prefetch (const uint64_t offsetInBytes, const uint64_t sizeInBytes); // starts reading the range in the background
+
+	private:
+		std::string 	m_FileName;
+		int 		m_FileDescriptor;
+		uint8_t* 	m_Mapping;
+		uint64_t 	m_SizeInBytes;
+		unsigned int 	m_PageSizeInBytes;
+
+		bool isInRange (const uint64_t offsetInBytes, const uint64_t sizeInBytes)
+		{
+			return offsetInBytes <= m_SizeInBytes && sizeInBytes <= m_SizeInBytes - offsetInBytes;
+		}
+		bool adviseRange (const uint64_t offsetInBytes, const uint64_t sizeInBytes, int advice);
+};
+
+#endif // MAPPEDFILE_HPP
@@ -0,0 +1,69 @@
+#ifndef PARALLELMEDIAREADER_HPP
+#define PARALLELMEDIAREADER_HPP
+
+/**************************************************************************
+ * A ParallelMediaReader reads a large region of a storage media on a pool
+ * of threads, for host tools that verify or convert whole card images.
+ *
+ * The region is split into chunks, the worker threads read ahead into
+ * free chunk buffers while the calling thread hands the finished chunks to
+ * the consumer strictly in order. The buffers are allocated once and their
+ * total is kept within the memory budget, so the workers stall rather than
+ * run further ahead than the budget allows.
+ *
+ * The workers call readFromMedia64() with their own buffers at the same
+ * time, so the media has to allow that, like a CPPFile in positional mode
+ * or a MappedFile. The consumer runs on the thread that called read().
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// the chunk is only valid during the call, returning false stops the read
+typedef std::function<bool(uint64_t offsetInBytes, const SharedData<uint8_t>& chunk)> ParallelMediaReaderConsumer;
+
+class ParallelMediaReader
+{
+	public:
+		// 0 threads uses one per core, the budget is always enough for at least one chunk and is capped just under 4GiB
+		ParallelMediaReader (IStorageMedia& media, unsigned int numThreads = 0, unsigned int chunkSizeInBytes = 1048576,
+					uint64_t memoryBudgetInBytes = 67108864, IAllocator* allocator = nullptr);
+		~ParallelMediaReader();
+
+		// blocks until the whole region has gone to the consumer, returns false if the consumer stopped it
+		bool read (uint64_t offsetInBytes, uint64_t sizeInBytes, const ParallelMediaReaderConsumer& consumer);
+
+		unsigned int getNumThreads() { return m_Threads.size(); }
+		unsigned int getNumChunkBuffers() { return m_NumChunkBuffers; }
+
+	private:
+		IStorageMedia& 			m_Media;
+		unsigned int 			m_ChunkSizeInBytes;
+		unsigned int 			m_NumChunkBuffers;
+		SharedData<uint8_t> 		m_ChunkBuffers; // all of the chunk buffers back to back
+		std::vector<bool> 		m_ChunkBufferReady; // the worker has finished reading into it
+
+		std::vector<std::thread> 	m_Threads;
+		std::mutex 			m_Mutex; // guards everything below
+		std::condition_variable 	m_WorkAvailable;
+		std::condition_variable 	m_ChunkReady;
+		bool 				m_ShuttingDown;
+
+		// the current read, chunk n always goes in buffer n % m_NumChunkBuffers
+		uint64_t 			m_OffsetInBytes;
+		uint64_t 			m_SizeInBytes;
+		uint64_t 			m_NumChunks;
+		uint64_t 			m_NextChunk; // next one a worker picks up
+		uint64_t 			m_NumChunksConsumed;
+		unsigned int 			m_NumChunksBeingRead;
+
+		void worker();
+		SharedData<uint8_t> getChunk (uint64_t chunkNum);
+};
+
+#endif // PARALLELMEDIAREADER_HPP
@@ -0,0 +1,54 @@
+#ifndef PARTITIONSTORAGEMEDIA_HPP
+#define PARTITIONSTORAGEMEDIA_HPP
+
+/**************************************************************************
+ * A PartitionStorageMedia is a view of part of a parent IStorageMedia.
+ * Offsets are shifted by the start of the partition and the callers data
+ * is handed straight to the parent, so the view never copies anything.
+ *
+ * Accesses that don't fit entirely in the partition are ignored (reads
+ * return null data) instead of spilling into a neighbouring partition.
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+#include "PartitionTable.hpp"
+
+class PartitionStorageMedia : public IStorageMedia
+{
+	public:
+		PartitionStorageMedia (IStorageMedia& parent, uint64_t offsetInBytes, uint64_t sizeInBytes);
+		PartitionStorageMedia (IStorageMedia& parent, const PartitionInfo& partition);
+		~PartitionStorageMedia() override;
+
+		void writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes) override;
+		void readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes) override;
+		void readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes) override;
+		void discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes) override;
+
+		bool needsInitialization() override { return m_Parent.needsInitialization(); }
+		void initialize() override { m_Parent.initialize(); }
+		void afterInitialize() override { m_Parent.afterInitialize(); }
+
+		IStorageMediaInfo getMediaInfo() override;
+
+		uint64_t getOffsetInBytes() { return m_OffsetInBytes; }
+		uint64_t getSizeInBytes() { return m_SizeInBytes; }
+
+	private:
+		IStorageMedia& 	m_Parent;
+		uint64_t 	m_OffsetInBytes;
+		uint64_t 	m_SizeInBytes;
+
+		bool isInRange (const uint64_t offsetInBytes, const unsigned int sizeInBytes)
+		{
+			return offsetInBytes <= m_SizeInBytes && sizeInBytes <= m_SizeInBytes - offsetInBytes;
+		}
+};
+
+#endif // PARTITIONSTORAGEMEDIA_HPP
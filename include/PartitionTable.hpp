@@ -0,0 +1,71 @@
+#ifndef PARTITIONTABLE_HPP
+#define PARTITIONTABLE_HPP
+
+/**************************************************************************
+ * A PartitionTable reads the partitions of an IStorageMedia. MBR primary
+ * partitions and the logical partitions chained in an extended partition
+ * are supported, as well as GPT (detected through its protective MBR).
+ *
+ * Each partition can be turned into a PartitionStorageMedia, so that a
+ * filesystem or raw streaming code can use it as a media of its own.
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+
+#include <string>
+#include <vector>
+
+#define MBR_PARTITION_TYPE_EMPTY 		0x00
+#define MBR_PARTITION_TYPE_FAT32_CHS 		0x0B
+#define MBR_PARTITION_TYPE_FAT32_LBA 		0x0C
+#define MBR_PARTITION_TYPE_EXTENDED_CHS 	0x05
+#define MBR_PARTITION_TYPE_EXTENDED_LBA 	0x0F
+#define MBR_PARTITION_TYPE_EXTENDED_LINUX 	0x85
+#define MBR_PARTITION_TYPE_GPT_PROTECTIVE 	0xEE
+
+enum class PARTITION_TABLE_TYPE : unsigned int
+{
+	NONE = 0,
+	MBR,
+	GPT
+};
+
+struct PartitionInfo
+{
+	uint64_t 	m_OffsetInBytes = 0;
+	uint64_t 	m_SizeInBytes = 0;
+	uint8_t 	m_MbrType = MBR_PARTITION_TYPE_EMPTY; 	// 0 for gpt partitions
+	bool 		m_IsLogical = false; 			// true for partitions inside an mbr extended partition
+	uint8_t 	m_GptTypeGuid[16] = {}; 		// all zero for mbr partitions, in on-disk byte order
+	std::string 	m_Name; 				// the gpt partition name (ascii only), empty for mbr partitions
+};
+
+class PartitionTable
+{
+	public:
+		PartitionTable (IStorageMedia& media, unsigned int sectorSizeInBytes = 512);
+		~PartitionTable();
+
+		bool read(); // returns false if the media doesn't contain a valid partition table
+
+		PARTITION_TABLE_TYPE getType() { return m_Type; }
+		unsigned int getNumPartitions() { return m_Partitions.size(); }
+		const PartitionInfo& getPartition (unsigned int partitionNum) { return m_Partitions[partitionNum]; }
+		const std::vector<PartitionInfo>& getPartitions() { return m_Partitions; }
+
+	private:
+		IStorageMedia& 			m_Media;
+		unsigned int 			m_SectorSizeInBytes;
+		PARTITION_TABLE_TYPE 		m_Type;
+		std::vector<PartitionInfo> 	m_Partitions;
+
+		SharedData<uint8_t> readSector (uint64_t lba);
+		bool readMbr();
+		void readExtendedPartition (uint64_t extendedStartLba, uint64_t extendedNumSectors);
+		bool readGpt();
+		bool readGptHeader (uint64_t lba, uint64_t& entriesLba, uint32_t& numEntries, uint32_t& entrySize, uint32_t& entriesCrc);
+
+		static bool isExtendedType (uint8_t mbrType);
+};
+
+#endif // PARTITIONTABLE_HPP
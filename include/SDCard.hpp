@@ -14,15 +14,29 @@ class SDCard : public IStorageMedia
 		SharedData<uint8_t> readFromMedia (const unsigned int sizeInBytes, const unsigned int address) override;
 		void readFromMedia (const unsigned int address, const SharedData<uint8_t>& data) override;
 
+		void writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t address) override;
+		SharedData<uint8_t> readFromMedia64 (const unsigned int sizeInBytes, const uint64_t address) override;
+		void readFromMedia64 (const uint64_t address, const SharedData<uint8_t>& data) override;
+
+		// only the blocks entirely inside the range are erased, the partial blocks at either end are left as they are
+		void discard (const unsigned int address, const unsigned int sizeInBytes) override;
+		void discard64 (const uint64_t address, const uint64_t sizeInBytes) override;
 
 		bool writeSingleBlock (const SharedData<uint8_t>& data, const unsigned int blockNum);
-		bool writeMultipleBlocks (const SharedData<uint8_t>& data, const unsigned int startBlockNum);
+		// stops at the first rejected block, numBlocksWritten is set to how many were accepted before it
+		bool writeMultipleBlocks (const SharedData<uint8_t>& data, const unsigned int startBlockNum, unsigned int* numBlocksWritten = nullptr);
 		SharedData<uint8_t> readSingleBlock (const unsigned int blockNum);
+		bool readMultipleBlocks (const SharedData<uint8_t>& data, const unsigned int startBlockNum); // reads straight into data
+		bool eraseBlocks (const unsigned int startBlockNum, const unsigned int endBlockNum); // end block is included
 
 		virtual bool needsInitialization() override { return false; }
 		virtual void initialize() override; // this needs to be called before any writing or reading is done
 		virtual void afterInitialize() override {}
 
+		IStorageMediaInfo getMediaInfo() override; // only valid after initialize
+
+		unsigned int getNumCrcErrors() { return m_NumCrcErrors; } // data blocks that failed their crc check, including retried ones
+
 	private:
 		SPI_NUM 	m_SpiNum;
 		GPIO_PORT 	m_CSPort; // chip select pin port
@@ -30,6 +44,9 @@ class SDCard : public IStorageMedia
 		unsigned int 	m_BlockSize;
 		bool 		m_UsingBlockAddressing; // true for block addressing, otherwise using byte addressing
 		unsigned int 	m_ByteAddressingMultiplier; // 1 for block addressing, otherwise block size
+		uint64_t 	m_CapacityInBytes; // read from the csd register on initialize
+		unsigned int 	m_EraseSizeInBytes; // read from the csd register on initialize
+		unsigned int 	m_NumCrcErrors;
 
 		struct R1CommandResult
 		{
@@ -42,15 +59,22 @@ class SDCard : public IStorageMedia
 			bool ParameterError 	= false;
 		};
 
-		uint8_t sendCommand (uint8_t commandNum, uint8_t arg1, uint8_t arg2, uint8_t arg3, uint8_t arg4, uint8_t crc = 0x01,
-					bool leaveCSLow =false);
+		uint8_t sendCommand (uint8_t commandNum, uint8_t arg1, uint8_t arg2, uint8_t arg3, uint8_t arg4, bool leaveCSLow = false);
 		bool isVersion2Card();
 		R1CommandResult interpretR1CommandResultByte (uint8_t commandResultByte);
 
 		void setBlockSize (const unsigned int blockSize);
 		unsigned int getBlockSize();
 
+		bool isInRange (const uint64_t address, const unsigned int sizeInBytes); // true if capacity is unknown
+		bool getCommandAddress (const unsigned int blockNum, uint32_t& address); // false if the address doesn't fit the command
+
+		bool readRange (const uint64_t address, uint8_t* data, const unsigned int sizeInBytes);
+
 		SharedData<uint8_t> readOCR();
+		SharedData<uint8_t> readCSD();
+		unsigned int getCSDBits (const SharedData<uint8_t>& csd, unsigned int msb, unsigned int lsb); // bit numbers as in the spec
+		void readCapacityAndEraseSize();
 };
 
 #endif // SDCARD_HPP
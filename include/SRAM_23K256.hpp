@@ -16,6 +16,7 @@ class Sram_23K256 : public IStorageMedia
 {
 	public:
 		static const int SRAM_SIZE = 32768;
+		static const int SRAM_PAGE_SIZE = 32;
 
 		Sram_23K256 (const SPI_NUM& spiNum, const GPIO_PORT& csPort, const GPIO_PIN& csPin);
 		~Sram_23K256();
@@ -42,6 +43,8 @@ class Sram_23K256 : public IStorageMedia
 		virtual void initialize() override {}
 		virtual void afterInitialize() override {}
 
+		IStorageMediaInfo getMediaInfo() override;
+
 	private:
 		SPI_NUM   m_SpiNum;
 		GPIO_PORT m_CSPort; // chip select pin port
@@ -83,6 +86,8 @@ class Sram_23K256_Manager : public IStorageMedia
 		virtual void initialize() override {}
 		virtual void afterInitialize() override {}
 
+		IStorageMediaInfo getMediaInfo() override;
+
 		// sets the function pointers to the private static dma functions
 		void setDmaMode (std::function<void()>* txComplete, std::function<void()>* rxComplete);
 		void setDmaTransferCompleteCallback (std::function<void()> callback) { m_DmaTransferCompleteCallback = callback; }
@@ -217,7 +217,8 @@ class SharedData
 		{
 			if ( m_RefCount )
 			{
-				if ( m_Data && m_Data != other.m_Data )
+				// release our reference unless we already share the same ref count, null data owns a ref count as well
+				if ( m_RefCount != other.m_RefCount )
 				{
 					(*m_RefCount)--;
 
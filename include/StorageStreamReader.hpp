@@ -0,0 +1,71 @@
+#ifndef STORAGESTREAMREADER_HPP
+#define STORAGESTREAMREADER_HPP
+
+/**************************************************************************
+ * A StorageStreamReader streams a region of a storage media (usually an
+ * audio file) into a ring of buffers, so the consumer never has to wait
+ * on the media.
+ *
+ * service() is called from the main loop and fills every empty buffer,
+ * blocking on the media as needed. read() is called from the consumer,
+ * usually the audio interrupt, and only ever copies out of buffers that
+ * are already full. The two sides only share a pair of atomic indices, so
+ * read() never blocks or allocates. If the consumer catches up with the
+ * media, read() returns what it has and counts an underrun.
+ *
+ * More buffers ride out longer media stalls (an sd card busy with wear
+ * leveling for example) at the cost of ram.
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+
+#include <atomic>
+
+class StorageStreamReader
+{
+	public:
+		StorageStreamReader (IStorageMedia& media, uint64_t startOffsetInBytes, uint64_t sizeInBytes, unsigned int bufferSizeInBytes,
+					unsigned int numBuffers = 2, bool loop = false, IAllocator* allocator = nullptr);
+		~StorageStreamReader();
+
+		// main loop side, returns the number of buffers filled
+		unsigned int service();
+
+		// consumer side, safe to call from an interrupt, returns the number of bytes copied
+		unsigned int read (uint8_t* destination, unsigned int sizeInBytes);
+		bool isFinished(); // true once the whole region has been read, never true when looping
+
+		unsigned int getNumFullBuffers();
+		unsigned int getNumUnderruns() { return m_NumUnderruns.load( std::memory_order_relaxed ); }
+
+	private:
+		IStorageMedia& 			m_Media;
+		uint64_t 			m_StartOffsetInBytes;
+		uint64_t 			m_SizeInBytes;
+		unsigned int 			m_BufferSizeInBytes;
+		unsigned int 			m_NumBuffers;
+		bool 				m_Loop;
+
+		SharedData<uint8_t> 		m_Buffers; // all of the buffers back to back
+		SharedData<unsigned int> 	m_FillSizes; // bytes of valid data in each buffer, only the last buffer is short
+
+		// only touched by service()
+		uint64_t 			m_MediaPosition; // relative to the start offset
+
+		// only touched by read()
+		unsigned int 			m_BufferPosition; // how far into the oldest full buffer the consumer is
+
+		// both indices count up to twice the number of buffers, so a full ring and an empty ring look different
+		std::atomic<unsigned int> 	m_WriteIndex; // only service() stores this
+		std::atomic<unsigned int> 	m_ReadIndex; // only read() stores this
+		std::atomic<bool> 		m_MediaFinished;
+		std::atomic<unsigned int> 	m_NumUnderruns;
+
+		unsigned int nextIndex (unsigned int index) { return ( index + 1 ) % ( m_NumBuffers * 2 ); }
+		unsigned int getNumFullBuffers (unsigned int writeIndex, unsigned int readIndex)
+		{
+			return ( writeIndex + m_NumBuffers * 2 - readIndex ) % ( m_NumBuffers * 2 );
+		}
+};
+
+#endif // STORAGESTREAMREADER_HPP
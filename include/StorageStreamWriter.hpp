@@ -0,0 +1,72 @@
+#ifndef STORAGESTREAMWRITER_HPP
+#define STORAGESTREAMWRITER_HPP
+
+/**************************************************************************
+ * A StorageStreamWriter is the recording side of a StorageStreamReader.
+ * It collects a stream (usually audio) into a ring of buffers and writes
+ * the full ones to a region of a storage media.
+ *
+ * write() is called from the producer, usually the audio interrupt, and
+ * only copies into a buffer. It never blocks or allocates. service() is
+ * called from the main loop and writes every full buffer to the media,
+ * blocking as needed. If the media falls so far behind that every buffer
+ * is full, write() drops the data and counts an overrun.
+ *
+ * Once the producer has stopped, finish() writes out the partly filled
+ * last buffer.
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+
+#include <atomic>
+
+class StorageStreamWriter
+{
+	public:
+		StorageStreamWriter (IStorageMedia& media, uint64_t startOffsetInBytes, uint64_t sizeInBytes, unsigned int bufferSizeInBytes,
+					unsigned int numBuffers = 2, IAllocator* allocator = nullptr);
+		~StorageStreamWriter();
+
+		// main loop side, returns the number of buffers written to the media
+		unsigned int service();
+		void finish(); // only once write() will no longer be called, then writes everything that's left
+
+		// producer side, safe to call from an interrupt, returns the number of bytes taken
+		unsigned int write (const uint8_t* source, unsigned int sizeInBytes);
+		bool isFull(); // true once the whole region has been taken, later writes are ignored
+
+		unsigned int getNumFullBuffers();
+		unsigned int getNumOverruns() { return m_NumOverruns.load( std::memory_order_relaxed ); }
+		uint64_t getNumBytesWritten() { return m_MediaPosition; } // bytes that have reached the media
+
+	private:
+		IStorageMedia& 			m_Media;
+		uint64_t 			m_StartOffsetInBytes;
+		uint64_t 			m_SizeInBytes;
+		unsigned int 			m_BufferSizeInBytes;
+		unsigned int 			m_NumBuffers;
+
+		SharedData<uint8_t> 		m_Buffers; // all of the buffers back to back
+		SharedData<unsigned int> 	m_FillSizes; // bytes of valid data in each full buffer
+
+		// only touched by service()
+		uint64_t 			m_MediaPosition; // relative to the start offset
+
+		// only touched by write()
+		unsigned int 			m_BufferPosition; // how far into the buffer being filled the producer is
+		uint64_t 			m_NumBytesTaken;
+
+		// both indices count up to twice the number of buffers, so a full ring and an empty ring look different
+		std::atomic<unsigned int> 	m_WriteIndex; // only write() stores this
+		std::atomic<unsigned int> 	m_ReadIndex; // only service() stores this
+		std::atomic<unsigned int> 	m_NumOverruns;
+
+		unsigned int nextIndex (unsigned int index) { return ( index + 1 ) % ( m_NumBuffers * 2 ); }
+		unsigned int getNumFullBuffers (unsigned int writeIndex, unsigned int readIndex)
+		{
+			return ( writeIndex + m_NumBuffers * 2 - readIndex ) % ( m_NumBuffers * 2 );
+		}
+		void publishBuffer(); // hands the buffer being filled over to service()
+};
+
+#endif // STORAGESTREAMWRITER_HPP
@@ -0,0 +1,57 @@
+#ifndef STORAGETRACEREPLAYER_HPP
+#define STORAGETRACEREPLAYER_HPP
+
+/**************************************************************************
+ * A StorageTraceReplayer drives any IStorageMedia with a trace recorded by
+ * a TracingStorageMedia and measures how it copes, so a cache stack or a
+ * new device can be compared on real access patterns.
+ *
+ * The operations are replayed back to back in their recorded order, the
+ * gaps between them aren't reproduced. Writes carry a fixed pattern since
+ * traces don't hold data. With the same media, trace and clock, a replay
+ * always does the same thing, so with a FakeStorageDevice on its virtual
+ * clock the results are exactly repeatable.
+**************************************************************************/
+
+#include "TracingStorageMedia.hpp"
+
+#include <vector>
+
+struct StorageTraceReplayResult
+{
+	unsigned int 	m_NumReads;
+	unsigned int 	m_NumWrites;
+	unsigned int 	m_NumDiscards;
+	uint64_t 	m_BytesRead;
+	uint64_t 	m_BytesWritten;
+	uint64_t 	m_TotalTimeInNs;
+	double 		m_BytesPerSecond; // reads and writes together
+
+	// per operation, discards included
+	uint64_t 	m_MedianLatencyInNs;
+	uint64_t 	m_P90LatencyInNs;
+	uint64_t 	m_P99LatencyInNs;
+	uint64_t 	m_P999LatencyInNs;
+	uint64_t 	m_MaxLatencyInNs;
+};
+
+class StorageTraceReplayer
+{
+	public:
+		StorageTraceReplayer (IStorageMedia& media, StorageTraceClock clock = nullptr);
+		~StorageTraceReplayer();
+
+		// returns false if the trace is malformed, nothing is replayed then
+		bool replay (const uint8_t* trace, unsigned int sizeInBytes, StorageTraceReplayResult& result);
+		void replay (const std::vector<StorageTraceRecord>& records, StorageTraceReplayResult& result);
+
+		// from the last replay, percentile is 0 to 100
+		uint64_t getLatencyPercentile (double percentile);
+
+	private:
+		IStorageMedia& 		m_Media;
+		StorageTraceClock 	m_Clock;
+		std::vector<uint64_t> 	m_Latencies; // sorted after each replay
+};
+
+#endif // STORAGETRACEREPLAYER_HPP
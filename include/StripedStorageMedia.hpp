@@ -0,0 +1,86 @@
+#ifndef STRIPEDSTORAGEMEDIA_HPP
+#define STRIPEDSTORAGEMEDIA_HPP
+
+/**************************************************************************
+ * A StripedStorageMedia spreads its address space round-robin across
+ * several child storage media in units of a configurable stripe size
+ * (RAID-0), so that large transfers keep every device busy instead of
+ * filling one device before the next.
+ *
+ * Each request results in at most one contiguous transfer per child. The
+ * transfers are grouped by bus number, and the groups are handed to a
+ * dispatcher which may run them concurrently (with threads on a host,
+ * or by kicking off dma on independent buses). Without a dispatcher the
+ * groups are simply run one after another.
+ *
+ * The child media should be initialized before use, initialize() is only
+ * forwarded to children that report needing initialization.
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+
+#include <functional>
+#include <vector>
+
+struct StripedStorageMediaMember
+{
+	IStorageMedia* 	m_Media;
+	unsigned int 	m_BusNum; // members with the same bus number will never be accessed concurrently
+
+	StripedStorageMediaMember (IStorageMedia* media, unsigned int busNum) :
+		m_Media( media ),
+		m_BusNum( busNum ) {}
+};
+
+// runs each of the given jobs once, returning only after all of them have finished
+typedef std::function<void(const std::vector<std::function<void()>>&)> StripedStorageMediaDispatcher;
+
+class StripedStorageMedia : public IStorageMedia
+{
+	public:
+		StripedStorageMedia (const std::vector<StripedStorageMediaMember>& members, unsigned int stripeUnitInBytes);
+		~StripedStorageMedia() override;
+
+		void writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes) override;
+		void readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes) override;
+		void readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes) override;
+		void discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes) override;
+
+		bool needsInitialization() override;
+		void initialize() override;
+		void afterInitialize() override;
+
+		IStorageMediaInfo getMediaInfo() override;
+
+		void setDispatcher (StripedStorageMediaDispatcher dispatcher) { m_Dispatcher = dispatcher; }
+
+		unsigned int getStripeUnitInBytes() { return m_StripeUnitInBytes; }
+
+	private:
+		std::vector<StripedStorageMediaMember> 	m_Members;
+		unsigned int 				m_StripeUnitInBytes;
+		StripedStorageMediaDispatcher 		m_Dispatcher;
+
+		// the part of a request that lands on a single member, which is always contiguous on that member
+		struct MemberTransfer
+		{
+			uint64_t 		m_MemberOffset = 0;
+			unsigned int 		m_SizeInBytes = 0;
+			SharedData<uint8_t> 	m_Data = SharedData<uint8_t>::MakeSharedDataNull();
+		};
+
+		// returns true if the whole request lands on a single member
+		bool planTransfers (const uint64_t offsetInBytes, const unsigned int sizeInBytes, std::vector<MemberTransfer>& transfers);
+		// gathers the callers data into (allocated) member buffers, or scatters the member buffers back into the callers data
+		void copyStripes (const uint64_t offsetInBytes, const SharedData<uint8_t>& data, std::vector<MemberTransfer>& transfers,
+					bool toMembers);
+		void runTransfers (std::vector<MemberTransfer>& transfers, bool writing);
+};
+
+#endif // STRIPEDSTORAGEMEDIA_HPP
@@ -0,0 +1,87 @@
+#ifndef TIEREDSTORAGEMEDIA_HPP
+#define TIEREDSTORAGEMEDIA_HPP
+
+/**************************************************************************
+ * A TieredStorageMedia puts a small fast storage media (such as sram) in
+ * front of a large slow one (such as an sd card or eeprom). The address
+ * space is that of the slow tier, divided into fixed size extents. The
+ * access frequency of each extent is tracked, and extents that become
+ * hot are promoted into the fast tier, demoting the coldest resident
+ * extent if the fast tier is full.
+ *
+ * Writes to resident extents only go to the fast tier and are written
+ * back to the slow tier when the extent is demoted or when flush() is
+ * called. The placement metadata is kept in ram, so flush() must be
+ * called before powering down if the fast tier is volatile.
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+
+#include <unordered_map>
+#include <vector>
+
+class TieredStorageMedia : public IStorageMedia
+{
+	public:
+		// the number of extents held by the fast tier is derived from its capacity
+		TieredStorageMedia (IStorageMedia& fastTier, IStorageMedia& slowTier, unsigned int extentSizeInBytes,
+					unsigned int promotionThreshold = 2);
+		~TieredStorageMedia() override;
+
+		void writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes) override;
+		void readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes) override;
+		void readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes) override;
+		void discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes) override;
+
+		bool needsInitialization() override;
+		void initialize() override;
+		void afterInitialize() override;
+
+		IStorageMediaInfo getMediaInfo() override;
+
+		void flush(); // writes every dirty extent back to the slow tier
+
+		unsigned int getNumFastExtents() { return m_Slots.size(); }
+		unsigned int getFastTierHits() { return m_FastTierHits; }
+		unsigned int getSlowTierHits() { return m_SlowTierHits; }
+
+	private:
+		IStorageMedia& 					m_FastTier;
+		IStorageMedia& 					m_SlowTier;
+		unsigned int 					m_ExtentSizeInBytes;
+		unsigned int 					m_PromotionThreshold; // accesses needed before a slow extent is promoted
+		uint64_t 					m_SlowTierCapacityInBytes; // the last extent may be cut short by this
+
+		// placement metadata, slot n lives at n * m_ExtentSizeInBytes in the fast tier
+		struct ExtentSlot
+		{
+			uint64_t 	m_ExtentNum = 0;
+			unsigned int 	m_Heat = 0;
+			bool 		m_InUse = false;
+			bool 		m_Dirty = false;
+		};
+
+		std::vector<ExtentSlot> 			m_Slots;
+		std::unordered_map<uint64_t, unsigned int> 	m_ResidentExtents; // extent num to slot num
+		std::unordered_map<uint64_t, unsigned int> 	m_SlowExtentHeat; // extent num to access count for extents in the slow tier
+		unsigned int 					m_AccessesSinceDecay;
+
+		unsigned int 					m_FastTierHits;
+		unsigned int 					m_SlowTierHits;
+
+		// handles the part of a request that lands in a single extent
+		void accessExtent (const uint64_t extentNum, const unsigned int offsetInExtent, const SharedData<uint8_t>& data, bool writing);
+		// returns false if the extent isn't hot enough
+		bool promoteExtent (const uint64_t extentNum, unsigned int& slotNum, bool loadFromSlowTier);
+		unsigned int getExtentSize (const uint64_t extentNum);
+		void writeBackSlot (ExtentSlot& slot, unsigned int slotNum);
+		void decayHeat();
+};
+
+#endif // TIEREDSTORAGEMEDIA_HPP
@@ -0,0 +1,88 @@
+#ifndef TRACINGSTORAGEMEDIA_HPP
+#define TRACINGSTORAGEMEDIA_HPP
+
+/**************************************************************************
+ * A TracingStorageMedia passes everything through to a child media and
+ * records each read, write and discard in a compact binary trace, so real
+ * access patterns can be replayed later with a StorageTraceReplayer.
+ *
+ * The trace starts with a 4 byte magic and a version byte. Each record is
+ * an op byte followed by varints: the time since the previous record, how
+ * long the child took, the offset relative to where the previous access
+ * ended (zigzag encoded, so sequential access costs a single byte) and the
+ * size. Records are typically 5 to 12 bytes.
+ *
+ * Times come from the clock function, which defaults to the steady clock.
+ * A FakeStorageDevice's virtual clock can be used to keep traces
+ * deterministic. Only the access pattern is recorded, not the data.
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+
+#include <functional>
+#include <vector>
+
+enum class STORAGE_TRACE_OP : uint8_t
+{
+	READ 	= 0,
+	WRITE 	= 1,
+	DISCARD = 2
+};
+
+struct StorageTraceRecord
+{
+	STORAGE_TRACE_OP 	m_Op;
+	uint64_t 		m_TimestampInNs; // since the trace started
+	uint64_t 		m_DurationInNs; // how long the traced media took
+	uint64_t 		m_OffsetInBytes;
+	uint64_t 		m_SizeInBytes;
+};
+
+// returns a time in nanoseconds, only differences between calls are used
+typedef std::function<uint64_t()> StorageTraceClock;
+
+class TracingStorageMedia : public IStorageMedia
+{
+	public:
+		TracingStorageMedia (IStorageMedia& child, StorageTraceClock clock = nullptr);
+		~TracingStorageMedia() override;
+
+		void writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes) override;
+		void readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes) override;
+		void readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes) override;
+		void discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes) override;
+
+		bool needsInitialization() override { return m_Child.needsInitialization(); }
+		void initialize() override { m_Child.initialize(); }
+		void afterInitialize() override { m_Child.afterInitialize(); }
+
+		IStorageMediaInfo getMediaInfo() override { return m_Child.getMediaInfo(); }
+
+		const std::vector<uint8_t>& getTrace() { return m_Trace; }
+		unsigned int getNumRecords() { return m_NumRecords; }
+		void clearTrace(); // starts a new trace, timestamps start from now
+
+		// returns false if the trace is malformed, the records decoded up to that point are still added
+		static bool DecodeTrace (const uint8_t* trace, unsigned int sizeInBytes, std::vector<StorageTraceRecord>& records);
+
+	private:
+		IStorageMedia& 		m_Child;
+		StorageTraceClock 	m_Clock;
+
+		std::vector<uint8_t> 	m_Trace;
+		unsigned int 		m_NumRecords;
+		uint64_t 		m_StartTimeInNs;
+		uint64_t 		m_LastTimestampInNs; // relative to the start
+		uint64_t 		m_LastEndOffsetInBytes;
+
+		void addRecord (const STORAGE_TRACE_OP& op, uint64_t startTimeInNs, uint64_t offsetInBytes, uint64_t sizeInBytes);
+		uint64_t now() { return m_Clock(); }
+};
+
+#endif // TRACINGSTORAGEMEDIA_HPP
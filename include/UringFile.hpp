@@ -0,0 +1,112 @@
+#ifndef URINGFILE_HPP
+#define URINGFILE_HPP
+
+/**************************************************************************
+ * A UringFile is a storage media that uses linux io_uring to read from
+ * and write to a file, so a single thread can keep many transfers in
+ * flight at once.
+ *
+ * readAsync() and writeAsync() only queue a transfer, nothing is handed to
+ * the kernel until submit() is called (or the queue is full), so a batch
+ * of transfers costs a single system call. Completions are picked up by
+ * poll() or wait(), which run the callback of each finished transfer on
+ * the calling thread. The queue depth limits how many transfers can be in
+ * flight, queueing another one when it's reached waits for the oldest.
+ *
+ * Buffers given to registerBuffers() are pinned by the kernel once, and
+ * any transfer that lies within one of them uses it automatically instead
+ * of mapping the memory for every transfer.
+ *
+ * The IStorageMedia functions are synchronous, they queue a transfer and
+ * wait for it, running the callbacks of any other transfers that finish
+ * in the meantime.
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// called with the number of bytes transferred, or a negative errno
+typedef std::function<void(int result)> UringFileCallback;
+
+class UringFile : public IStorageMedia
+{
+	public:
+		UringFile (const std::string& fileName, unsigned int queueDepth = 32);
+		~UringFile() override;
+
+		void writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes) override;
+		void readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes) override;
+		void readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		bool needsInitialization() override { return false; }
+		void initialize() override {}
+		void afterInitialize() override {}
+
+		IStorageMediaInfo getMediaInfo() override;
+
+		bool isOpen() { return m_RingFileDescriptor >= 0 && m_FileDescriptor >= 0; }
+
+		// the data is kept alive until the callback has run, returns false if the file isn't open
+		bool readAsync (const uint64_t offsetInBytes, const SharedData<uint8_t>& data, UringFileCallback callback = nullptr);
+		bool writeAsync (const uint64_t offsetInBytes, const SharedData<uint8_t>& data, UringFileCallback callback = nullptr);
+
+		unsigned int submit(); // hands every queued transfer to the kernel, returns how many
+		unsigned int poll(); // runs the callbacks of finished transfers without waiting, returns how many
+		void wait (unsigned int minCompletions = 1); // submits, then runs callbacks until at least this many transfers have finished
+		void waitForAll();
+
+		// waits for every transfer first, returns false if the kernel refused them
+		bool registerBuffers (const std::vector<SharedData<uint8_t>>& buffers);
+		void unregisterBuffers();
+
+		unsigned int getQueueDepth() { return m_Transfers.size(); }
+		unsigned int getNumInFlight() { return m_Transfers.size() - m_FreeTransfers.size(); } // queued or submitted, but not finished
+
+	private:
+		struct PendingTransfer
+		{
+			SharedData<uint8_t> 	m_Data = SharedData<uint8_t>::MakeSharedDataNull();
+			UringFileCallback 	m_Callback = nullptr;
+		};
+
+		std::string 				m_FileName;
+		int 					m_FileDescriptor;
+		int 					m_RingFileDescriptor;
+
+		// the rings shared with the kernel
+		void* 					m_SubmissionRing;
+		unsigned int 				m_SubmissionRingSize;
+		void* 					m_CompletionRing;
+		unsigned int 				m_CompletionRingSize;
+		io_uring_sqe* 				m_SubmissionEntries;
+		unsigned int 				m_SubmissionEntriesSize;
+		unsigned int* 				m_SubmissionTail;
+		unsigned int 				m_SubmissionMask;
+		unsigned int* 				m_SubmissionArray;
+		unsigned int* 				m_CompletionHead;
+		unsigned int* 				m_CompletionTail;
+		unsigned int 				m_CompletionMask;
+		io_uring_cqe* 				m_CompletionEntries;
+
+		std::vector<PendingTransfer> 		m_Transfers; // indexed by the user data of each entry
+		std::vector<unsigned int> 		m_FreeTransfers;
+		unsigned int 				m_NumUnsubmitted;
+		std::vector<SharedData<uint8_t>> 	m_RegisteredBuffers;
+
+		bool setupRings (unsigned int queueDepth);
+		bool queueTransfer (bool writing, const uint64_t offsetInBytes, const SharedData<uint8_t>& data, UringFileCallback callback);
+		bool transferAndWait (bool writing, const uint64_t offsetInBytes, const SharedData<uint8_t>& data);
+		unsigned int enter (unsigned int minCompletions);
+};
+
+#endif // URINGFILE_HPP
@@ -0,0 +1,73 @@
+#ifndef WEARLEVELINGSTORAGEMEDIA_HPP
+#define WEARLEVELINGSTORAGEMEDIA_HPP
+
+/**************************************************************************
+ * A WearLevelingStorageMedia spreads writes to a small, frequently
+ * updated address space over all of a child media (usually an eeprom),
+ * so that no cell gets rewritten much more often than any other.
+ *
+ * The child is divided into physical pages, each holding a small header
+ * (the logical page number, a sequence number and a crc) followed by the
+ * data of one logical page. Updating a logical page writes a new copy to
+ * the next free physical page round-robin, with the next sequence
+ * number, and leaves the old copy behind to be reused later. So every
+ * update is a single page write and endurance grows with the number of
+ * spare physical pages.
+ *
+ * mount() (or afterInitialize()) finds the latest copy of every logical
+ * page by reading only the headers, then checks the crc of just those
+ * copies. A copy torn by a power loss fails its crc and the previous copy
+ * is used instead. Logical pages that were never written read as zeros.
+**************************************************************************/
+
+#include "IStorageMedia.hpp"
+
+#include <vector>
+
+#define WEAR_LEVELING_HEADER_SIZE 8
+
+class WearLevelingStorageMedia : public IStorageMedia
+{
+	public:
+		// physicalPageSizeInBytes should match the child's page size so that each update is one page write
+		WearLevelingStorageMedia (IStorageMedia& child, unsigned int numLogicalPages, unsigned int physicalPageSizeInBytes = 32);
+		~WearLevelingStorageMedia() override;
+
+		void writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes) override;
+		void readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		void writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes) override;
+		SharedData<uint8_t> readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes) override;
+		void readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data) override;
+
+		bool needsInitialization() override { return m_Child.needsInitialization(); }
+		void initialize() override { m_Child.initialize(); }
+		void afterInitialize() override;
+
+		IStorageMediaInfo getMediaInfo() override;
+
+		void mount(); // finds the latest copy of each logical page
+
+		unsigned int getLogicalPageSizeInBytes() { return m_LogicalPageSizeInBytes; }
+		unsigned int getNumPhysicalPages() { return m_LiveSlots.size(); }
+
+	private:
+		IStorageMedia& 			m_Child;
+		unsigned int 			m_PhysicalPageSizeInBytes;
+		unsigned int 			m_LogicalPageSizeInBytes;
+		std::vector<uint32_t> 		m_LogicalToPhysical; // NO_PHYSICAL_PAGE if the logical page was never written
+		std::vector<bool> 		m_LiveSlots; // true if the physical page holds the latest copy of a logical page
+		unsigned int 			m_NextSlot; // where to start looking for a free physical page
+		uint32_t 			m_NextSequenceNum;
+		SharedData<uint8_t> 		m_PageBuffer; // one physical page
+
+		uint64_t getCapacityInBytes() { return static_cast<uint64_t>( m_LogicalToPhysical.size() ) * m_LogicalPageSizeInBytes; }
+		uint64_t getSlotOffset (uint32_t slotNum) { return static_cast<uint64_t>( slotNum ) * m_PhysicalPageSizeInBytes; }
+
+		void readLogicalPage (unsigned int logicalPageNum, unsigned int offsetInPage, const SharedData<uint8_t>& data);
+		void writeLogicalPage (unsigned int logicalPageNum); // writes the data in m_PageBuffer after the header
+		bool verifySlot (uint32_t slotNum); // reads the slot into m_PageBuffer and checks its crc
+};
+
+#endif // WEARLEVELINGSTORAGEMEDIA_HPP
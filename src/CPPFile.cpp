@@ -1,11 +1,90 @@
 #include "CPPFile.hpp"
 
-CPPFile::CPPFile (const std::string& fileName) :
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// group commit limits until setGroupCommitLimits is called
+#define DEFAULT_GROUP_COMMIT_SIZE 65536
+#define DEFAULT_GROUP_COMMIT_INTERVAL_MS 100
+// the file position isn't known to be where the next write goes
+#define NO_WRITE_POSITION 0xFFFFFFFFFFFFFFFF
+// direct mode offsets, sizes and buffers are kept to this, which covers the logical block size of any common device
+#define DIRECT_ALIGNMENT 4096
+// unaligned transfers are split into pieces of at most this through the bounce buffer
+#define DIRECT_BOUNCE_SIZE 1048576
+
+// pread and pwrite may transfer less than asked for, so these carry on until everything is done or there's an error
+static bool readAll (int fileDescriptor, uint8_t* data, uint64_t sizeInBytes, uint64_t offsetInBytes)
+{
+	while ( sizeInBytes > 0 )
+	{
+		const ssize_t numRead = pread( fileDescriptor, data, sizeInBytes, static_cast<off_t>(offsetInBytes) );
+		if ( numRead <= 0 ) return false;
+
+		data += numRead;
+		sizeInBytes -= numRead;
+		offsetInBytes += numRead;
+	}
+
+	return true;
+}
+
+// like readAll, but stops early at the end of the file, returns how much was read
+static uint64_t readUpTo (int fileDescriptor, uint8_t* data, uint64_t sizeInBytes, uint64_t offsetInBytes)
+{
+	uint64_t numReadTotal = 0;
+
+	while ( numReadTotal < sizeInBytes )
+	{
+		const ssize_t numRead = pread( fileDescriptor, data + numReadTotal, sizeInBytes - numReadTotal,
+						static_cast<off_t>(offsetInBytes + numReadTotal) );
+		if ( numRead <= 0 ) break;
+
+		numReadTotal += numRead;
+	}
+
+	return numReadTotal;
+}
+
+static bool writeAll (int fileDescriptor, const uint8_t* data, uint64_t sizeInBytes, uint64_t offsetInBytes)
+{
+	while ( sizeInBytes > 0 )
+	{
+		const ssize_t numWritten = pwrite( fileDescriptor, data, sizeInBytes, static_cast<off_t>(offsetInBytes) );
+		if ( numWritten <= 0 ) return false;
+
+		data += numWritten;
+		sizeInBytes -= numWritten;
+		offsetInBytes += numWritten;
+	}
+
+	return true;
+}
+
+CPPFile::CPPFile (const std::string& fileName, const CPP_FILE_DURABILITY& durability, const CPP_FILE_IO& io) :
 	m_FileName( fileName ),
-	m_NeedsInitialization( false )
+	m_NeedsInitialization( false ),
+	m_IO( io ),
+	m_FileDescriptor( -1 ),
+	m_BounceBuffer( nullptr ),
+	m_Durability( durability ),
+	m_GroupCommitSizeInBytes( DEFAULT_GROUP_COMMIT_SIZE ),
+	m_GroupCommitInterval( DEFAULT_GROUP_COMMIT_INTERVAL_MS ),
+	m_UnflushedBytes( 0 ),
+	m_LastFlushTime( std::chrono::steady_clock::now() ),
+	m_WritePosition( NO_WRITE_POSITION ),
+	m_InitialSizeInBytes( 0 ),
+	m_InitialAllocation( CPP_FILE_ALLOCATION::PREALLOCATE )
 {
-	m_File.open( "./" + m_FileName, std::fstream::in | std::fstream::out | std::ios::binary );
-	if ( !m_File.is_open() )
+	if ( m_IO == CPP_FILE_IO::DIRECT ) m_BounceBuffer = static_cast<uint8_t*>( aligned_alloc(DIRECT_ALIGNMENT, DIRECT_BOUNCE_SIZE) );
+
+	this->openFile( false );
+	if ( !m_File.is_open() && m_FileDescriptor < 0 )
 	{
 		m_NeedsInitialization = true;
 	}
@@ -13,29 +92,112 @@ CPPFile::CPPFile (const std::string& fileName) :
 
 CPPFile::~CPPFile()
 {
-	m_File.close();
+	// closing flushes whatever is still buffered
+	this->closeFile();
+
+	free( m_BounceBuffer );
 }
 
 void CPPFile::writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes)
 {
-	m_File.seekp( offsetInBytes );
-	m_File.write( reinterpret_cast<char*>(data.getPtr()), data.getSizeInBytes() );
-	m_File.flush();
+	this->writeToMedia64( data, offsetInBytes );
 }
 
 SharedData<uint8_t> CPPFile::readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes)
+{
+	return this->readFromMedia64( sizeInBytes, offsetInBytes );
+}
+
+void CPPFile::readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data)
+{
+	this->readFromMedia64( static_cast<uint64_t>(offsetInBytes), data );
+}
+
+void CPPFile::writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes)
+{
+	if ( m_IO == CPP_FILE_IO::DIRECT )
+	{
+		this->transferDirect( true, data.getPtr(), data.getSizeInBytes(), offsetInBytes );
+
+		return;
+	}
+
+	if ( m_IO == CPP_FILE_IO::POSITIONAL )
+	{
+		writeAll( m_FileDescriptor, data.getPtr(), data.getSizeInBytes(), offsetInBytes );
+
+		return;
+	}
+
+	// seeking pushes the buffered writes out to the os, so sequential writes skip it to let them build up
+	if ( offsetInBytes != m_WritePosition ) m_File.seekp( static_cast<std::streamoff>(offsetInBytes) );
+	m_File.write( reinterpret_cast<char*>(data.getPtr()), data.getSizeInBytes() );
+	m_WritePosition = ( m_File.good() ) ? offsetInBytes + data.getSizeInBytes() : NO_WRITE_POSITION;
+	m_UnflushedBytes += data.getSizeInBytes();
+
+	switch ( m_Durability )
+	{
+		case CPP_FILE_DURABILITY::FLUSH_EVERY_WRITE:
+			this->sync();
+
+			break;
+		case CPP_FILE_DURABILITY::GROUP_COMMIT:
+			if ( (m_GroupCommitSizeInBytes > 0 && m_UnflushedBytes >= m_GroupCommitSizeInBytes)
+					|| (m_GroupCommitInterval.count() > 0
+						&& std::chrono::steady_clock::now() - m_LastFlushTime >= m_GroupCommitInterval) )
+			{
+				this->sync();
+			}
+
+			break;
+		default:
+			break;
+	}
+}
+
+SharedData<uint8_t> CPPFile::readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes)
 {
 	SharedData<uint8_t> data = SharedData<uint8_t>::MakeSharedData( sizeInBytes );
 
-	m_File.seekg( offsetInBytes );
+	if ( m_IO == CPP_FILE_IO::DIRECT )
+	{
+		if ( ! this->transferDirect(false, data.getPtr(), sizeInBytes, offsetInBytes) ) return SharedData<uint8_t>::MakeSharedDataNull();
+
+		return data;
+	}
+
+	if ( m_IO == CPP_FILE_IO::POSITIONAL )
+	{
+		if ( ! readAll(m_FileDescriptor, data.getPtr(), sizeInBytes, offsetInBytes) ) return SharedData<uint8_t>::MakeSharedDataNull();
+
+		return data;
+	}
+
+	m_File.seekg( static_cast<std::streamoff>(offsetInBytes) );
+	m_WritePosition = NO_WRITE_POSITION;
 	m_File.read( reinterpret_cast<char*>(data.getPtr()), sizeInBytes );
 
 	return data;
 }
 
-void CPPFile::readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data)
+void CPPFile::readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data)
 {
-	m_File.seekg( offsetInBytes );
+	if ( m_IO == CPP_FILE_IO::DIRECT )
+	{
+		this->transferDirect( false, data.getPtr(), data.getSizeInBytes(), offsetInBytes );
+
+		return;
+	}
+
+	if ( m_IO == CPP_FILE_IO::POSITIONAL )
+	{
+		readAll( m_FileDescriptor, data.getPtr(), data.getSizeInBytes(), offsetInBytes );
+
+		return;
+	}
+
+	m_File.seekg( static_cast<std::streamoff>(offsetInBytes) );
+	m_WritePosition = NO_WRITE_POSITION;
 	m_File.read( reinterpret_cast<char*>(data.getPtr()), data.getSizeInBytes() );
 }
 
@@ -46,11 +208,191 @@ bool CPPFile::needsInitialization()
 
 void CPPFile::initialize()
 {
-	m_File.open( "./" + m_FileName, std::fstream::out | std::ios::binary );
+	this->openFile( true );
+
+	// if the file couldn't be created or grown (say the disk is full), it still needs initializing
+	const bool created = m_File.is_open() || m_FileDescriptor >= 0;
+	m_NeedsInitialization = ! created || ! this->allocateInitialSize();
+}
+
+IStorageMediaInfo CPPFile::getMediaInfo()
+{
+	uint64_t fileSize = 0;
+	struct stat fileStat;
+
+	if ( m_FileDescriptor >= 0 )
+	{
+		if ( fstat(m_FileDescriptor, &fileStat) == 0 ) fileSize = static_cast<uint64_t>( fileStat.st_size );
+	}
+	else if ( m_File.is_open() )
+	{
+		// a read past the end leaves the stream failed, which would make tellg() return -1
+		m_File.clear();
+		m_File.seekg( 0, std::ios::end );
+		const std::streamoff endPosition = m_File.tellg();
+		if ( endPosition > 0 ) fileSize = static_cast<uint64_t>( endPosition );
+		m_WritePosition = NO_WRITE_POSITION;
+	}
+
+	// files can be accessed at any offset, but transfers matching the typical filesystem block size are fastest
+	const unsigned int alignment = ( m_IO == CPP_FILE_IO::DIRECT ) ? DIRECT_ALIGNMENT : 1;
+
+	return IStorageMediaInfo( fileSize, 4096, alignment, 1, 1, false );
 }
 
 void CPPFile::afterInitialize()
 {
-	m_File.close();
-	m_File.open( "./" + m_FileName, std::fstream::in | std::fstream::out | std::ios::binary );
+	this->closeFile();
+	this->openFile( false );
+}
+
+void CPPFile::sync()
+{
+	// positional writes aren't buffered, they're already with the os
+	if ( m_File.is_open() ) m_File.flush();
+
+	m_UnflushedBytes = 0;
+	m_LastFlushTime = std::chrono::steady_clock::now();
+}
+
+void CPPFile::setGroupCommitLimits (unsigned int sizeInBytes, unsigned int intervalInMs)
+{
+	m_GroupCommitSizeInBytes = sizeInBytes;
+	m_GroupCommitInterval = std::chrono::milliseconds( intervalInMs );
+}
+
+void CPPFile::setInitialSize (uint64_t sizeInBytes, const CPP_FILE_ALLOCATION& allocation)
+{
+	m_InitialSizeInBytes = sizeInBytes;
+	m_InitialAllocation = allocation;
+}
+
+void CPPFile::openFile (bool create)
+{
+	m_WritePosition = NO_WRITE_POSITION;
+
+	if ( m_IO != CPP_FILE_IO::STREAM )
+	{
+		const int flags = ( create ) ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR;
+
+		// tmpfs and some other filesystems refuse O_DIRECT, those just get buffered positional transfers
+		if ( m_IO == CPP_FILE_IO::DIRECT )
+		{
+			m_FileDescriptor = open( ("./" + m_FileName).c_str(), flags | O_DIRECT, 0644 );
+			if ( m_FileDescriptor >= 0 || errno != EINVAL ) return;
+		}
+
+		m_FileDescriptor = open( ("./" + m_FileName).c_str(), flags, 0644 );
+
+		return;
+	}
+
+	if ( create )
+	{
+		m_File.open( "./" + m_FileName, std::fstream::out | std::ios::binary );
+	}
+	else
+	{
+		m_File.open( "./" + m_FileName, std::fstream::in | std::fstream::out | std::ios::binary );
+	}
+}
+
+void CPPFile::closeFile()
+{
+	if ( m_FileDescriptor >= 0 )
+	{
+		close( m_FileDescriptor );
+		m_FileDescriptor = -1;
+	}
+
+	if ( m_File.is_open() ) m_File.close();
+}
+
+bool CPPFile::allocateInitialSize()
+{
+	if ( m_InitialSizeInBytes == 0 ) return true;
+
+	// the stream doesn't expose its descriptor, but nothing has been written through it yet so a second one is safe
+	const int fileDescriptor = ( m_FileDescriptor >= 0 ) ? m_FileDescriptor : open( ("./" + m_FileName).c_str(), O_RDWR );
+	if ( fileDescriptor < 0 ) return false;
+
+	bool allocated = false;
+	if ( m_InitialAllocation == CPP_FILE_ALLOCATION::PREALLOCATE )
+	{
+		allocated = posix_fallocate( fileDescriptor, 0, static_cast<off_t>(m_InitialSizeInBytes) ) == 0;
+	}
+	else
+	{
+		allocated = ftruncate( fileDescriptor, static_cast<off_t>(m_InitialSizeInBytes) ) == 0;
+	}
+
+	if ( fileDescriptor != m_FileDescriptor ) close( fileDescriptor );
+
+	return allocated;
+}
+
+bool CPPFile::transferDirect (bool writing, uint8_t* data, uint64_t sizeInBytes, uint64_t offsetInBytes)
+{
+	if ( m_FileDescriptor < 0 || ! m_BounceBuffer ) return false;
+
+	while ( sizeInBytes > 0 )
+	{
+		const uint64_t blockOffset = offsetInBytes % DIRECT_ALIGNMENT;
+		const bool dataIsAligned = reinterpret_cast<uintptr_t>( data ) % DIRECT_ALIGNMENT == 0;
+
+		// the aligned core goes straight between the callers buffer and the file
+		if ( blockOffset == 0 && dataIsAligned && sizeInBytes >= DIRECT_ALIGNMENT )
+		{
+			const uint64_t numBytes = sizeInBytes - ( sizeInBytes % DIRECT_ALIGNMENT );
+			const bool transferred = ( writing ) ? writeAll( m_FileDescriptor, data, numBytes, offsetInBytes )
+								: readAll( m_FileDescriptor, data, numBytes, offsetInBytes );
+			if ( ! transferred ) return false;
+
+			data += numBytes;
+			sizeInBytes -= numBytes;
+			offsetInBytes += numBytes;
+
+			continue;
+		}
+
+		// the edges, or everything if the callers buffer is misaligned, go through the bounce buffer in whole blocks
+		const uint64_t numBytes = std::min( sizeInBytes, static_cast<uint64_t>(DIRECT_BOUNCE_SIZE) - blockOffset );
+		const uint64_t bounceOffset = offsetInBytes - blockOffset;
+		const uint64_t bounceSize = ( (blockOffset + numBytes + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT ) * DIRECT_ALIGNMENT;
+
+		if ( writing )
+		{
+			struct stat fileStat;
+			if ( fstat(m_FileDescriptor, &fileStat) != 0 ) return false;
+			const uint64_t fileSize = static_cast<uint64_t>( fileStat.st_size );
+
+			// partly covered blocks keep whatever else was in them, anything past the end of the file reads as zeros
+			if ( blockOffset != 0 || numBytes != bounceSize )
+			{
+				const uint64_t numRead = readUpTo( m_FileDescriptor, m_BounceBuffer, bounceSize, bounceOffset );
+				std::memset( m_BounceBuffer + numRead, 0, bounceSize - numRead );
+			}
+
+			std::memcpy( m_BounceBuffer + blockOffset, data, numBytes );
+			if ( ! writeAll(m_FileDescriptor, m_BounceBuffer, bounceSize, bounceOffset) ) return false;
+
+			// the whole last block was written, so the file may have grown past the end of the data
+			if ( bounceOffset + bounceSize > fileSize && offsetInBytes + numBytes < bounceOffset + bounceSize )
+			{
+				if ( ftruncate(m_FileDescriptor, static_cast<off_t>(std::max(fileSize, offsetInBytes + numBytes))) != 0 ) return false;
+			}
+		}
+		else
+		{
+			if ( readUpTo(m_FileDescriptor, m_BounceBuffer, bounceSize, bounceOffset) < blockOffset + numBytes ) return false;
+
+			std::memcpy( data, m_BounceBuffer + blockOffset, numBytes );
+		}
+
+		data += numBytes;
+		sizeInBytes -= numBytes;
+		offsetInBytes += numBytes;
+	}
+
+	return true;
 }
@@ -0,0 +1,133 @@
+#include "Checksum.hpp"
+
+struct Crc7Table
+{
+	uint8_t 	m_Table[256];
+};
+
+struct Crc16Table
+{
+	uint16_t 	m_Table[256];
+};
+
+struct Crc32Tables
+{
+	uint32_t 	m_Tables[8][256]; // m_Tables[n] gives the crc of a byte followed by n zero bytes
+};
+
+static constexpr Crc7Table makeCrc7Table()
+{
+	Crc7Table table{};
+
+	for ( unsigned int byte = 0; byte < 256; byte++ )
+	{
+		// kept shifted up by one bit, so the table can be indexed with the crc xored with the next byte
+		uint8_t crc = byte;
+		for ( unsigned int bit = 0; bit < 8; bit++ )
+		{
+			crc = ( crc & 0x80 ) ? static_cast<uint8_t>( (crc << 1) ^ (0x09 << 1) ) : static_cast<uint8_t>( crc << 1 );
+		}
+
+		table.m_Table[byte] = crc;
+	}
+
+	return table;
+}
+
+static constexpr Crc16Table makeCrc16Table()
+{
+	Crc16Table table{};
+
+	for ( unsigned int byte = 0; byte < 256; byte++ )
+	{
+		uint16_t crc = byte << 8;
+		for ( unsigned int bit = 0; bit < 8; bit++ )
+		{
+			crc = ( crc & 0x8000 ) ? static_cast<uint16_t>( (crc << 1) ^ 0x1021 ) : static_cast<uint16_t>( crc << 1 );
+		}
+
+		table.m_Table[byte] = crc;
+	}
+
+	return table;
+}
+
+static constexpr Crc32Tables makeCrc32Tables()
+{
+	Crc32Tables tables{};
+
+	for ( unsigned int byte = 0; byte < 256; byte++ )
+	{
+		uint32_t crc = byte;
+		for ( unsigned int bit = 0; bit < 8; bit++ )
+		{
+			crc = ( crc & 1 ) ? ( crc >> 1 ) ^ 0xEDB88320 : crc >> 1;
+		}
+
+		tables.m_Tables[0][byte] = crc;
+	}
+
+	for ( unsigned int slice = 1; slice < 8; slice++ )
+	{
+		for ( unsigned int byte = 0; byte < 256; byte++ )
+		{
+			const uint32_t previous = tables.m_Tables[slice - 1][byte];
+			tables.m_Tables[slice][byte] = ( previous >> 8 ) ^ tables.m_Tables[0][previous & 0xFF];
+		}
+	}
+
+	return tables;
+}
+
+static constexpr Crc7Table crc7Table = makeCrc7Table();
+static constexpr Crc16Table crc16Table = makeCrc16Table();
+static constexpr Crc32Tables crc32Tables = makeCrc32Tables();
+
+uint8_t Checksum::Crc7 (const uint8_t* data, unsigned int sizeInBytes)
+{
+	uint8_t crc = 0;
+
+	for ( unsigned int byte = 0; byte < sizeInBytes; byte++ )
+	{
+		crc = crc7Table.m_Table[crc ^ data[byte]];
+	}
+
+	return crc | 0x01;
+}
+
+uint16_t Checksum::Crc16 (const uint8_t* data, unsigned int sizeInBytes, uint16_t previousCrc)
+{
+	uint16_t crc = previousCrc;
+
+	for ( unsigned int byte = 0; byte < sizeInBytes; byte++ )
+	{
+		crc = ( crc << 8 ) ^ crc16Table.m_Table[( crc >> 8 ) ^ data[byte]];
+	}
+
+	return crc;
+}
+
+uint32_t Checksum::Crc32 (const uint8_t* data, unsigned int sizeInBytes, uint32_t previousCrc)
+{
+	const uint32_t (&tables)[8][256] = crc32Tables.m_Tables;
+	uint32_t crc = ~previousCrc;
+	unsigned int byte = 0;
+
+	// 8 bytes at a time, assembled byte by byte so alignment and endianness don't matter
+	for ( ; byte + 8 <= sizeInBytes; byte += 8 )
+	{
+		const uint8_t* bytes = data + byte;
+		const uint32_t low = crc ^ ( static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8)
+						| (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24) );
+
+		crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^ tables[5][(low >> 16) & 0xFF] ^ tables[4][low >> 24]
+			^ tables[3][bytes[4]] ^ tables[2][bytes[5]] ^ tables[1][bytes[6]] ^ tables[0][bytes[7]];
+	}
+
+	for ( ; byte < sizeInBytes; byte++ )
+	{
+		crc = ( crc >> 8 ) ^ tables[0][( crc ^ data[byte] ) & 0xFF];
+	}
+
+	return ~crc;
+}
@@ -0,0 +1,337 @@
+#include "CompressedStorageMedia.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#define BLOCK_MAP_MAGIC 0x4D425A4C // 'LZBM'
+#define BLOCK_MAP_HEADER_SIZE 16
+#define BLOCK_MAP_ENTRY_SIZE 4
+
+static uint32_t readUInt32 (const uint8_t* src)
+{
+	return static_cast<uint32_t>( src[0] ) | ( static_cast<uint32_t>(src[1]) << 8 )
+		| ( static_cast<uint32_t>(src[2]) << 16 ) | ( static_cast<uint32_t>(src[3]) << 24 );
+}
+
+static void writeUInt32 (uint8_t* dest, uint32_t value)
+{
+	dest[0] = ( value       ) & 0xFF;
+	dest[1] = ( value >> 8  ) & 0xFF;
+	dest[2] = ( value >> 16 ) & 0xFF;
+	dest[3] = ( value >> 24 ) & 0xFF;
+}
+
+static uint64_t getBlockMapSizeInBytes (uint64_t numBlocks, unsigned int blockSizeInBytes)
+{
+	const uint64_t mapSize = BLOCK_MAP_HEADER_SIZE + ( numBlocks * BLOCK_MAP_ENTRY_SIZE );
+
+	// keep the block slots aligned to the block size
+	return ( (mapSize + blockSizeInBytes - 1) / blockSizeInBytes ) * blockSizeInBytes;
+}
+
+CompressedStorageMedia::CompressedStorageMedia (IStorageMedia& child, uint64_t capacityInBytes, unsigned int blockSizeInBytes,
+							unsigned int mapWindowSizeInEntries) :
+	m_Child( child ),
+	m_CapacityInBytes( capacityInBytes ),
+	m_BlockSizeInBytes( std::min<unsigned int>(std::max<unsigned int>(blockSizeInBytes, 64), LZ_BLOCK_CODEC_MAX_BLOCK_SIZE) ),
+	m_NumBlocks( (capacityInBytes + m_BlockSizeInBytes - 1) / m_BlockSizeInBytes ),
+	m_BlockMapSizeInBytes( getBlockMapSizeInBytes(m_NumBlocks, m_BlockSizeInBytes) ),
+	m_MapWindowSizeInEntries( (mapWindowSizeInEntries > 0) ? mapWindowSizeInEntries : 1 ),
+	m_MapWindow( SharedData<uint8_t>::MakeSharedData(m_MapWindowSizeInEntries * BLOCK_MAP_ENTRY_SIZE) ),
+	m_MapWindowFirstBlockNum( 0 ),
+	m_MapWindowNumEntries( 0 ),
+	m_Codec(),
+	m_BlockBuffer( SharedData<uint8_t>::MakeSharedData(m_BlockSizeInBytes) ),
+	m_BlockBufferNum( 0 ),
+	m_BlockBufferValid( false ),
+	m_CompressedBuffer( SharedData<uint8_t>::MakeSharedData(m_BlockSizeInBytes) )
+{
+}
+
+CompressedStorageMedia::~CompressedStorageMedia()
+{
+}
+
+void CompressedStorageMedia::writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes)
+{
+	this->writeToMedia64( data, offsetInBytes );
+}
+
+SharedData<uint8_t> CompressedStorageMedia::readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes)
+{
+	return this->readFromMedia64( sizeInBytes, offsetInBytes );
+}
+
+void CompressedStorageMedia::readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data)
+{
+	this->readFromMedia64( static_cast<uint64_t>(offsetInBytes), data );
+}
+
+void CompressedStorageMedia::writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes)
+{
+	if ( offsetInBytes > m_CapacityInBytes || data.getSizeInBytes() > m_CapacityInBytes - offsetInBytes ) return;
+
+	unsigned int dataIndex = 0;
+
+	while ( dataIndex < data.getSizeInBytes() )
+	{
+		const uint64_t position = offsetInBytes + dataIndex;
+		const uint64_t blockNum = position / m_BlockSizeInBytes;
+		const unsigned int offsetInBlock = position % m_BlockSizeInBytes;
+		const unsigned int pieceSize = std::min( m_BlockSizeInBytes - offsetInBlock, data.getSizeInBytes() - dataIndex );
+
+		if ( pieceSize == m_BlockSizeInBytes )
+		{
+			// a whole block can be compressed straight from the callers buffer
+			if ( m_BlockBufferValid && m_BlockBufferNum == blockNum ) m_BlockBufferValid = false;
+
+			this->storeBlock( blockNum, data.getPtr(dataIndex) );
+		}
+		else
+		{
+			if ( ! m_BlockBufferValid || m_BlockBufferNum != blockNum )
+			{
+				this->loadBlock( blockNum, m_BlockBuffer.getPtr() );
+				m_BlockBufferNum = blockNum;
+				m_BlockBufferValid = true;
+			}
+
+			std::memcpy( m_BlockBuffer.getPtr(offsetInBlock), data.getPtr(dataIndex), pieceSize );
+			this->storeBlock( blockNum, m_BlockBuffer.getPtr() );
+		}
+
+		dataIndex += pieceSize;
+	}
+}
+
+SharedData<uint8_t> CompressedStorageMedia::readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes)
+{
+	if ( offsetInBytes > m_CapacityInBytes || sizeInBytes > m_CapacityInBytes - offsetInBytes ) return SharedData<uint8_t>::MakeSharedDataNull();
+
+	SharedData<uint8_t> data = SharedData<uint8_t>::MakeSharedData( sizeInBytes );
+
+	this->readFromMedia64( offsetInBytes, data );
+
+	return data;
+}
+
+void CompressedStorageMedia::readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data)
+{
+	if ( offsetInBytes > m_CapacityInBytes || data.getSizeInBytes() > m_CapacityInBytes - offsetInBytes ) return;
+
+	unsigned int dataIndex = 0;
+
+	while ( dataIndex < data.getSizeInBytes() )
+	{
+		const uint64_t position = offsetInBytes + dataIndex;
+		const uint64_t blockNum = position / m_BlockSizeInBytes;
+		const unsigned int offsetInBlock = position % m_BlockSizeInBytes;
+		const unsigned int pieceSize = std::min( m_BlockSizeInBytes - offsetInBlock, data.getSizeInBytes() - dataIndex );
+		const bool blockBuffered = m_BlockBufferValid && m_BlockBufferNum == blockNum;
+
+		if ( pieceSize == m_BlockSizeInBytes && ! blockBuffered )
+		{
+			// decompress whole blocks straight into the callers buffer
+			this->loadBlock( blockNum, data.getPtr(dataIndex) );
+		}
+		else
+		{
+			if ( ! blockBuffered )
+			{
+				this->loadBlock( blockNum, m_BlockBuffer.getPtr() );
+				m_BlockBufferNum = blockNum;
+				m_BlockBufferValid = true;
+			}
+
+			std::memcpy( data.getPtr(dataIndex), m_BlockBuffer.getPtr(offsetInBlock), pieceSize );
+		}
+
+		dataIndex += pieceSize;
+	}
+}
+
+void CompressedStorageMedia::discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes)
+{
+	this->discard64( static_cast<uint64_t>(offsetInBytes), static_cast<uint64_t>(sizeInBytes) );
+}
+
+void CompressedStorageMedia::discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes)
+{
+	if ( offsetInBytes >= m_CapacityInBytes ) return;
+
+	// only whole blocks can be dropped, they read back as zeros afterwards
+	const uint64_t endInBytes = offsetInBytes + std::min( sizeInBytes, m_CapacityInBytes - offsetInBytes );
+	const uint64_t firstBlockNum = ( offsetInBytes + m_BlockSizeInBytes - 1 ) / m_BlockSizeInBytes;
+	const uint64_t endBlockNum = ( endInBytes == m_CapacityInBytes ) ? m_NumBlocks : endInBytes / m_BlockSizeInBytes;
+	if ( firstBlockNum >= endBlockNum ) return;
+
+	// the map is updated first, so the slots are never referenced once the child has discarded them
+	for ( uint64_t blockNum = firstBlockNum; blockNum < endBlockNum; blockNum++ )
+	{
+		if ( this->getBlockMapEntry(blockNum) != 0 ) this->setBlockMapEntry( blockNum, 0 );
+	}
+
+	if ( m_BlockBufferValid && m_BlockBufferNum >= firstBlockNum && m_BlockBufferNum < endBlockNum ) m_BlockBufferValid = false;
+
+	m_Child.discard64( this->getSlotOffset(firstBlockNum), (endBlockNum - firstBlockNum) * m_BlockSizeInBytes );
+}
+
+void CompressedStorageMedia::afterInitialize()
+{
+	m_Child.afterInitialize();
+
+	this->mount();
+}
+
+IStorageMediaInfo CompressedStorageMedia::getMediaInfo()
+{
+	// anything smaller than a block costs a decompress and recompress to write
+	return IStorageMediaInfo( m_CapacityInBytes, m_BlockSizeInBytes, m_BlockSizeInBytes, m_BlockSizeInBytes, m_BlockSizeInBytes, false );
+}
+
+void CompressedStorageMedia::mount()
+{
+	m_BlockBufferValid = false;
+	m_MapWindowNumEntries = 0;
+
+	// only the header is checked, the map itself is paged in as blocks are touched
+	SharedData<uint8_t> header = m_Child.readFromMedia64( BLOCK_MAP_HEADER_SIZE, 0 );
+	if ( header.getSizeInBytes() != BLOCK_MAP_HEADER_SIZE )
+	{
+		this->format();
+		return;
+	}
+
+	const uint8_t* headerPtr = header.getPtr();
+	const uint64_t numBlocks = static_cast<uint64_t>( readUInt32(headerPtr + 8) ) | ( static_cast<uint64_t>(readUInt32(headerPtr + 12)) << 32 );
+	if ( readUInt32(headerPtr) != BLOCK_MAP_MAGIC || readUInt32(headerPtr + 4) != m_BlockSizeInBytes || numBlocks != m_NumBlocks )
+	{
+		this->format();
+	}
+}
+
+uint64_t CompressedStorageMedia::GetChildSizeInBytes (uint64_t capacityInBytes, unsigned int blockSizeInBytes)
+{
+	const uint64_t numBlocks = ( capacityInBytes + blockSizeInBytes - 1 ) / blockSizeInBytes;
+
+	return getBlockMapSizeInBytes( numBlocks, blockSizeInBytes ) + ( numBlocks * blockSizeInBytes );
+}
+
+uint64_t CompressedStorageMedia::getStoredBytes()
+{
+	uint64_t storedBytes = 0;
+	for ( uint64_t blockNum = 0; blockNum < m_NumBlocks; blockNum++ )
+	{
+		storedBytes += std::min( this->getBlockMapEntry(blockNum), m_BlockSizeInBytes );
+	}
+
+	return storedBytes;
+}
+
+bool CompressedStorageMedia::loadBlock (uint64_t blockNum, uint8_t* dest)
+{
+	const uint32_t compressedSize = this->getBlockMapEntry( blockNum );
+	const SharedData<uint8_t> destData = SharedData<uint8_t>::MakeSharedData( m_BlockSizeInBytes, dest );
+
+	if ( compressedSize == m_BlockSizeInBytes )
+	{
+		// stored uncompressed, so read it straight into place
+		m_Child.readFromMedia64( this->getSlotOffset(blockNum), destData );
+
+		return true;
+	}
+
+	if ( compressedSize > 0 && compressedSize < m_BlockSizeInBytes )
+	{
+		const SharedData<uint8_t> compressed = SharedData<uint8_t>::MakeSharedData( compressedSize, m_CompressedBuffer.getPtr() );
+		m_Child.readFromMedia64( this->getSlotOffset(blockNum), compressed );
+
+		if ( LzBlockCodec::decompress(compressed.getPtr(), compressedSize, dest, m_BlockSizeInBytes) ) return true;
+	}
+
+	// never written, or corrupt
+	std::fill( dest, dest + m_BlockSizeInBytes, 0 );
+
+	return compressedSize == 0;
+}
+
+void CompressedStorageMedia::storeBlock (uint64_t blockNum, const uint8_t* src)
+{
+	uint32_t compressedSize = 0;
+
+	// all zero blocks don't need to be stored at all
+	if ( ! std::all_of(src, src + m_BlockSizeInBytes, [](uint8_t byte) { return byte == 0; }) )
+	{
+		compressedSize = m_Codec.compress( src, m_BlockSizeInBytes, m_CompressedBuffer.getPtr(), m_BlockSizeInBytes - 1 );
+
+		if ( compressedSize == 0 )
+		{
+			compressedSize = m_BlockSizeInBytes;
+			m_Child.writeToMedia64( SharedData<uint8_t>::MakeSharedData(m_BlockSizeInBytes, const_cast<uint8_t*>(src)),
+						this->getSlotOffset(blockNum) );
+		}
+		else
+		{
+			m_Child.writeToMedia64( SharedData<uint8_t>::MakeSharedData(compressedSize, m_CompressedBuffer.getPtr()),
+						this->getSlotOffset(blockNum) );
+		}
+	}
+
+	if ( this->getBlockMapEntry(blockNum) != compressedSize ) this->setBlockMapEntry( blockNum, compressedSize );
+}
+
+uint32_t CompressedStorageMedia::getBlockMapEntry (uint64_t blockNum)
+{
+	if ( m_MapWindowNumEntries == 0 || blockNum < m_MapWindowFirstBlockNum || blockNum >= m_MapWindowFirstBlockNum + m_MapWindowNumEntries )
+	{
+		this->loadMapWindow( blockNum );
+	}
+
+	return readUInt32( m_MapWindow.getPtr((blockNum - m_MapWindowFirstBlockNum) * BLOCK_MAP_ENTRY_SIZE) );
+}
+
+void CompressedStorageMedia::setBlockMapEntry (uint64_t blockNum, uint32_t compressedSize)
+{
+	if ( m_MapWindowNumEntries == 0 || blockNum < m_MapWindowFirstBlockNum || blockNum >= m_MapWindowFirstBlockNum + m_MapWindowNumEntries )
+	{
+		this->loadMapWindow( blockNum );
+	}
+
+	uint8_t* entryPtr = m_MapWindow.getPtr( (blockNum - m_MapWindowFirstBlockNum) * BLOCK_MAP_ENTRY_SIZE );
+	writeUInt32( entryPtr, compressedSize );
+
+	// the window is written through, so it never needs writing back when it moves
+	m_Child.writeToMedia64( SharedData<uint8_t>::MakeSharedData(BLOCK_MAP_ENTRY_SIZE, entryPtr),
+				BLOCK_MAP_HEADER_SIZE + (blockNum * BLOCK_MAP_ENTRY_SIZE) );
+}
+
+void CompressedStorageMedia::loadMapWindow (uint64_t blockNum)
+{
+	m_MapWindowFirstBlockNum = blockNum - ( blockNum % m_MapWindowSizeInEntries );
+	m_MapWindowNumEntries = std::min<uint64_t>( m_MapWindowSizeInEntries, m_NumBlocks - m_MapWindowFirstBlockNum );
+
+	const SharedData<uint8_t> window = SharedData<uint8_t>::MakeSharedData( m_MapWindowNumEntries * BLOCK_MAP_ENTRY_SIZE, m_MapWindow.getPtr() );
+	m_Child.readFromMedia64( BLOCK_MAP_HEADER_SIZE + (m_MapWindowFirstBlockNum * BLOCK_MAP_ENTRY_SIZE), window );
+}
+
+void CompressedStorageMedia::format()
+{
+	m_BlockBufferValid = false;
+	m_MapWindowNumEntries = 0;
+
+	// clear the map in block sized pieces so formatting a big media doesn't need a big buffer
+	SharedData<uint8_t> mapPiece = SharedData<uint8_t>::MakeSharedData( m_BlockSizeInBytes, m_CompressedBuffer.getPtr() );
+	std::fill( mapPiece.getPtr(), mapPiece.getPtr() + m_BlockSizeInBytes, 0 );
+	for ( uint64_t mapOffset = 0; mapOffset < m_BlockMapSizeInBytes; mapOffset += m_BlockSizeInBytes )
+	{
+		m_Child.writeToMedia64( mapPiece, mapOffset );
+	}
+
+	// the header goes last, so an interrupted format is simply formatted again
+	SharedData<uint8_t> header = SharedData<uint8_t>::MakeSharedData( BLOCK_MAP_HEADER_SIZE );
+	writeUInt32( header.getPtr(0), BLOCK_MAP_MAGIC );
+	writeUInt32( header.getPtr(4), m_BlockSizeInBytes );
+	writeUInt32( header.getPtr(8), m_NumBlocks & 0xFFFFFFFF );
+	writeUInt32( header.getPtr(12), m_NumBlocks >> 32 );
+	m_Child.writeToMedia64( header, 0 );
+}
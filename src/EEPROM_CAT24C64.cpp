@@ -95,6 +95,12 @@ void Eeprom_CAT24C64::readFromMedia (const unsigned int address, const SharedDat
 	}
 }
 
+IStorageMediaInfo Eeprom_CAT24C64::getMediaInfo()
+{
+	// byte addressable and no erase required, but the write cycle is per page
+	return IStorageMediaInfo( EEPROM_SIZE, EEPROM_PAGE_SIZE, 1, EEPROM_PAGE_SIZE, 1, false );
+}
+
 Eeprom_CAT24C64_Manager::Eeprom_CAT24C64_Manager (const I2C_NUM& i2cNum, const std::vector<Eeprom_CAT24C64_AddressConfig>& addressConfigs) :
 	m_Eeproms()
 {
@@ -144,3 +150,20 @@ SharedData<uint8_t> Eeprom_CAT24C64_Manager::readFromMedia (const unsigned int s
 
 	return data;
 }
+
+void Eeprom_CAT24C64_Manager::readFromMedia (const unsigned int address, const SharedData<uint8_t>& data)
+{
+	uint8_t* dataPtr = data.getPtr();
+
+	for ( unsigned int byte = 0; byte < data.getSizeInBytes(); byte++ )
+	{
+		dataPtr[byte] = this->readByte( address + byte );
+	}
+}
+
+IStorageMediaInfo Eeprom_CAT24C64_Manager::getMediaInfo()
+{
+	const uint64_t capacity = static_cast<uint64_t>( Eeprom_CAT24C64::EEPROM_SIZE ) * m_Eeproms.size();
+
+	return IStorageMediaInfo( capacity, Eeprom_CAT24C64::EEPROM_PAGE_SIZE, 1, Eeprom_CAT24C64::EEPROM_PAGE_SIZE, 1, false );
+}
@@ -1,8 +1,71 @@
 #include "FakeStorageDevice.hpp"
 
-FakeStorageDevice::FakeStorageDevice (const unsigned int deviceSizeInBytes) :
+#include <algorithm>
+#include <cstring>
+
+FakeStorageTiming::FakeStorageTiming (const FAKE_STORAGE_TIMING& profile) :
+	m_ReadCommandTimeInNs( 0 ),
+	m_WriteCommandTimeInNs( 0 ),
+	m_ReadPageTimeInNs( 0 ),
+	m_WritePageTimeInNs( 0 ),
+	m_ByteTimeInNs( 0 ),
+	m_WriteBusyTimeInNs( 0 ),
+	m_WritePageBusyTimeInNs( 0 ),
+	m_ReadPageSizeInBytes( 0 ),
+	m_WritePageSizeInBytes( 0 ),
+	m_MultiPageCommands( false ),
+	m_BlockSizeInBytes( 1 )
+{
+	switch ( profile )
+	{
+		case FAKE_STORAGE_TIMING::SRAM_23K256:
+			// 8 bits at 20MHz per byte, the instruction and 16 bit address are 3 bytes plus chip select setup
+			m_ByteTimeInNs = 400;
+			m_ReadCommandTimeInNs = 1300;
+			m_WriteCommandTimeInNs = 1300;
+
+			break;
+		case FAKE_STORAGE_TIMING::EEPROM_CAT24C64:
+			// 9 bits at 400kHz per byte, writes send the device address and 2 address bytes, reads then restart with the device address
+			m_ByteTimeInNs = 22500;
+			m_WriteCommandTimeInNs = 70000;
+			m_ReadCommandTimeInNs = 92500;
+			m_WriteBusyTimeInNs = 5000000;
+			m_WritePageSizeInBytes = 32;
+
+			break;
+		case FAKE_STORAGE_TIMING::SD_CARD_SPI:
+			// 8 bits at 25MHz per byte, a read command waits on the card's access latency, then each block on its data token
+			// and crc. Each written block sends a token and crc and waits for the data response, the card buffers the blocks
+			// of a multi block write so only the last one waits out the full programming time
+			m_ByteTimeInNs = 320;
+			m_ReadCommandTimeInNs = 100000;
+			m_ReadPageTimeInNs = 2000;
+			m_WriteCommandTimeInNs = 5000;
+			m_WritePageTimeInNs = 1600;
+			m_WriteBusyTimeInNs = 250000;
+			m_WritePageBusyTimeInNs = 25000;
+			m_ReadPageSizeInBytes = 512;
+			m_WritePageSizeInBytes = 512;
+			m_MultiPageCommands = true;
+			m_BlockSizeInBytes = 512;
+
+			break;
+		default:
+			break;
+	}
+}
+
+FakeStorageDevice::FakeStorageDevice (const unsigned int deviceSizeInBytes, const unsigned int snapshotPageSizeInBytes) :
 	m_SizeInBytes( deviceSizeInBytes ),
-	m_DataArray( new uint8_t[deviceSizeInBytes] )
+	m_DataArray( new uint8_t[deviceSizeInBytes] ),
+	m_SnapshotPageSizeInBytes( std::max<unsigned int>(snapshotPageSizeInBytes, 1) ),
+	m_NumSnapshotPages( (deviceSizeInBytes + m_SnapshotPageSizeInBytes - 1) / m_SnapshotPageSizeInBytes ),
+	m_NextSnapshotHandle( 0 ),
+	m_Snapshots(),
+	m_Timing(),
+	m_VirtualTimeInNs( 0 ),
+	m_BusyUntilInNs( 0 )
 {
 }
 
@@ -13,11 +76,15 @@ FakeStorageDevice::~FakeStorageDevice()
 
 void FakeStorageDevice::writeByte (uint16_t address, uint8_t data)
 {
+	this->saveSnapshotPages( address, 1 );
+	this->addTransferTime( true, address, 1 );
 	m_DataArray[address] = data;
 }
 
 uint8_t FakeStorageDevice::readByte (uint16_t address)
 {
+	this->addTransferTime( false, address, 1 );
+
 	return m_DataArray[address];
 }
 
@@ -25,6 +92,9 @@ void FakeStorageDevice::writeToMedia (const SharedData<uint8_t>& data, const uns
 {
 	if ( data.getSizeInBytes() + offsetInBytes <= m_SizeInBytes ) // if the data fits in this media
 	{
+		this->saveSnapshotPages( offsetInBytes, data.getSizeInBytes() );
+		this->addTransferTime( true, offsetInBytes, data.getSizeInBytes() );
+
 		for ( unsigned int byte = 0; byte < data.getSizeInBytes(); byte ++ )
 		{
 			m_DataArray[offsetInBytes + byte] = data[byte];
@@ -35,6 +105,7 @@ void FakeStorageDevice::writeToMedia (const SharedData<uint8_t>& data, const uns
 SharedData<uint8_t> FakeStorageDevice::readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes)
 {
 	SharedData<uint8_t> data = SharedData<uint8_t>::MakeSharedData( sizeInBytes );
+	this->addTransferTime( false, offsetInBytes, sizeInBytes );
 
 	for ( unsigned int byte = 0; byte < sizeInBytes; byte++ )
 	{
@@ -46,8 +117,183 @@ SharedData<uint8_t> FakeStorageDevice::readFromMedia (const unsigned int sizeInB
 
 void FakeStorageDevice::readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data)
 {
+	this->addTransferTime( false, offsetInBytes, data.getSizeInBytes() );
+
 	for ( unsigned int byte = 0; byte < data.getSizeInBytes(); byte++ )
 	{
 		data[byte] = m_DataArray[offsetInBytes + byte];
 	}
 }
+
+IStorageMediaInfo FakeStorageDevice::getMediaInfo()
+{
+	// with a timing set, callers see the same page and block sizes the real device would report
+	const unsigned int blockSize = std::max<unsigned int>( m_Timing.m_BlockSizeInBytes, 1 );
+	const unsigned int pageSize = std::max( m_Timing.m_WritePageSizeInBytes, blockSize );
+
+	return IStorageMediaInfo( m_SizeInBytes, pageSize, blockSize, pageSize, 1, false );
+}
+
+unsigned int FakeStorageDevice::snapshot()
+{
+	Snapshot snapshot;
+	snapshot.m_Handle = m_NextSnapshotHandle++;
+	snapshot.m_PageIsSaved.assign( m_NumSnapshotPages, false );
+	m_Snapshots.push_back( std::move(snapshot) );
+
+	return m_Snapshots.back().m_Handle;
+}
+
+bool FakeStorageDevice::restore (unsigned int snapshotHandle)
+{
+	const int snapshotNum = this->findSnapshot( snapshotHandle );
+	if ( snapshotNum < 0 ) return false;
+
+	// newest first, so each page ends up as the oldest saved copy
+	for ( int snapshotToUndo = static_cast<int>(m_Snapshots.size()) - 1; snapshotToUndo >= snapshotNum; snapshotToUndo-- )
+	{
+		const Snapshot& snapshot = m_Snapshots[snapshotToUndo];
+		for ( unsigned int savedNum = 0; savedNum < snapshot.m_SavedPages.size(); savedNum++ )
+		{
+			const unsigned int pageOffset = snapshot.m_SavedPages[savedNum] * m_SnapshotPageSizeInBytes;
+			std::memcpy( m_DataArray + pageOffset, snapshot.m_SavedData.data() + savedNum * m_SnapshotPageSizeInBytes,
+					std::min(m_SnapshotPageSizeInBytes, m_SizeInBytes - pageOffset) );
+		}
+	}
+
+	m_Snapshots.erase( m_Snapshots.begin() + snapshotNum + 1, m_Snapshots.end() );
+
+	// the device matches the snapshot again, so it starts over with nothing saved
+	Snapshot& snapshot = m_Snapshots[snapshotNum];
+	for ( const unsigned int page : snapshot.m_SavedPages )
+	{
+		snapshot.m_PageIsSaved[page] = false;
+	}
+	snapshot.m_SavedPages.clear();
+	snapshot.m_SavedData.clear();
+
+	return true;
+}
+
+bool FakeStorageDevice::releaseSnapshot (unsigned int snapshotHandle)
+{
+	const int snapshotNum = this->findSnapshot( snapshotHandle );
+	if ( snapshotNum < 0 ) return false;
+
+	// pages the previous snapshot hasn't saved were unchanged up to this one, so this one's copies belong to it now
+	if ( snapshotNum > 0 )
+	{
+		const Snapshot& released = m_Snapshots[snapshotNum];
+		Snapshot& previous = m_Snapshots[snapshotNum - 1];
+
+		for ( unsigned int savedNum = 0; savedNum < released.m_SavedPages.size(); savedNum++ )
+		{
+			const unsigned int page = released.m_SavedPages[savedNum];
+			if ( previous.m_PageIsSaved[page] ) continue;
+
+			previous.m_PageIsSaved[page] = true;
+			previous.m_SavedPages.push_back( page );
+			previous.m_SavedData.insert( previous.m_SavedData.end(), released.m_SavedData.begin() + savedNum * m_SnapshotPageSizeInBytes,
+							released.m_SavedData.begin() + (savedNum + 1) * m_SnapshotPageSizeInBytes );
+		}
+	}
+
+	m_Snapshots.erase( m_Snapshots.begin() + snapshotNum );
+
+	return true;
+}
+
+void FakeStorageDevice::saveSnapshotPages (unsigned int offsetInBytes, unsigned int sizeInBytes)
+{
+	// only the newest snapshot saves pages, the older ones already match what it saves
+	if ( m_Snapshots.empty() || sizeInBytes == 0 ) return;
+
+	Snapshot& snapshot = m_Snapshots.back();
+	const unsigned int lastPage = ( offsetInBytes + sizeInBytes - 1 ) / m_SnapshotPageSizeInBytes;
+
+	for ( unsigned int page = offsetInBytes / m_SnapshotPageSizeInBytes; page <= lastPage; page++ )
+	{
+		if ( snapshot.m_PageIsSaved[page] ) continue;
+
+		// a short last page is padded so every saved page is the same size
+		const unsigned int pageOffset = page * m_SnapshotPageSizeInBytes;
+		const unsigned int pageSize = std::min( m_SnapshotPageSizeInBytes, m_SizeInBytes - pageOffset );
+		snapshot.m_SavedData.insert( snapshot.m_SavedData.end(), m_DataArray + pageOffset, m_DataArray + pageOffset + pageSize );
+		snapshot.m_SavedData.resize( snapshot.m_SavedData.size() + m_SnapshotPageSizeInBytes - pageSize, 0 );
+
+		snapshot.m_PageIsSaved[page] = true;
+		snapshot.m_SavedPages.push_back( page );
+	}
+}
+
+int FakeStorageDevice::findSnapshot (unsigned int snapshotHandle)
+{
+	for ( unsigned int snapshotNum = 0; snapshotNum < m_Snapshots.size(); snapshotNum++ )
+	{
+		if ( m_Snapshots[snapshotNum].m_Handle == snapshotHandle ) return static_cast<int>( snapshotNum );
+	}
+
+	return -1;
+}
+
+void FakeStorageDevice::resetVirtualTime()
+{
+	m_VirtualTimeInNs = 0;
+	m_BusyUntilInNs = 0;
+}
+
+void FakeStorageDevice::addTransferTime (bool writing, unsigned int offsetInBytes, unsigned int sizeInBytes)
+{
+	if ( sizeInBytes == 0 ) return;
+
+	const uint64_t blockSize = std::max<unsigned int>( m_Timing.m_BlockSizeInBytes, 1 );
+	const uint64_t startOffset = ( offsetInBytes / blockSize ) * blockSize;
+	const uint64_t endOffset = ( (static_cast<uint64_t>(offsetInBytes) + sizeInBytes + blockSize - 1) / blockSize ) * blockSize;
+
+	// a partly written block has to be read first so the rest of it survives
+	if ( writing && blockSize > 1 )
+	{
+		const bool headIsPartial = ( offsetInBytes != startOffset );
+		const bool tailIsPartial = ( offsetInBytes + sizeInBytes != endOffset );
+
+		if ( headIsPartial ) this->addCommandTime( false, startOffset, blockSize );
+		if ( tailIsPartial && (! headIsPartial || endOffset - startOffset > blockSize) )
+		{
+			this->addCommandTime( false, endOffset - blockSize, blockSize );
+		}
+	}
+
+	this->addCommandTime( writing, startOffset, endOffset - startOffset );
+}
+
+void FakeStorageDevice::addCommandTime (bool writing, uint64_t offsetInBytes, uint64_t sizeInBytes)
+{
+	const uint64_t pageSize = ( writing ) ? m_Timing.m_WritePageSizeInBytes : m_Timing.m_ReadPageSizeInBytes;
+	const uint64_t commandTime = ( writing ) ? m_Timing.m_WriteCommandTimeInNs : m_Timing.m_ReadCommandTimeInNs;
+	const uint64_t pageTime = ( writing ) ? m_Timing.m_WritePageTimeInNs : m_Timing.m_ReadPageTimeInNs;
+	const uint64_t endOffset = offsetInBytes + sizeInBytes;
+	bool inCommand = false;
+
+	while ( offsetInBytes < endOffset )
+	{
+		const uint64_t pageEnd = ( pageSize > 0 ) ? std::min( endOffset, (offsetInBytes / pageSize + 1) * pageSize ) : endOffset;
+
+		if ( ! inCommand )
+		{
+			// a device that's still programming doesn't accept the next command until it's done
+			m_VirtualTimeInNs = std::max( m_VirtualTimeInNs, m_BusyUntilInNs );
+			m_VirtualTimeInNs += commandTime;
+			inCommand = m_Timing.m_MultiPageCommands;
+		}
+		else if ( writing )
+		{
+			m_VirtualTimeInNs += m_Timing.m_WritePageBusyTimeInNs;
+		}
+
+		m_VirtualTimeInNs += pageTime + ( pageEnd - offsetInBytes ) * m_Timing.m_ByteTimeInNs;
+
+		if ( writing ) m_BusyUntilInNs = m_VirtualTimeInNs + m_Timing.m_WriteBusyTimeInNs;
+
+		offsetInBytes = pageEnd;
+	}
+}
@@ -0,0 +1,822 @@
+#include "Fat32FileSystem.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+#define DIR_ENTRY_SIZE 32
+#define DIR_ENTRY_FREE 0xE5
+#define DIR_ENTRY_END 0x00
+#define LONG_NAME_LAST_ENTRY 0x40
+#define LONG_NAME_CHARS_PER_ENTRY 13
+#define FAT_ENTRY_MASK 0x0FFFFFFF
+#define FAT_END_OF_CHAIN 0x0FFFFFFF
+#define FSINFO_LEAD_SIGNATURE 0x41615252
+#define FSINFO_FREE_COUNT_OFFSET 488
+#define FSINFO_NEXT_FREE_OFFSET 492
+#define FAT_DATE_1980_01_01 0x0021
+
+// the lookup cache is simply cleared once it reaches this many entries
+#define DIRECTORY_CACHE_MAX_ENTRIES 64
+
+static uint16_t readUInt16 (const uint8_t* src)
+{
+	return static_cast<uint16_t>( src[0] | (src[1] << 8) );
+}
+
+static uint32_t readUInt32 (const uint8_t* src)
+{
+	return static_cast<uint32_t>( src[0] ) | ( static_cast<uint32_t>(src[1]) << 8 )
+		| ( static_cast<uint32_t>(src[2]) << 16 ) | ( static_cast<uint32_t>(src[3]) << 24 );
+}
+
+static void writeUInt16 (uint8_t* dest, uint16_t value)
+{
+	dest[0] = value & 0xFF;
+	dest[1] = value >> 8;
+}
+
+static void writeUInt32 (uint8_t* dest, uint32_t value)
+{
+	dest[0] = ( value       ) & 0xFF;
+	dest[1] = ( value >> 8  ) & 0xFF;
+	dest[2] = ( value >> 16 ) & 0xFF;
+	dest[3] = ( value >> 24 ) & 0xFF;
+}
+
+static uint8_t shortNameChecksum (const uint8_t* shortName)
+{
+	uint8_t sum = 0;
+	for ( unsigned int character = 0; character < 11; character++ )
+	{
+		sum = ( (sum & 1) << 7 ) + ( sum >> 1 ) + shortName[character];
+	}
+
+	return sum;
+}
+
+Fat32FileSystem::Fat32FileSystem (IStorageMedia& media, uint64_t volumeOffsetInBytes, unsigned int fatWindowSizeInSectors) :
+	m_Media( media ),
+	m_VolumeOffset( volumeOffsetInBytes ),
+	m_IsMounted( false ),
+	m_BytesPerSector( 512 ),
+	m_SectorsPerCluster( 1 ),
+	m_FatStartSector( 0 ),
+	m_SectorsPerFat( 0 ),
+	m_NumFats( 0 ),
+	m_DataStartSector( 0 ),
+	m_NumClusters( 0 ),
+	m_RootCluster( 0 ),
+	m_FsInfoSector( 0 ),
+	m_FatWindowSizeInSectors( (fatWindowSizeInSectors > 0) ? fatWindowSizeInSectors : 1 ),
+	m_FatWindow( SharedData<uint8_t>::MakeSharedDataNull() ),
+	m_FatWindowStartSector( 0 ),
+	m_FatWindowNumSectors( 0 ),
+	m_FatWindowDirty( false ),
+	m_NextFreeClusterHint( 2 ),
+	m_FsInfoInvalidated( false ),
+	m_DirectoryCache()
+{
+}
+
+Fat32FileSystem::~Fat32FileSystem()
+{
+	this->flush();
+}
+
+bool Fat32FileSystem::mount()
+{
+	m_IsMounted = false;
+	m_DirectoryCache.clear();
+
+	SharedData<uint8_t> bootSector = m_Media.readFromMedia64( 512, m_VolumeOffset );
+	if ( bootSector.getSizeInBytes() != 512 ) return false;
+	const uint8_t* bootPtr = bootSector.getPtr();
+
+	if ( bootPtr[510] != 0x55 || bootPtr[511] != 0xAA ) return false;
+
+	const unsigned int bytesPerSector = readUInt16( bootPtr + 11 );
+	const unsigned int sectorsPerCluster = bootPtr[13];
+	const unsigned int reservedSectors = readUInt16( bootPtr + 14 );
+	const unsigned int numFats = bootPtr[16];
+	const unsigned int rootEntryCount = readUInt16( bootPtr + 17 );
+	const unsigned int fatSize16 = readUInt16( bootPtr + 22 );
+	const uint32_t totalSectors = ( readUInt16(bootPtr + 19) != 0 ) ? readUInt16( bootPtr + 19 ) : readUInt32( bootPtr + 32 );
+	const uint32_t sectorsPerFat = readUInt32( bootPtr + 36 );
+
+	// fat32 volumes have no fixed root directory and no 16-bit fat size
+	const bool validBytesPerSector = bytesPerSector == 512 || bytesPerSector == 1024 || bytesPerSector == 2048 || bytesPerSector == 4096;
+	const bool validSectorsPerCluster = sectorsPerCluster != 0 && ( sectorsPerCluster & (sectorsPerCluster - 1) ) == 0;
+	if ( ! validBytesPerSector || ! validSectorsPerCluster || numFats == 0 || rootEntryCount != 0 || fatSize16 != 0 || sectorsPerFat == 0 )
+	{
+		return false;
+	}
+
+	m_BytesPerSector = bytesPerSector;
+	m_SectorsPerCluster = sectorsPerCluster;
+	m_FatStartSector = reservedSectors;
+	m_SectorsPerFat = sectorsPerFat;
+	m_NumFats = numFats;
+	m_DataStartSector = reservedSectors + ( numFats * sectorsPerFat );
+	if ( m_DataStartSector >= totalSectors ) return false;
+	m_NumClusters = ( totalSectors - m_DataStartSector ) / sectorsPerCluster;
+	m_RootCluster = readUInt32( bootPtr + 44 );
+	m_FsInfoSector = readUInt16( bootPtr + 48 );
+
+	// never let a corrupt boot sector make us address clusters past the end of the fat
+	m_NumClusters = std::min<uint32_t>( m_NumClusters, (static_cast<uint64_t>(sectorsPerFat) * bytesPerSector / 4) - 2 );
+
+	m_FatWindow = SharedData<uint8_t>::MakeSharedData( m_FatWindowSizeInSectors * m_BytesPerSector );
+	m_FatWindowNumSectors = 0;
+	m_FatWindowDirty = false;
+	m_FsInfoInvalidated = false;
+	m_NextFreeClusterHint = 2;
+
+	// the fsinfo sector holds a hint of where to start looking for free clusters
+	if ( m_FsInfoSector != 0 && m_FsInfoSector != 0xFFFF )
+	{
+		SharedData<uint8_t> fsInfo = m_Media.readFromMedia64( 512, this->getSectorOffset(m_FsInfoSector) );
+		if ( fsInfo.getSizeInBytes() == 512 && readUInt32(fsInfo.getPtr()) == FSINFO_LEAD_SIGNATURE )
+		{
+			const uint32_t nextFree = readUInt32( fsInfo.getPtr(FSINFO_NEXT_FREE_OFFSET) );
+			if ( this->isValidCluster(nextFree) ) m_NextFreeClusterHint = nextFree;
+		}
+		else
+		{
+			m_FsInfoSector = 0;
+		}
+	}
+
+	m_IsMounted = this->isValidCluster( m_RootCluster );
+
+	return m_IsMounted;
+}
+
+bool Fat32FileSystem::openFile (const std::string& path, Fat32File& file)
+{
+	Fat32DirEntry entry;
+	if ( ! m_IsMounted || ! this->lookup(path, entry) || entry.isDirectory() ) return false;
+
+	file.m_IsOpen = true;
+	file.m_Path = Fat32FileSystem::normalizePath( path );
+	file.m_Entry = entry;
+	file.m_Position = 0;
+	file.m_EntryChanged = false;
+	this->buildExtents( file );
+
+	return true;
+}
+
+bool Fat32FileSystem::createFile (const std::string& path, Fat32File& file)
+{
+	std::string parentPath;
+	std::string name;
+	uint8_t shortName[11];
+	if ( ! m_IsMounted || ! Fat32FileSystem::splitPath(path, parentPath, name) || ! Fat32FileSystem::toShortName(name, shortName) )
+	{
+		return false;
+	}
+
+	Fat32DirEntry parentEntry;
+	Fat32DirEntry existingEntry;
+	if ( ! this->lookup(parentPath, parentEntry) || ! parentEntry.isDirectory()
+			|| this->findInDirectory(parentEntry.m_FirstCluster, name, existingEntry) )
+	{
+		return false;
+	}
+
+	const uint64_t entryOffset = this->findFreeDirEntry( parentEntry.m_FirstCluster );
+	if ( entryOffset == 0 ) return false;
+
+	SharedData<uint8_t> entryData = SharedData<uint8_t>::MakeSharedData( DIR_ENTRY_SIZE );
+	uint8_t* entryPtr = entryData.getPtr();
+	std::fill( entryPtr, entryPtr + DIR_ENTRY_SIZE, 0 );
+	std::copy( shortName, shortName + 11, entryPtr );
+	entryPtr[11] = FAT32_ATTR_ARCHIVE;
+	writeUInt16( entryPtr + 16, FAT_DATE_1980_01_01 ); // creation date
+	writeUInt16( entryPtr + 18, FAT_DATE_1980_01_01 ); // last access date
+	writeUInt16( entryPtr + 24, FAT_DATE_1980_01_01 ); // last write date
+	m_Media.writeToMedia64( entryData, entryOffset );
+
+	Fat32DirEntry entry;
+	entry.m_Attributes = FAT32_ATTR_ARCHIVE;
+	entry.m_EntryOffset = entryOffset;
+
+	file.m_IsOpen = true;
+	file.m_Path = Fat32FileSystem::normalizePath( path );
+	file.m_Entry = entry;
+	file.m_Position = 0;
+	file.m_Extents.clear();
+	file.m_NumClusters = 0;
+	file.m_EntryChanged = false;
+
+	if ( m_DirectoryCache.size() >= DIRECTORY_CACHE_MAX_ENTRIES ) m_DirectoryCache.clear();
+	m_DirectoryCache[file.m_Path] = entry;
+
+	return true;
+}
+
+bool Fat32FileSystem::removeFile (const std::string& path)
+{
+	Fat32DirEntry entry;
+	if ( ! m_IsMounted || ! this->lookup(path, entry) || entry.isDirectory() ) return false;
+
+	std::vector<Fat32Extent> freedExtents;
+	if ( this->isValidCluster(entry.m_FirstCluster) ) this->freeClusterChain( entry.m_FirstCluster, freedExtents );
+
+	// mark the 8.3 entry and its long name entries as free
+	SharedData<uint8_t> freeMarker = SharedData<uint8_t>::MakeSharedData( 1 );
+	freeMarker[0] = DIR_ENTRY_FREE;
+	m_Media.writeToMedia64( freeMarker, entry.m_EntryOffset );
+	for ( const uint64_t longNameEntryOffset : entry.m_LongNameEntryOffsets )
+	{
+		m_Media.writeToMedia64( freeMarker, longNameEntryOffset );
+	}
+
+	m_DirectoryCache.erase( Fat32FileSystem::normalizePath(path) );
+	this->flush();
+
+	// only once nothing on the media points at the clusters any more, a power loss before here leaves them intact
+	this->discardExtents( freedExtents );
+
+	return true;
+}
+
+bool Fat32FileSystem::getEntry (const std::string& path, Fat32DirEntry& entry)
+{
+	return m_IsMounted && this->lookup( path, entry );
+}
+
+unsigned int Fat32FileSystem::read (Fat32File& file, const SharedData<uint8_t>& data)
+{
+	if ( ! file.m_IsOpen || file.m_Position >= file.m_Entry.m_SizeInBytes ) return 0;
+
+	const unsigned int bytesToRead = std::min<uint32_t>( data.getSizeInBytes(), file.m_Entry.m_SizeInBytes - file.m_Position );
+	unsigned int bytesRead = 0;
+
+	while ( bytesRead < bytesToRead )
+	{
+		uint64_t mediaOffset = 0;
+		uint32_t contiguousBytes = 0;
+		if ( ! this->locate(file, file.m_Position, mediaOffset, contiguousBytes) ) break;
+
+		// read as much of the extent as we can in one go, straight into the callers buffer
+		const unsigned int chunkSize = std::min<uint32_t>( contiguousBytes, bytesToRead - bytesRead );
+		const SharedData<uint8_t> chunk = SharedData<uint8_t>::MakeSharedData( chunkSize, data.getPtr(bytesRead) );
+		m_Media.readFromMedia64( mediaOffset, chunk );
+
+		bytesRead += chunkSize;
+		file.m_Position += chunkSize;
+	}
+
+	return bytesRead;
+}
+
+unsigned int Fat32FileSystem::write (Fat32File& file, const SharedData<uint8_t>& data)
+{
+	if ( ! file.m_IsOpen ) return 0;
+
+	// fat32 files are limited to 4GB - 1
+	const uint64_t requestedEnd = static_cast<uint64_t>( file.m_Position ) + data.getSizeInBytes();
+	const uint32_t end = static_cast<uint32_t>( std::min<uint64_t>(requestedEnd, 0xFFFFFFFF) );
+
+	// if the volume fills up, write as much as fits in the clusters we did get
+	this->extendFile( file, end );
+	const uint64_t allocatedBytes = static_cast<uint64_t>( file.m_NumClusters ) * this->getClusterSizeInBytes();
+	const unsigned int bytesToWrite = std::min<uint64_t>( end, allocatedBytes ) - std::min<uint64_t>( file.m_Position, allocatedBytes );
+
+	unsigned int bytesWritten = 0;
+	while ( bytesWritten < bytesToWrite )
+	{
+		uint64_t mediaOffset = 0;
+		uint32_t contiguousBytes = 0;
+		if ( ! this->locate(file, file.m_Position, mediaOffset, contiguousBytes) ) break;
+
+		const unsigned int chunkSize = std::min<uint32_t>( contiguousBytes, bytesToWrite - bytesWritten );
+		const SharedData<uint8_t> chunk = SharedData<uint8_t>::MakeSharedData( chunkSize, data.getPtr(bytesWritten) );
+		m_Media.writeToMedia64( chunk, mediaOffset );
+
+		bytesWritten += chunkSize;
+		file.m_Position += chunkSize;
+	}
+
+	if ( file.m_Position > file.m_Entry.m_SizeInBytes )
+	{
+		file.m_Entry.m_SizeInBytes = file.m_Position;
+		file.m_EntryChanged = true;
+	}
+
+	return bytesWritten;
+}
+
+void Fat32FileSystem::close (Fat32File& file)
+{
+	if ( ! file.m_IsOpen ) return;
+
+	if ( file.m_EntryChanged )
+	{
+		this->writeDirEntry( file.m_Entry );
+
+		auto cacheIt = m_DirectoryCache.find( file.m_Path );
+		if ( cacheIt != m_DirectoryCache.end() ) cacheIt->second = file.m_Entry;
+
+		this->flush();
+	}
+
+	file.m_IsOpen = false;
+	file.m_Extents.clear();
+}
+
+void Fat32FileSystem::flush()
+{
+	if ( ! m_FatWindowDirty ) return;
+
+	// keep every copy of the fat in sync
+	const SharedData<uint8_t> window = SharedData<uint8_t>::MakeSharedData( m_FatWindowNumSectors * m_BytesPerSector, m_FatWindow.getPtr() );
+	for ( unsigned int fatNum = 0; fatNum < m_NumFats; fatNum++ )
+	{
+		const uint32_t sector = m_FatStartSector + ( fatNum * m_SectorsPerFat ) + m_FatWindowStartSector;
+		m_Media.writeToMedia64( window, this->getSectorOffset(sector) );
+	}
+
+	m_FatWindowDirty = false;
+}
+
+uint64_t Fat32FileSystem::getClusterOffset (uint32_t clusterNum)
+{
+	const uint64_t sector = m_DataStartSector + static_cast<uint64_t>( clusterNum - 2 ) * m_SectorsPerCluster;
+
+	return m_VolumeOffset + sector * m_BytesPerSector;
+}
+
+uint32_t Fat32FileSystem::getFatEntry (uint32_t clusterNum)
+{
+	const uint64_t byteInFat = static_cast<uint64_t>( clusterNum ) * 4;
+	const uint32_t fatSector = byteInFat / m_BytesPerSector;
+
+	if ( m_FatWindowNumSectors == 0 || fatSector < m_FatWindowStartSector || fatSector >= m_FatWindowStartSector + m_FatWindowNumSectors )
+	{
+		this->loadFatWindow( fatSector );
+	}
+
+	const unsigned int byteInWindow = ( (fatSector - m_FatWindowStartSector) * m_BytesPerSector ) + ( byteInFat % m_BytesPerSector );
+
+	return readUInt32( m_FatWindow.getPtr(byteInWindow) ) & FAT_ENTRY_MASK;
+}
+
+void Fat32FileSystem::setFatEntry (uint32_t clusterNum, uint32_t value)
+{
+	const uint64_t byteInFat = static_cast<uint64_t>( clusterNum ) * 4;
+	const uint32_t fatSector = byteInFat / m_BytesPerSector;
+
+	if ( m_FatWindowNumSectors == 0 || fatSector < m_FatWindowStartSector || fatSector >= m_FatWindowStartSector + m_FatWindowNumSectors )
+	{
+		this->loadFatWindow( fatSector );
+	}
+
+	const unsigned int byteInWindow = ( (fatSector - m_FatWindowStartSector) * m_BytesPerSector ) + ( byteInFat % m_BytesPerSector );
+	uint8_t* entryPtr = m_FatWindow.getPtr( byteInWindow );
+
+	// the top 4 bits are reserved and must be preserved
+	const uint32_t reservedBits = readUInt32( entryPtr ) & ~FAT_ENTRY_MASK;
+	writeUInt32( entryPtr, reservedBits | (value & FAT_ENTRY_MASK) );
+
+	m_FatWindowDirty = true;
+}
+
+void Fat32FileSystem::loadFatWindow (uint32_t fatSector)
+{
+	this->flush();
+
+	m_FatWindowStartSector = fatSector;
+	m_FatWindowNumSectors = std::min<uint32_t>( m_FatWindowSizeInSectors, m_SectorsPerFat - fatSector );
+
+	const SharedData<uint8_t> window = SharedData<uint8_t>::MakeSharedData( m_FatWindowNumSectors * m_BytesPerSector, m_FatWindow.getPtr() );
+	m_Media.readFromMedia64( this->getSectorOffset(m_FatStartSector + fatSector), window );
+}
+
+uint32_t Fat32FileSystem::allocateCluster (uint32_t previousClusterNum)
+{
+	// search from the hint to the end, then wrap around to the start
+	for ( uint32_t clusterIndex = 0; clusterIndex < m_NumClusters; clusterIndex++ )
+	{
+		const uint32_t clusterNum = 2 + ( (m_NextFreeClusterHint - 2 + clusterIndex) % m_NumClusters );
+
+		if ( this->getFatEntry(clusterNum) == 0 )
+		{
+			this->setFatEntry( clusterNum, FAT_END_OF_CHAIN );
+			if ( this->isValidCluster(previousClusterNum) ) this->setFatEntry( previousClusterNum, clusterNum );
+
+			m_NextFreeClusterHint = ( this->isValidCluster(clusterNum + 1) ) ? clusterNum + 1 : 2;
+			this->invalidateFsInfo();
+
+			return clusterNum;
+		}
+	}
+
+	return 0;
+}
+
+void Fat32FileSystem::freeClusterChain (uint32_t firstClusterNum, std::vector<Fat32Extent>& freedExtents)
+{
+	uint32_t clusterNum = firstClusterNum;
+	uint32_t clustersLeft = m_NumClusters; // guards against a corrupt chain with a loop
+
+	// freed clusters are collected a run of adjacent clusters at a time
+	Fat32Extent run = { clusterNum, 0 };
+
+	while ( this->isValidCluster(clusterNum) && clustersLeft > 0 )
+	{
+		const uint32_t nextClusterNum = this->getFatEntry( clusterNum );
+		this->setFatEntry( clusterNum, 0 );
+
+		run.m_NumClusters++;
+		if ( nextClusterNum != clusterNum + 1 )
+		{
+			freedExtents.push_back( run );
+			run = { nextClusterNum, 0 };
+		}
+
+		clusterNum = nextClusterNum;
+		clustersLeft--;
+	}
+
+	if ( run.m_NumClusters > 0 ) freedExtents.push_back( run );
+
+	this->invalidateFsInfo();
+}
+
+void Fat32FileSystem::discardExtents (const std::vector<Fat32Extent>& extents)
+{
+	for ( const Fat32Extent& extent : extents )
+	{
+		m_Media.discard64( this->getClusterOffset(extent.m_FirstCluster), static_cast<uint64_t>(extent.m_NumClusters) * this->getClusterSizeInBytes() );
+	}
+}
+
+void Fat32FileSystem::invalidateFsInfo()
+{
+	if ( m_FsInfoInvalidated || m_FsInfoSector == 0 ) return;
+
+	// we don't keep track of the free cluster count, so mark it as unknown and let the host recompute it
+	SharedData<uint8_t> freeCount = SharedData<uint8_t>::MakeSharedData( 4 );
+	writeUInt32( freeCount.getPtr(), 0xFFFFFFFF );
+	m_Media.writeToMedia64( freeCount, this->getSectorOffset(m_FsInfoSector) + FSINFO_FREE_COUNT_OFFSET );
+
+	m_FsInfoInvalidated = true;
+}
+
+void Fat32FileSystem::buildExtents (Fat32File& file)
+{
+	file.m_Extents.clear();
+	file.m_NumClusters = 0;
+
+	uint32_t clusterNum = file.m_Entry.m_FirstCluster;
+	while ( this->isValidCluster(clusterNum) && file.m_NumClusters < m_NumClusters )
+	{
+		if ( ! file.m_Extents.empty() && file.m_Extents.back().m_FirstCluster + file.m_Extents.back().m_NumClusters == clusterNum )
+		{
+			file.m_Extents.back().m_NumClusters++;
+		}
+		else
+		{
+			file.m_Extents.push_back( Fat32Extent{clusterNum, 1} );
+		}
+
+		file.m_NumClusters++;
+		clusterNum = this->getFatEntry( clusterNum );
+	}
+}
+
+bool Fat32FileSystem::extendFile (Fat32File& file, uint32_t sizeInBytes)
+{
+	const uint32_t clusterSize = this->getClusterSizeInBytes();
+	const uint32_t clustersNeeded = ( static_cast<uint64_t>(sizeInBytes) + clusterSize - 1 ) / clusterSize;
+
+	while ( file.m_NumClusters < clustersNeeded )
+	{
+		uint32_t lastClusterNum = 0;
+		if ( ! file.m_Extents.empty() )
+		{
+			lastClusterNum = file.m_Extents.back().m_FirstCluster + file.m_Extents.back().m_NumClusters - 1;
+		}
+
+		const uint32_t clusterNum = this->allocateCluster( lastClusterNum );
+		if ( clusterNum == 0 ) return false;
+
+		if ( file.m_Extents.empty() )
+		{
+			file.m_Entry.m_FirstCluster = clusterNum;
+			file.m_EntryChanged = true;
+		}
+
+		if ( ! file.m_Extents.empty() && lastClusterNum + 1 == clusterNum )
+		{
+			file.m_Extents.back().m_NumClusters++;
+		}
+		else
+		{
+			file.m_Extents.push_back( Fat32Extent{clusterNum, 1} );
+		}
+
+		file.m_NumClusters++;
+	}
+
+	return true;
+}
+
+bool Fat32FileSystem::locate (const Fat32File& file, uint32_t position, uint64_t& mediaOffset, uint32_t& contiguousBytes)
+{
+	const uint64_t clusterSize = this->getClusterSizeInBytes();
+	uint64_t extentStart = 0;
+
+	for ( const Fat32Extent& extent : file.m_Extents )
+	{
+		const uint64_t extentSize = extent.m_NumClusters * clusterSize;
+
+		if ( position < extentStart + extentSize )
+		{
+			const uint64_t offsetInExtent = position - extentStart;
+
+			mediaOffset = this->getClusterOffset( extent.m_FirstCluster ) + offsetInExtent;
+			contiguousBytes = std::min<uint64_t>( extentSize - offsetInExtent, 0xFFFFFFFF );
+
+			return true;
+		}
+
+		extentStart += extentSize;
+	}
+
+	return false;
+}
+
+bool Fat32FileSystem::lookup (const std::string& path, Fat32DirEntry& entry)
+{
+	const std::string normalizedPath = Fat32FileSystem::normalizePath( path );
+
+	auto cacheIt = m_DirectoryCache.find( normalizedPath );
+	if ( cacheIt != m_DirectoryCache.end() )
+	{
+		entry = cacheIt->second;
+
+		return true;
+	}
+
+	// start at the root directory and walk down one path component at a time
+	Fat32DirEntry currentEntry;
+	currentEntry.m_FirstCluster = m_RootCluster;
+	currentEntry.m_Attributes = FAT32_ATTR_DIRECTORY;
+
+	std::string currentPath;
+	size_t componentStart = 1;
+	while ( componentStart < normalizedPath.size() )
+	{
+		size_t componentEnd = normalizedPath.find( '/', componentStart );
+		if ( componentEnd == std::string::npos ) componentEnd = normalizedPath.size();
+
+		const std::string component = normalizedPath.substr( componentStart, componentEnd - componentStart );
+		currentPath += "/" + component;
+
+		auto componentIt = m_DirectoryCache.find( currentPath );
+		if ( componentIt != m_DirectoryCache.end() )
+		{
+			currentEntry = componentIt->second;
+		}
+		else
+		{
+			Fat32DirEntry nextEntry;
+			if ( ! currentEntry.isDirectory() || ! this->findInDirectory(currentEntry.m_FirstCluster, component, nextEntry) ) return false;
+
+			// a directory entry with cluster 0 refers to the root directory (..)
+			if ( nextEntry.isDirectory() && nextEntry.m_FirstCluster == 0 ) nextEntry.m_FirstCluster = m_RootCluster;
+
+			if ( m_DirectoryCache.size() >= DIRECTORY_CACHE_MAX_ENTRIES ) m_DirectoryCache.clear();
+			m_DirectoryCache[currentPath] = nextEntry;
+			currentEntry = nextEntry;
+		}
+
+		componentStart = componentEnd + 1;
+	}
+
+	entry = currentEntry;
+
+	return true;
+}
+
+bool Fat32FileSystem::findInDirectory (uint32_t dirCluster, const std::string& name, Fat32DirEntry& entry)
+{
+	const std::string upperName = Fat32FileSystem::normalizePath( name ).substr( 1 );
+	const uint32_t clusterSize = this->getClusterSizeInBytes();
+
+	std::vector<uint16_t> longName;
+	std::vector<uint64_t> longNameEntryOffsets;
+	uint8_t longNameChecksum = 0;
+
+	uint32_t clusterNum = dirCluster;
+	uint32_t clustersLeft = m_NumClusters;
+	while ( this->isValidCluster(clusterNum) && clustersLeft > 0 )
+	{
+		const uint64_t clusterOffset = this->getClusterOffset( clusterNum );
+		SharedData<uint8_t> cluster = m_Media.readFromMedia64( clusterSize, clusterOffset );
+		if ( cluster.getSizeInBytes() != clusterSize ) return false;
+
+		for ( uint32_t entryOffset = 0; entryOffset < clusterSize; entryOffset += DIR_ENTRY_SIZE )
+		{
+			const uint8_t* entryPtr = cluster.getPtr( entryOffset );
+			const uint8_t attributes = entryPtr[11];
+
+			if ( entryPtr[0] == DIR_ENTRY_END ) return false;
+
+			if ( entryPtr[0] == DIR_ENTRY_FREE )
+			{
+				longName.clear();
+				longNameEntryOffsets.clear();
+			}
+			else if ( (attributes & FAT32_ATTR_LONG_NAME) == FAT32_ATTR_LONG_NAME )
+			{
+				// long name entries are stored last part first, each holding 13 ucs-2 characters
+				const unsigned int order = entryPtr[0] & 0x1F;
+				if ( entryPtr[0] & LONG_NAME_LAST_ENTRY )
+				{
+					longName.assign( order * LONG_NAME_CHARS_PER_ENTRY, 0 );
+					longNameEntryOffsets.clear();
+					longNameChecksum = entryPtr[13];
+				}
+
+				if ( order == 0 || order * LONG_NAME_CHARS_PER_ENTRY > longName.size() ) continue;
+
+				static const unsigned int charOffsets[LONG_NAME_CHARS_PER_ENTRY] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+				for ( unsigned int character = 0; character < LONG_NAME_CHARS_PER_ENTRY; character++ )
+				{
+					longName[(order - 1) * LONG_NAME_CHARS_PER_ENTRY + character] = readUInt16( entryPtr + charOffsets[character] );
+				}
+
+				longNameEntryOffsets.push_back( clusterOffset + entryOffset );
+			}
+			else if ( attributes & FAT32_ATTR_VOLUME_ID )
+			{
+				longName.clear();
+				longNameEntryOffsets.clear();
+			}
+			else
+			{
+				bool matches = Fat32FileSystem::fromShortName( entryPtr ) == upperName;
+
+				// only trust the long name if it belongs to this entry
+				if ( ! matches && ! longName.empty() && longNameChecksum == shortNameChecksum(entryPtr) )
+				{
+					std::string longNameStr;
+					for ( const uint16_t character : longName )
+					{
+						if ( character == 0x0000 || character == 0xFFFF ) break;
+						longNameStr += ( character < 0x80 ) ? static_cast<char>( std::toupper(character) ) : '?';
+					}
+
+					matches = longNameStr == upperName;
+				}
+
+				if ( matches )
+				{
+					entry.m_FirstCluster = ( static_cast<uint32_t>(readUInt16(entryPtr + 20)) << 16 ) | readUInt16( entryPtr + 26 );
+					entry.m_SizeInBytes = readUInt32( entryPtr + 28 );
+					entry.m_Attributes = attributes;
+					entry.m_EntryOffset = clusterOffset + entryOffset;
+					entry.m_LongNameEntryOffsets = ( longNameChecksum == shortNameChecksum(entryPtr) ) ? longNameEntryOffsets
+																: std::vector<uint64_t>();
+
+					return true;
+				}
+
+				longName.clear();
+				longNameEntryOffsets.clear();
+			}
+		}
+
+		clusterNum = this->getFatEntry( clusterNum );
+		clustersLeft--;
+	}
+
+	return false;
+}
+
+uint64_t Fat32FileSystem::findFreeDirEntry (uint32_t dirCluster)
+{
+	const uint32_t clusterSize = this->getClusterSizeInBytes();
+
+	uint32_t clusterNum = dirCluster;
+	uint32_t lastClusterNum = 0;
+	uint32_t clustersLeft = m_NumClusters;
+	while ( this->isValidCluster(clusterNum) && clustersLeft > 0 )
+	{
+		const uint64_t clusterOffset = this->getClusterOffset( clusterNum );
+		SharedData<uint8_t> cluster = m_Media.readFromMedia64( clusterSize, clusterOffset );
+		if ( cluster.getSizeInBytes() != clusterSize ) return 0;
+
+		for ( uint32_t entryOffset = 0; entryOffset < clusterSize; entryOffset += DIR_ENTRY_SIZE )
+		{
+			if ( cluster[entryOffset] == DIR_ENTRY_END || cluster[entryOffset] == DIR_ENTRY_FREE ) return clusterOffset + entryOffset;
+		}
+
+		lastClusterNum = clusterNum;
+		clusterNum = this->getFatEntry( clusterNum );
+		clustersLeft--;
+	}
+
+	// the directory is full, so give it another (zeroed) cluster
+	const uint32_t newClusterNum = this->allocateCluster( lastClusterNum );
+	if ( newClusterNum == 0 ) return 0;
+
+	SharedData<uint8_t> emptyCluster = SharedData<uint8_t>::MakeSharedData( clusterSize );
+	std::fill( emptyCluster.getPtr(), emptyCluster.getPtr() + clusterSize, 0 );
+	m_Media.writeToMedia64( emptyCluster, this->getClusterOffset(newClusterNum) );
+	this->flush();
+
+	return this->getClusterOffset( newClusterNum );
+}
+
+void Fat32FileSystem::writeDirEntry (const Fat32DirEntry& entry)
+{
+	if ( entry.m_EntryOffset == 0 ) return;
+
+	SharedData<uint8_t> entryData = m_Media.readFromMedia64( DIR_ENTRY_SIZE, entry.m_EntryOffset );
+	if ( entryData.getSizeInBytes() != DIR_ENTRY_SIZE ) return;
+
+	uint8_t* entryPtr = entryData.getPtr();
+	writeUInt16( entryPtr + 20, entry.m_FirstCluster >> 16 );
+	writeUInt16( entryPtr + 26, entry.m_FirstCluster & 0xFFFF );
+	writeUInt32( entryPtr + 28, entry.m_SizeInBytes );
+
+	m_Media.writeToMedia64( entryData, entry.m_EntryOffset );
+}
+
+std::string Fat32FileSystem::normalizePath (const std::string& path)
+{
+	std::string normalizedPath = "/";
+
+	for ( const char character : path )
+	{
+		// collapse repeated separators
+		if ( character == '/' && normalizedPath.back() == '/' ) continue;
+
+		normalizedPath += static_cast<char>( std::toupper(static_cast<unsigned char>(character)) );
+	}
+
+	if ( normalizedPath.size() > 1 && normalizedPath.back() == '/' ) normalizedPath.pop_back();
+
+	return normalizedPath;
+}
+
+bool Fat32FileSystem::splitPath (const std::string& path, std::string& parentPath, std::string& name)
+{
+	const std::string normalizedPath = Fat32FileSystem::normalizePath( path );
+	const size_t separator = normalizedPath.find_last_of( '/' );
+
+	parentPath = ( separator == 0 ) ? "/" : normalizedPath.substr( 0, separator );
+	name = normalizedPath.substr( separator + 1 );
+
+	return ! name.empty();
+}
+
+bool Fat32FileSystem::toShortName (const std::string& name, uint8_t shortName[11])
+{
+	const size_t dot = name.find_last_of( '.' );
+	const std::string base = ( dot == std::string::npos ) ? name : name.substr( 0, dot );
+	const std::string extension = ( dot == std::string::npos ) ? "" : name.substr( dot + 1 );
+
+	if ( base.empty() || base.size() > 8 || extension.size() > 3 ) return false;
+
+	static const std::string validSymbols = "$%'-_@~`!(){}^#&";
+	std::fill( shortName, shortName + 11, ' ' );
+
+	for ( size_t character = 0; character < base.size() + extension.size(); character++ )
+	{
+		const char nameChar = ( character < base.size() ) ? base[character] : extension[character - base.size()];
+		const unsigned char upperChar = std::toupper( static_cast<unsigned char>(nameChar) );
+
+		if ( ! std::isalnum(upperChar) && validSymbols.find(upperChar) == std::string::npos ) return false;
+
+		if ( character < base.size() )
+		{
+			shortName[character] = upperChar;
+		}
+		else
+		{
+			shortName[8 + character - base.size()] = upperChar;
+		}
+	}
+
+	return true;
+}
+
+std::string Fat32FileSystem::fromShortName (const uint8_t* shortName)
+{
+	std::string base( reinterpret_cast<const char*>(shortName), 8 );
+	std::string extension( reinterpret_cast<const char*>(shortName + 8), 3 );
+
+	base.erase( base.find_last_not_of(' ') + 1 );
+	extension.erase( extension.find_last_not_of(' ') + 1 );
+
+	// 0x05 stands in for a leading 0xE5, which would otherwise mark the entry as free
+	if ( ! base.empty() && base[0] == 0x05 ) base[0] = static_cast<char>( 0xE5 );
+
+	return ( extension.empty() ) ? base : base + "." + extension;
+}
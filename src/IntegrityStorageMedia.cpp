@@ -0,0 +1,297 @@
+#include "IntegrityStorageMedia.hpp"
+
+#include "Checksum.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#define CHECKSUM_TABLE_MAGIC 0x42435243 // 'CRCB'
+#define CHECKSUM_TABLE_HEADER_SIZE 16
+#define CHECKSUM_SIZE 4
+// a stored crc of 0 means the block has never been written through this media
+#define CHECKSUM_UNWRITTEN 0
+
+static uint32_t readUInt32 (const uint8_t* src)
+{
+	return static_cast<uint32_t>( src[0] ) | ( static_cast<uint32_t>(src[1]) << 8 )
+		| ( static_cast<uint32_t>(src[2]) << 16 ) | ( static_cast<uint32_t>(src[3]) << 24 );
+}
+
+static void writeUInt32 (uint8_t* dest, uint32_t value)
+{
+	dest[0] = ( value       ) & 0xFF;
+	dest[1] = ( value >> 8  ) & 0xFF;
+	dest[2] = ( value >> 16 ) & 0xFF;
+	dest[3] = ( value >> 24 ) & 0xFF;
+}
+
+static uint64_t getTableSizeInBytes (uint64_t numBlocks, unsigned int blockSizeInBytes)
+{
+	const uint64_t tableSize = CHECKSUM_TABLE_HEADER_SIZE + ( numBlocks * CHECKSUM_SIZE );
+
+	// keep the data blocks aligned to the block size
+	return ( (tableSize + blockSizeInBytes - 1) / blockSizeInBytes ) * blockSizeInBytes;
+}
+
+IntegrityStorageMedia::IntegrityStorageMedia (IStorageMedia& child, uint64_t capacityInBytes, unsigned int blockSizeInBytes) :
+	m_Child( child ),
+	m_CapacityInBytes( capacityInBytes ),
+	m_BlockSizeInBytes( std::max<unsigned int>(blockSizeInBytes, CHECKSUM_TABLE_HEADER_SIZE) ),
+	m_NumBlocks( (capacityInBytes + m_BlockSizeInBytes - 1) / m_BlockSizeInBytes ),
+	m_TableSizeInBytes( getTableSizeInBytes(m_NumBlocks, m_BlockSizeInBytes) ),
+	m_BlockBuffer( SharedData<uint8_t>::MakeSharedData(m_BlockSizeInBytes) ),
+	m_ErrorCallback( nullptr ),
+	m_NumChecksumErrors( 0 )
+{
+}
+
+IntegrityStorageMedia::~IntegrityStorageMedia()
+{
+}
+
+void IntegrityStorageMedia::writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes)
+{
+	this->writeToMedia64( data, offsetInBytes );
+}
+
+SharedData<uint8_t> IntegrityStorageMedia::readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes)
+{
+	return this->readFromMedia64( sizeInBytes, offsetInBytes );
+}
+
+void IntegrityStorageMedia::readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data)
+{
+	this->readFromMedia64( static_cast<uint64_t>(offsetInBytes), data );
+}
+
+void IntegrityStorageMedia::writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes)
+{
+	const unsigned int sizeInBytes = data.getSizeInBytes();
+	if ( sizeInBytes == 0 || ! this->isInRange(offsetInBytes, sizeInBytes) ) return;
+
+	const uint64_t firstBlockNum = offsetInBytes / m_BlockSizeInBytes;
+	const uint64_t lastBlockNum = ( offsetInBytes + sizeInBytes - 1 ) / m_BlockSizeInBytes;
+	const unsigned int numBlocks = lastBlockNum - firstBlockNum + 1;
+
+	// the old crcs are only needed to check the partial blocks we merge into
+	const bool partialFirst = offsetInBytes % m_BlockSizeInBytes != 0 || sizeInBytes < m_BlockSizeInBytes;
+	const bool partialLast = ( offsetInBytes + sizeInBytes ) % m_BlockSizeInBytes != 0;
+	SharedData<uint8_t> checksums = ( partialFirst || partialLast ) ? this->readChecksums( firstBlockNum, numBlocks )
+									: SharedData<uint8_t>::MakeSharedData( numBlocks * CHECKSUM_SIZE );
+	if ( checksums.getSizeInBytes() != numBlocks * CHECKSUM_SIZE ) return;
+
+	unsigned int dataIndex = 0;
+	uint64_t blockNum = firstBlockNum;
+
+	while ( dataIndex < sizeInBytes )
+	{
+		const unsigned int offsetInBlock = ( offsetInBytes + dataIndex ) % m_BlockSizeInBytes;
+		const unsigned int checksumIndex = ( blockNum - firstBlockNum ) * CHECKSUM_SIZE;
+
+		if ( offsetInBlock != 0 || sizeInBytes - dataIndex < m_BlockSizeInBytes )
+		{
+			// partial block, so merge it with what's already there
+			const unsigned int pieceSize = std::min( m_BlockSizeInBytes - offsetInBlock, sizeInBytes - dataIndex );
+
+			m_Child.readFromMedia64( this->getBlockOffset(blockNum), m_BlockBuffer );
+			this->checkBlock( blockNum, m_BlockBuffer.getPtr(), checksums, checksumIndex );
+
+			std::memcpy( m_BlockBuffer.getPtr(offsetInBlock), data.getPtr(dataIndex), pieceSize );
+			writeUInt32( checksums.getPtr(checksumIndex), Checksum::Crc32(m_BlockBuffer.getPtr(), m_BlockSizeInBytes) );
+			m_Child.writeToMedia64( m_BlockBuffer, this->getBlockOffset(blockNum) );
+
+			dataIndex += pieceSize;
+			blockNum++;
+		}
+		else
+		{
+			// write the run of whole blocks straight from the callers buffer
+			const unsigned int numWholeBlocks = ( sizeInBytes - dataIndex ) / m_BlockSizeInBytes;
+			const unsigned int runSize = numWholeBlocks * m_BlockSizeInBytes;
+
+			for ( unsigned int block = 0; block < numWholeBlocks; block++ )
+			{
+				const uint32_t crc = Checksum::Crc32( data.getPtr(dataIndex + block * m_BlockSizeInBytes), m_BlockSizeInBytes );
+				writeUInt32( checksums.getPtr(checksumIndex + block * CHECKSUM_SIZE), crc );
+			}
+
+			m_Child.writeToMedia64( SharedData<uint8_t>::MakeSharedData(runSize, data.getPtr(dataIndex)), this->getBlockOffset(blockNum) );
+
+			dataIndex += runSize;
+			blockNum += numWholeBlocks;
+		}
+	}
+
+	// the crcs go after the data, so an interrupted write shows up as a failed check rather than stale data passing one
+	m_Child.writeToMedia64( checksums, CHECKSUM_TABLE_HEADER_SIZE + (firstBlockNum * CHECKSUM_SIZE) );
+}
+
+SharedData<uint8_t> IntegrityStorageMedia::readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes)
+{
+	if ( ! this->isInRange(offsetInBytes, sizeInBytes) ) return SharedData<uint8_t>::MakeSharedDataNull();
+
+	SharedData<uint8_t> data = SharedData<uint8_t>::MakeSharedData( sizeInBytes );
+
+	this->readFromMedia64( offsetInBytes, data );
+
+	return data;
+}
+
+void IntegrityStorageMedia::readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data)
+{
+	const unsigned int sizeInBytes = data.getSizeInBytes();
+	if ( sizeInBytes == 0 || ! this->isInRange(offsetInBytes, sizeInBytes) ) return;
+
+	const uint64_t firstBlockNum = offsetInBytes / m_BlockSizeInBytes;
+	const uint64_t lastBlockNum = ( offsetInBytes + sizeInBytes - 1 ) / m_BlockSizeInBytes;
+
+	SharedData<uint8_t> checksums = this->readChecksums( firstBlockNum, lastBlockNum - firstBlockNum + 1 );
+	if ( checksums.getSizeInBytes() == 0 ) return;
+
+	unsigned int dataIndex = 0;
+	uint64_t blockNum = firstBlockNum;
+
+	while ( dataIndex < sizeInBytes )
+	{
+		const unsigned int offsetInBlock = ( offsetInBytes + dataIndex ) % m_BlockSizeInBytes;
+		const unsigned int checksumIndex = ( blockNum - firstBlockNum ) * CHECKSUM_SIZE;
+
+		if ( offsetInBlock != 0 || sizeInBytes - dataIndex < m_BlockSizeInBytes )
+		{
+			// a partial block has to be read whole to be checked
+			const unsigned int pieceSize = std::min( m_BlockSizeInBytes - offsetInBlock, sizeInBytes - dataIndex );
+
+			m_Child.readFromMedia64( this->getBlockOffset(blockNum), m_BlockBuffer );
+			this->checkBlock( blockNum, m_BlockBuffer.getPtr(), checksums, checksumIndex );
+			std::memcpy( data.getPtr(dataIndex), m_BlockBuffer.getPtr(offsetInBlock), pieceSize );
+
+			dataIndex += pieceSize;
+			blockNum++;
+		}
+		else
+		{
+			// read the run of whole blocks straight into the callers buffer and check them in place
+			const unsigned int numWholeBlocks = ( sizeInBytes - dataIndex ) / m_BlockSizeInBytes;
+			const unsigned int runSize = numWholeBlocks * m_BlockSizeInBytes;
+
+			m_Child.readFromMedia64( this->getBlockOffset(blockNum), SharedData<uint8_t>::MakeSharedData(runSize, data.getPtr(dataIndex)) );
+
+			for ( unsigned int block = 0; block < numWholeBlocks; block++ )
+			{
+				this->checkBlock( blockNum + block, data.getPtr(dataIndex + block * m_BlockSizeInBytes), checksums,
+							checksumIndex + block * CHECKSUM_SIZE );
+			}
+
+			dataIndex += runSize;
+			blockNum += numWholeBlocks;
+		}
+	}
+}
+
+void IntegrityStorageMedia::discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes)
+{
+	this->discard64( static_cast<uint64_t>(offsetInBytes), static_cast<uint64_t>(sizeInBytes) );
+}
+
+void IntegrityStorageMedia::discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes)
+{
+	if ( offsetInBytes >= m_CapacityInBytes ) return;
+
+	// a partial block still needs its crc, so only whole blocks are discarded
+	const uint64_t endInBytes = offsetInBytes + std::min( sizeInBytes, m_CapacityInBytes - offsetInBytes );
+	const uint64_t firstBlockNum = ( offsetInBytes + m_BlockSizeInBytes - 1 ) / m_BlockSizeInBytes;
+	const uint64_t endBlockNum = ( endInBytes == m_CapacityInBytes ) ? m_NumBlocks : endInBytes / m_BlockSizeInBytes;
+	if ( firstBlockNum >= endBlockNum ) return;
+
+	// the crcs are marked unwritten first, so whatever the child reads back afterwards isn't reported as an error
+	std::fill( m_BlockBuffer.getPtr(), m_BlockBuffer.getPtr() + m_BlockSizeInBytes, CHECKSUM_UNWRITTEN );
+	const uint64_t checksumsPerPiece = m_BlockSizeInBytes / CHECKSUM_SIZE;
+
+	for ( uint64_t blockNum = firstBlockNum; blockNum < endBlockNum; blockNum += checksumsPerPiece )
+	{
+		const unsigned int numChecksums = std::min( checksumsPerPiece, endBlockNum - blockNum );
+
+		m_Child.writeToMedia64( SharedData<uint8_t>::MakeSharedData(numChecksums * CHECKSUM_SIZE, m_BlockBuffer.getPtr()),
+					CHECKSUM_TABLE_HEADER_SIZE + (blockNum * CHECKSUM_SIZE) );
+	}
+
+	m_Child.discard64( this->getBlockOffset(firstBlockNum), (endBlockNum - firstBlockNum) * m_BlockSizeInBytes );
+}
+
+void IntegrityStorageMedia::afterInitialize()
+{
+	m_Child.afterInitialize();
+
+	this->mount();
+}
+
+IStorageMediaInfo IntegrityStorageMedia::getMediaInfo()
+{
+	IStorageMediaInfo info = m_Child.getMediaInfo();
+	info.m_CapacityInBytes = m_CapacityInBytes;
+
+	// anything smaller than a block has to be read back to recalculate its crc
+	info.m_OptimalIOSizeInBytes = std::max( info.m_OptimalIOSizeInBytes, m_BlockSizeInBytes );
+	info.m_AlignmentInBytes = std::max( info.m_AlignmentInBytes, m_BlockSizeInBytes );
+	info.m_PageSizeInBytes = std::max( info.m_PageSizeInBytes, m_BlockSizeInBytes );
+
+	return info;
+}
+
+void IntegrityStorageMedia::mount()
+{
+	SharedData<uint8_t> header = m_Child.readFromMedia64( CHECKSUM_TABLE_HEADER_SIZE, 0 );
+	if ( header.getSizeInBytes() != CHECKSUM_TABLE_HEADER_SIZE )
+	{
+		this->format();
+		return;
+	}
+
+	const uint8_t* headerPtr = header.getPtr();
+	const uint64_t numBlocks = static_cast<uint64_t>( readUInt32(headerPtr + 8) ) | ( static_cast<uint64_t>(readUInt32(headerPtr + 12)) << 32 );
+	if ( readUInt32(headerPtr) != CHECKSUM_TABLE_MAGIC || readUInt32(headerPtr + 4) != m_BlockSizeInBytes || numBlocks != m_NumBlocks )
+	{
+		this->format();
+	}
+}
+
+uint64_t IntegrityStorageMedia::GetChildSizeInBytes (uint64_t capacityInBytes, unsigned int blockSizeInBytes)
+{
+	const uint64_t numBlocks = ( capacityInBytes + blockSizeInBytes - 1 ) / blockSizeInBytes;
+
+	return getTableSizeInBytes( numBlocks, blockSizeInBytes ) + ( numBlocks * blockSizeInBytes );
+}
+
+SharedData<uint8_t> IntegrityStorageMedia::readChecksums (uint64_t firstBlockNum, unsigned int numBlocks)
+{
+	return m_Child.readFromMedia64( numBlocks * CHECKSUM_SIZE, CHECKSUM_TABLE_HEADER_SIZE + (firstBlockNum * CHECKSUM_SIZE) );
+}
+
+void IntegrityStorageMedia::checkBlock (uint64_t blockNum, const uint8_t* blockData, const SharedData<uint8_t>& checksums,
+						unsigned int checksumIndex)
+{
+	const uint32_t storedCrc = readUInt32( checksums.getPtr(checksumIndex) );
+	if ( storedCrc == CHECKSUM_UNWRITTEN || storedCrc == Checksum::Crc32(blockData, m_BlockSizeInBytes) ) return;
+
+	m_NumChecksumErrors++;
+
+	if ( m_ErrorCallback ) m_ErrorCallback( blockNum );
+}
+
+void IntegrityStorageMedia::format()
+{
+	// clear the table a block at a time so formatting a big media doesn't need a big buffer
+	std::fill( m_BlockBuffer.getPtr(), m_BlockBuffer.getPtr() + m_BlockSizeInBytes, 0 );
+	for ( uint64_t tableOffset = 0; tableOffset < m_TableSizeInBytes; tableOffset += m_BlockSizeInBytes )
+	{
+		m_Child.writeToMedia64( m_BlockBuffer, tableOffset );
+	}
+
+	// the header goes last, so an interrupted format is simply formatted again
+	SharedData<uint8_t> header = SharedData<uint8_t>::MakeSharedData( CHECKSUM_TABLE_HEADER_SIZE );
+	writeUInt32( header.getPtr(0), CHECKSUM_TABLE_MAGIC );
+	writeUInt32( header.getPtr(4), m_BlockSizeInBytes );
+	writeUInt32( header.getPtr(8), m_NumBlocks & 0xFFFFFFFF );
+	writeUInt32( header.getPtr(12), m_NumBlocks >> 32 );
+	m_Child.writeToMedia64( header, 0 );
+}
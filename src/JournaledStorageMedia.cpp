@@ -0,0 +1,338 @@
+#include "JournaledStorageMedia.hpp"
+
+#include "Checksum.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#define JOURNAL_MAGIC 0x4C4E524A // 'JRNL'
+#define JOURNAL_HEADER_SIZE 24
+#define JOURNAL_RECORD_HEADER_SIZE 12
+
+static uint32_t readUInt32 (const uint8_t* src)
+{
+	return static_cast<uint32_t>( src[0] ) | ( static_cast<uint32_t>(src[1]) << 8 )
+		| ( static_cast<uint32_t>(src[2]) << 16 ) | ( static_cast<uint32_t>(src[3]) << 24 );
+}
+
+static void writeUInt32 (uint8_t* dest, uint32_t value)
+{
+	dest[0] = ( value       ) & 0xFF;
+	dest[1] = ( value >> 8  ) & 0xFF;
+	dest[2] = ( value >> 16 ) & 0xFF;
+	dest[3] = ( value >> 24 ) & 0xFF;
+}
+
+JournaledStorageMedia::JournaledStorageMedia (IStorageMedia& child, uint64_t dataSizeInBytes, unsigned int journalSizeInBytes,
+						unsigned int groupCommitSizeInBytes) :
+	m_Child( child ),
+	m_DataSizeInBytes( dataSizeInBytes ),
+	m_JournalSizeInBytes( std::max<unsigned int>(journalSizeInBytes, JOURNAL_HEADER_SIZE) ),
+	m_GroupCommitSizeInBytes( groupCommitSizeInBytes ),
+	m_Records(),
+	m_NumGroupRecords( 0 ),
+	m_GroupSizeInBytes( 0 ),
+	m_InTransaction( false ),
+	m_SequenceNum( 0 )
+{
+	this->fitToChild();
+}
+
+JournaledStorageMedia::~JournaledStorageMedia()
+{
+	// an open transaction was never committed, so it's dropped
+	this->abortTransaction();
+	this->flush();
+}
+
+void JournaledStorageMedia::writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes)
+{
+	this->writeToMedia64( data, offsetInBytes );
+}
+
+SharedData<uint8_t> JournaledStorageMedia::readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes)
+{
+	return this->readFromMedia64( sizeInBytes, offsetInBytes );
+}
+
+void JournaledStorageMedia::readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data)
+{
+	this->readFromMedia64( static_cast<uint64_t>(offsetInBytes), data );
+}
+
+void JournaledStorageMedia::writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes)
+{
+	if ( data.getSizeInBytes() == 0 || ! this->isInRange(offsetInBytes, data.getSizeInBytes()) ) return;
+
+	if ( m_InTransaction )
+	{
+		this->addRecord( data.getPtr(), data.getSizeInBytes(), offsetInBytes );
+
+		return;
+	}
+
+	// a journal too small to hold even one byte can't protect anything, so the write just goes through
+	const unsigned int maxChunkSize = ( m_JournalSizeInBytes > JOURNAL_HEADER_SIZE + JOURNAL_RECORD_HEADER_SIZE )
+						? m_JournalSizeInBytes - JOURNAL_HEADER_SIZE - JOURNAL_RECORD_HEADER_SIZE : 0;
+	if ( maxChunkSize == 0 )
+	{
+		this->flush();
+		m_Child.writeToMedia64( data, offsetInBytes );
+
+		return;
+	}
+
+	// a write outside of a transaction is committed on its own, in journal sized chunks if it's too big for one
+	for ( unsigned int chunkOffset = 0; chunkOffset < data.getSizeInBytes(); chunkOffset += maxChunkSize )
+	{
+		this->beginTransaction();
+		this->addRecord( data.getPtr(chunkOffset), std::min(maxChunkSize, data.getSizeInBytes() - chunkOffset), offsetInBytes + chunkOffset );
+		this->commitTransaction();
+	}
+}
+
+SharedData<uint8_t> JournaledStorageMedia::readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes)
+{
+	if ( ! this->isInRange(offsetInBytes, sizeInBytes) ) return SharedData<uint8_t>::MakeSharedDataNull();
+
+	SharedData<uint8_t> data = SharedData<uint8_t>::MakeSharedData( sizeInBytes );
+
+	this->readFromMedia64( offsetInBytes, data );
+
+	return data;
+}
+
+void JournaledStorageMedia::readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data)
+{
+	if ( data.getSizeInBytes() == 0 || ! this->isInRange(offsetInBytes, data.getSizeInBytes()) ) return;
+
+	m_Child.readFromMedia64( offsetInBytes, data );
+
+	// overlay the writes that haven't reached the media yet, oldest first so the newest wins
+	const uint64_t endInBytes = offsetInBytes + data.getSizeInBytes();
+	for ( const JournalRecord& record : m_Records )
+	{
+		const uint64_t recordEnd = record.m_OffsetInBytes + record.m_Data.getSizeInBytes();
+		const uint64_t overlapStart = std::max( offsetInBytes, record.m_OffsetInBytes );
+		const uint64_t overlapEnd = std::min( endInBytes, recordEnd );
+
+		if ( overlapStart < overlapEnd )
+		{
+			std::memcpy( data.getPtr(overlapStart - offsetInBytes), record.m_Data.getPtr(overlapStart - record.m_OffsetInBytes),
+					overlapEnd - overlapStart );
+		}
+	}
+}
+
+void JournaledStorageMedia::discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes)
+{
+	this->discard64( static_cast<uint64_t>(offsetInBytes), static_cast<uint64_t>(sizeInBytes) );
+}
+
+void JournaledStorageMedia::discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes)
+{
+	if ( offsetInBytes >= m_DataSizeInBytes ) return;
+
+	// committed writes to the range have to land before it's discarded, not after
+	this->flush();
+
+	m_Child.discard64( offsetInBytes, std::min(sizeInBytes, m_DataSizeInBytes - offsetInBytes) );
+}
+
+void JournaledStorageMedia::afterInitialize()
+{
+	m_Child.afterInitialize();
+
+	// some media only know their capacity once they're initialized
+	this->fitToChild();
+	this->mount();
+}
+
+IStorageMediaInfo JournaledStorageMedia::getMediaInfo()
+{
+	IStorageMediaInfo info = m_Child.getMediaInfo();
+	info.m_CapacityInBytes = m_DataSizeInBytes;
+
+	return info;
+}
+
+bool JournaledStorageMedia::mount()
+{
+	m_Records.clear();
+	m_NumGroupRecords = 0;
+	m_GroupSizeInBytes = 0;
+	m_InTransaction = false;
+
+	SharedData<uint8_t> header = m_Child.readFromMedia64( JOURNAL_HEADER_SIZE, m_DataSizeInBytes );
+	if ( header.getSizeInBytes() != JOURNAL_HEADER_SIZE ) return false;
+
+	const uint8_t* headerPtr = header.getPtr();
+	const uint32_t payloadSize = readUInt32( headerPtr + 12 );
+	if ( readUInt32(headerPtr) != JOURNAL_MAGIC || readUInt32(headerPtr + 20) != Checksum::Crc32(headerPtr, 20)
+			|| payloadSize > m_JournalSizeInBytes - JOURNAL_HEADER_SIZE )
+	{
+		return false;
+	}
+
+	m_SequenceNum = readUInt32( headerPtr + 4 ) + 1;
+
+	// a journal that was only partly written is ignored, none of its writes reached their home locations
+	SharedData<uint8_t> payload = m_Child.readFromMedia64( payloadSize, m_DataSizeInBytes + JOURNAL_HEADER_SIZE );
+	if ( payload.getSizeInBytes() != payloadSize || readUInt32(headerPtr + 16) != Checksum::Crc32(payload.getPtr(), payloadSize) )
+	{
+		this->markJournalApplied();
+
+		return false;
+	}
+
+	this->applyRecords( payload.getPtr(), payloadSize );
+	this->markJournalApplied();
+
+	return true;
+}
+
+void JournaledStorageMedia::beginTransaction()
+{
+	// transactions don't nest, a second begin just carries on with the open transaction
+	m_InTransaction = true;
+}
+
+bool JournaledStorageMedia::commitTransaction()
+{
+	if ( ! m_InTransaction ) return true;
+
+	m_InTransaction = false;
+
+	const unsigned int transactionSize = this->getTransactionSizeInBytes();
+	if ( transactionSize == 0 ) return true;
+
+	if ( JOURNAL_HEADER_SIZE + transactionSize > m_JournalSizeInBytes )
+	{
+		m_Records.erase( m_Records.begin() + m_NumGroupRecords, m_Records.end() );
+
+		return false;
+	}
+
+	// if the group can't take this transaction as well, flush the group on its own first
+	if ( JOURNAL_HEADER_SIZE + m_GroupSizeInBytes + transactionSize > m_JournalSizeInBytes ) this->flush();
+
+	m_NumGroupRecords = m_Records.size();
+	m_GroupSizeInBytes += transactionSize;
+
+	if ( m_GroupSizeInBytes >= m_GroupCommitSizeInBytes ) this->flush();
+
+	return true;
+}
+
+void JournaledStorageMedia::abortTransaction()
+{
+	m_Records.erase( m_Records.begin() + m_NumGroupRecords, m_Records.end() );
+	m_InTransaction = false;
+}
+
+void JournaledStorageMedia::flush()
+{
+	if ( m_NumGroupRecords == 0 ) return;
+
+	// the whole group goes to the journal in one write
+	SharedData<uint8_t> journal = SharedData<uint8_t>::MakeSharedData( JOURNAL_HEADER_SIZE + m_GroupSizeInBytes );
+	uint8_t* payloadPtr = journal.getPtr( JOURNAL_HEADER_SIZE );
+	unsigned int payloadIndex = 0;
+
+	for ( unsigned int recordNum = 0; recordNum < m_NumGroupRecords; recordNum++ )
+	{
+		const JournalRecord& record = m_Records[recordNum];
+		const unsigned int recordSize = record.m_Data.getSizeInBytes();
+
+		writeUInt32( payloadPtr + payloadIndex, record.m_OffsetInBytes & 0xFFFFFFFF );
+		writeUInt32( payloadPtr + payloadIndex + 4, record.m_OffsetInBytes >> 32 );
+		writeUInt32( payloadPtr + payloadIndex + 8, recordSize );
+		std::memcpy( payloadPtr + payloadIndex + JOURNAL_RECORD_HEADER_SIZE, record.m_Data.getPtr(), recordSize );
+
+		payloadIndex += JOURNAL_RECORD_HEADER_SIZE + recordSize;
+	}
+
+	uint8_t* headerPtr = journal.getPtr();
+	writeUInt32( headerPtr, JOURNAL_MAGIC );
+	writeUInt32( headerPtr + 4, m_SequenceNum );
+	writeUInt32( headerPtr + 8, m_NumGroupRecords );
+	writeUInt32( headerPtr + 12, m_GroupSizeInBytes );
+	writeUInt32( headerPtr + 16, Checksum::Crc32(payloadPtr, m_GroupSizeInBytes) );
+	writeUInt32( headerPtr + 20, Checksum::Crc32(headerPtr, 20) );
+
+	m_Child.writeToMedia64( journal, m_DataSizeInBytes );
+
+	// once the journal is on the media, the home locations can be updated in any order
+	for ( unsigned int recordNum = 0; recordNum < m_NumGroupRecords; recordNum++ )
+	{
+		m_Child.writeToMedia64( m_Records[recordNum].m_Data, m_Records[recordNum].m_OffsetInBytes );
+	}
+
+	this->markJournalApplied();
+
+	m_Records.erase( m_Records.begin(), m_Records.begin() + m_NumGroupRecords );
+	m_NumGroupRecords = 0;
+	m_GroupSizeInBytes = 0;
+	m_SequenceNum++;
+}
+
+void JournaledStorageMedia::addRecord (const uint8_t* data, unsigned int sizeInBytes, uint64_t offsetInBytes)
+{
+	// the callers buffer may change before the group is flushed, so keep a copy
+	SharedData<uint8_t> recordData = SharedData<uint8_t>::MakeSharedData( sizeInBytes );
+	std::memcpy( recordData.getPtr(), data, sizeInBytes );
+
+	m_Records.push_back( JournalRecord{offsetInBytes, recordData} );
+}
+
+unsigned int JournaledStorageMedia::getTransactionSizeInBytes()
+{
+	unsigned int transactionSize = 0;
+
+	for ( unsigned int recordNum = m_NumGroupRecords; recordNum < m_Records.size(); recordNum++ )
+	{
+		transactionSize += JOURNAL_RECORD_HEADER_SIZE + m_Records[recordNum].m_Data.getSizeInBytes();
+	}
+
+	return transactionSize;
+}
+
+void JournaledStorageMedia::fitToChild()
+{
+	const uint64_t childCapacity = m_Child.getMediaInfo().m_CapacityInBytes;
+	if ( childCapacity == 0 ) return;
+
+	// the journal has to fit after the data region, so a child that's too small loses data region rather than journal
+	const uint64_t maxDataSize = ( childCapacity > m_JournalSizeInBytes ) ? childCapacity - m_JournalSizeInBytes : 0;
+	m_DataSizeInBytes = std::min( m_DataSizeInBytes, maxDataSize );
+}
+
+void JournaledStorageMedia::applyRecords (const uint8_t* payload, unsigned int payloadSize)
+{
+	unsigned int payloadIndex = 0;
+
+	while ( payloadIndex + JOURNAL_RECORD_HEADER_SIZE <= payloadSize )
+	{
+		const uint64_t recordOffset = static_cast<uint64_t>( readUInt32(payload + payloadIndex) )
+						| ( static_cast<uint64_t>(readUInt32(payload + payloadIndex + 4)) << 32 );
+		const unsigned int recordSize = readUInt32( payload + payloadIndex + 8 );
+		payloadIndex += JOURNAL_RECORD_HEADER_SIZE;
+
+		if ( recordSize > payloadSize - payloadIndex || ! this->isInRange(recordOffset, recordSize) ) return;
+
+		// write straight from the journal buffer
+		const uint8_t* recordData = payload + payloadIndex;
+		m_Child.writeToMedia64( SharedData<uint8_t>::MakeSharedData(recordSize, const_cast<uint8_t*>(recordData)), recordOffset );
+
+		payloadIndex += recordSize;
+	}
+}
+
+void JournaledStorageMedia::markJournalApplied()
+{
+	// clearing the whole header, not just the magic, means a torn write of the next journal can't bring this one back
+	SharedData<uint8_t> header = SharedData<uint8_t>::MakeSharedData( JOURNAL_HEADER_SIZE );
+	std::memset( header.getPtr(), 0, JOURNAL_HEADER_SIZE );
+
+	m_Child.writeToMedia64( header, m_DataSizeInBytes );
+}
@@ -0,0 +1,413 @@
+#include "LogKeyValueStore.hpp"
+
+#include <algorithm>
+
+#define HALF_HEADER_SIZE 16
+#define HALF_MAGIC 0x53564B4C // 'LKVS'
+#define RECORD_HEADER_SIZE 16
+#define RECORD_MAGIC 0xA5
+#define RECORD_FLAG_TOMBSTONE 0b00000001
+
+// the store is compacted in the background once this fraction of the active half is taken up by superseded records
+#define COMPACTION_GARBAGE_DIVISOR 4
+
+static void writeUInt32 (uint8_t* dest, uint32_t value)
+{
+	dest[0] = ( value       ) & 0xFF;
+	dest[1] = ( value >> 8  ) & 0xFF;
+	dest[2] = ( value >> 16 ) & 0xFF;
+	dest[3] = ( value >> 24 ) & 0xFF;
+}
+
+static uint32_t readUInt32 (const uint8_t* src)
+{
+	return static_cast<uint32_t>( src[0] ) | ( static_cast<uint32_t>(src[1]) << 8 )
+		| ( static_cast<uint32_t>(src[2]) << 16 ) | ( static_cast<uint32_t>(src[3]) << 24 );
+}
+
+// fletcher-16, only used to detect records torn by a power loss
+static uint16_t calculateChecksum (const uint8_t* data, unsigned int sizeInBytes)
+{
+	uint16_t sum1 = 0;
+	uint16_t sum2 = 0;
+
+	for ( unsigned int byte = 0; byte < sizeInBytes; byte++ )
+	{
+		sum1 = ( sum1 + data[byte] ) % 255;
+		sum2 = ( sum2 + sum1 ) % 255;
+	}
+
+	return ( sum2 << 8 ) | sum1;
+}
+
+LogKeyValueStore::LogKeyValueStore (IStorageMedia& media, uint64_t regionOffsetInBytes, uint64_t regionSizeInBytes) :
+	m_Media( media ),
+	m_RegionOffset( regionOffsetInBytes ),
+	m_HalfSize( regionSizeInBytes / 2 ),
+	m_Index(),
+	m_LiveBytes( 0 ),
+	m_ActiveHalf( 0 ),
+	m_ActiveGeneration( 0 ),
+	m_AppendOffset( HALF_HEADER_SIZE ),
+	m_Compacting( false ),
+	m_OldGeneration( 0 ),
+	m_CompactCursor( 0 ),
+	m_OldEndOffset( 0 ),
+	m_OldLiveBytes( 0 )
+{
+}
+
+LogKeyValueStore::~LogKeyValueStore()
+{
+}
+
+void LogKeyValueStore::mount()
+{
+	m_Index.clear();
+	m_LiveBytes = 0;
+	m_Compacting = false;
+	m_OldLiveBytes = 0;
+
+	uint32_t generations[2] = { 0, 0 };
+	const bool half0Valid = this->readHalfHeader( 0, generations[0] );
+	const bool half1Valid = this->readHalfHeader( 1, generations[1] );
+
+	if ( ! half0Valid && ! half1Valid )
+	{
+		// nothing here yet, so format the region
+		m_ActiveHalf = 0;
+		m_ActiveGeneration = 1;
+		m_AppendOffset = HALF_HEADER_SIZE;
+		this->writeHalfHeader( m_ActiveHalf, m_ActiveGeneration );
+	}
+	else if ( half0Valid && half1Valid )
+	{
+		// a compaction was interrupted, replay the old half first so the newer records win
+		const unsigned int oldHalf = ( generations[0] < generations[1] ) ? 0 : 1;
+		m_ActiveHalf = 1 - oldHalf;
+		m_ActiveGeneration = generations[m_ActiveHalf];
+		m_OldGeneration = generations[oldHalf];
+
+		m_OldEndOffset = this->scanHalf( oldHalf, m_OldGeneration );
+		m_AppendOffset = this->scanHalf( m_ActiveHalf, m_ActiveGeneration );
+
+		// copying records is idempotent, so the compaction can simply start over
+		m_Compacting = true;
+		m_CompactCursor = HALF_HEADER_SIZE;
+		for ( const auto& entry : m_Index )
+		{
+			if ( entry.second.m_Half == oldHalf ) m_OldLiveBytes += RECORD_HEADER_SIZE + entry.second.m_ValueSize;
+		}
+	}
+	else
+	{
+		m_ActiveHalf = ( half0Valid ) ? 0 : 1;
+		m_ActiveGeneration = generations[m_ActiveHalf];
+		m_AppendOffset = this->scanHalf( m_ActiveHalf, m_ActiveGeneration );
+	}
+}
+
+bool LogKeyValueStore::put (uint32_t key, const SharedData<uint8_t>& value)
+{
+	if ( ! this->reserveSpace(RECORD_HEADER_SIZE + value.getSizeInBytes()) ) return false;
+
+	this->appendRecord( key, value, false );
+
+	return true;
+}
+
+SharedData<uint8_t> LogKeyValueStore::get (uint32_t key)
+{
+	auto indexIt = m_Index.find( key );
+	if ( indexIt == m_Index.end() ) return SharedData<uint8_t>::MakeSharedDataNull();
+
+	const RecordLocation& location = indexIt->second;
+	if ( location.m_ValueSize == 0 ) return SharedData<uint8_t>::MakeSharedDataNull();
+
+	return m_Media.readFromMedia64( location.m_ValueSize, this->getHalfOffset(location.m_Half) + location.m_OffsetInHalf
+						+ RECORD_HEADER_SIZE );
+}
+
+bool LogKeyValueStore::contains (uint32_t key)
+{
+	return m_Index.find( key ) != m_Index.end();
+}
+
+bool LogKeyValueStore::remove (uint32_t key)
+{
+	if ( ! this->contains(key) || ! this->reserveSpace(RECORD_HEADER_SIZE) ) return false;
+
+	this->appendRecord( key, SharedData<uint8_t>::MakeSharedDataNull(), true );
+
+	return true;
+}
+
+bool LogKeyValueStore::compactStep (unsigned int maxRecords)
+{
+	if ( ! m_Compacting )
+	{
+		if ( ! this->needsCompaction() ) return false;
+
+		this->startCompaction();
+	}
+
+	for ( unsigned int recordNum = 0; recordNum < maxRecords && m_CompactCursor < m_OldEndOffset; recordNum++ )
+	{
+		this->copyNextOldRecord();
+	}
+
+	if ( m_CompactCursor >= m_OldEndOffset )
+	{
+		this->finishCompaction();
+
+		return false;
+	}
+
+	return true;
+}
+
+void LogKeyValueStore::compact()
+{
+	if ( ! m_Compacting ) this->startCompaction();
+
+	while ( m_CompactCursor < m_OldEndOffset )
+	{
+		this->copyNextOldRecord();
+	}
+
+	this->finishCompaction();
+}
+
+bool LogKeyValueStore::needsCompaction()
+{
+	if ( m_Compacting ) return true;
+
+	const uint64_t garbageBytes = ( m_AppendOffset - HALF_HEADER_SIZE ) - m_LiveBytes;
+
+	return garbageBytes > 0 && garbageBytes >= ( m_HalfSize - HALF_HEADER_SIZE ) / COMPACTION_GARBAGE_DIVISOR;
+}
+
+uint64_t LogKeyValueStore::getFreeBytes()
+{
+	// what would be available after a compaction
+	return ( m_HalfSize - HALF_HEADER_SIZE ) - m_LiveBytes;
+}
+
+bool LogKeyValueStore::readHalfHeader (unsigned int half, uint32_t& generation)
+{
+	if ( m_HalfSize < HALF_HEADER_SIZE ) return false;
+
+	SharedData<uint8_t> header = m_Media.readFromMedia64( HALF_HEADER_SIZE, this->getHalfOffset(half) );
+	if ( header.getSizeInBytes() != HALF_HEADER_SIZE ) return false;
+
+	const uint8_t* headerPtr = header.getPtr();
+	const uint16_t checksum = headerPtr[8] | ( headerPtr[9] << 8 );
+	if ( readUInt32(headerPtr) != HALF_MAGIC || calculateChecksum(headerPtr, 8) != checksum ) return false;
+
+	generation = readUInt32( headerPtr + 4 );
+
+	return true;
+}
+
+void LogKeyValueStore::writeHalfHeader (unsigned int half, uint32_t generation)
+{
+	SharedData<uint8_t> header = SharedData<uint8_t>::MakeSharedData( HALF_HEADER_SIZE );
+	uint8_t* headerPtr = header.getPtr();
+	std::fill( headerPtr, headerPtr + HALF_HEADER_SIZE, 0 );
+
+	writeUInt32( headerPtr, HALF_MAGIC );
+	writeUInt32( headerPtr + 4, generation );
+	const uint16_t checksum = calculateChecksum( headerPtr, 8 );
+	headerPtr[8] = checksum & 0xFF;
+	headerPtr[9] = checksum >> 8;
+
+	m_Media.writeToMedia64( header, this->getHalfOffset(half) );
+}
+
+void LogKeyValueStore::eraseHalfHeader (unsigned int half)
+{
+	SharedData<uint8_t> header = SharedData<uint8_t>::MakeSharedData( HALF_HEADER_SIZE );
+	std::fill( header.getPtr(), header.getPtr() + HALF_HEADER_SIZE, 0 );
+
+	m_Media.writeToMedia64( header, this->getHalfOffset(half) );
+}
+
+LogKeyValueStore::RecordHeader LogKeyValueStore::readRecordHeader (unsigned int half, uint64_t offsetInHalf, uint32_t generation)
+{
+	RecordHeader header;
+	if ( offsetInHalf + RECORD_HEADER_SIZE > m_HalfSize ) return header;
+
+	SharedData<uint8_t> headerData = m_Media.readFromMedia64( RECORD_HEADER_SIZE, this->getHalfOffset(half) + offsetInHalf );
+	if ( headerData.getSizeInBytes() != RECORD_HEADER_SIZE ) return header;
+
+	const uint8_t* headerPtr = headerData.getPtr();
+	header.m_IsTombstone = headerPtr[1] & RECORD_FLAG_TOMBSTONE;
+	header.m_Checksum = headerPtr[2] | ( headerPtr[3] << 8 );
+	header.m_Generation = readUInt32( headerPtr + 4 );
+	header.m_Key = readUInt32( headerPtr + 8 );
+	header.m_ValueSize = readUInt32( headerPtr + 12 );
+
+	// records left over from when this half was used by an older generation end the log
+	header.m_IsValid = headerPtr[0] == RECORD_MAGIC && header.m_Generation == generation
+				&& offsetInHalf + RECORD_HEADER_SIZE + header.m_ValueSize <= m_HalfSize;
+
+	return header;
+}
+
+bool LogKeyValueStore::verifyRecord (const RecordHeader& header, unsigned int half, uint64_t offsetInHalf)
+{
+	const unsigned int recordSize = RECORD_HEADER_SIZE + header.m_ValueSize;
+	SharedData<uint8_t> record = m_Media.readFromMedia64( recordSize, this->getHalfOffset(half) + offsetInHalf );
+	if ( record.getSizeInBytes() != recordSize ) return false;
+
+	return calculateChecksum( record.getPtr(4), recordSize - 4 ) == header.m_Checksum;
+}
+
+void LogKeyValueStore::appendRecord (uint32_t key, const SharedData<uint8_t>& value, bool isTombstone)
+{
+	const unsigned int valueSize = ( isTombstone ) ? 0 : value.getSizeInBytes();
+	const unsigned int recordSize = RECORD_HEADER_SIZE + valueSize;
+
+	// the header and value go out in a single write
+	SharedData<uint8_t> record = SharedData<uint8_t>::MakeSharedData( recordSize );
+	uint8_t* recordPtr = record.getPtr();
+
+	recordPtr[0] = RECORD_MAGIC;
+	recordPtr[1] = ( isTombstone ) ? RECORD_FLAG_TOMBSTONE : 0;
+	writeUInt32( recordPtr + 4, m_ActiveGeneration );
+	writeUInt32( recordPtr + 8, key );
+	writeUInt32( recordPtr + 12, valueSize );
+	if ( valueSize > 0 ) std::copy( value.getPtr(), value.getPtr() + valueSize, recordPtr + RECORD_HEADER_SIZE );
+
+	const uint16_t checksum = calculateChecksum( recordPtr + 4, recordSize - 4 );
+	recordPtr[2] = checksum & 0xFF;
+	recordPtr[3] = checksum >> 8;
+
+	m_Media.writeToMedia64( record, this->getHalfOffset(m_ActiveHalf) + m_AppendOffset );
+
+	auto indexIt = m_Index.find( key );
+	if ( indexIt != m_Index.end() )
+	{
+		this->forgetLocation( indexIt->second );
+		m_Index.erase( indexIt );
+	}
+
+	if ( ! isTombstone )
+	{
+		m_Index[key] = RecordLocation{ m_ActiveHalf, m_AppendOffset, valueSize };
+		m_LiveBytes += recordSize;
+	}
+
+	m_AppendOffset += recordSize;
+}
+
+uint64_t LogKeyValueStore::scanHalf (unsigned int half, uint32_t generation)
+{
+	uint64_t offset = HALF_HEADER_SIZE;
+
+	while ( true )
+	{
+		const RecordHeader header = this->readRecordHeader( half, offset, generation );
+		if ( ! header.m_IsValid || ! this->verifyRecord(header, half, offset) ) break;
+
+		const unsigned int recordSize = RECORD_HEADER_SIZE + header.m_ValueSize;
+
+		auto indexIt = m_Index.find( header.m_Key );
+		if ( indexIt != m_Index.end() )
+		{
+			m_LiveBytes -= RECORD_HEADER_SIZE + indexIt->second.m_ValueSize;
+			m_Index.erase( indexIt );
+		}
+
+		if ( ! header.m_IsTombstone )
+		{
+			m_Index[header.m_Key] = RecordLocation{ half, offset, header.m_ValueSize };
+			m_LiveBytes += recordSize;
+		}
+
+		offset += recordSize;
+	}
+
+	return offset;
+}
+
+bool LogKeyValueStore::reserveSpace (uint64_t recordSize)
+{
+	// while compacting, the live records still in the old half need to fit in the active half as well
+	if ( m_Compacting && m_AppendOffset + recordSize + m_OldLiveBytes > m_HalfSize )
+	{
+		this->compact();
+	}
+
+	if ( ! m_Compacting && m_AppendOffset + recordSize > m_HalfSize )
+	{
+		// no point compacting if the record won't fit even then
+		if ( HALF_HEADER_SIZE + m_LiveBytes + recordSize > m_HalfSize ) return false;
+
+		this->compact();
+	}
+
+	const uint64_t reservedBytes = ( m_Compacting ) ? m_OldLiveBytes : 0;
+
+	return m_AppendOffset + recordSize + reservedBytes <= m_HalfSize;
+}
+
+void LogKeyValueStore::startCompaction()
+{
+	m_OldGeneration = m_ActiveGeneration;
+	m_OldEndOffset = m_AppendOffset;
+	m_OldLiveBytes = m_LiveBytes;
+	m_CompactCursor = HALF_HEADER_SIZE;
+
+	m_ActiveHalf = 1 - m_ActiveHalf;
+	m_ActiveGeneration++;
+	m_AppendOffset = HALF_HEADER_SIZE;
+	this->writeHalfHeader( m_ActiveHalf, m_ActiveGeneration );
+
+	m_Compacting = true;
+}
+
+void LogKeyValueStore::copyNextOldRecord()
+{
+	const unsigned int oldHalf = 1 - m_ActiveHalf;
+	const RecordHeader header = this->readRecordHeader( oldHalf, m_CompactCursor, m_OldGeneration );
+	if ( ! header.m_IsValid )
+	{
+		m_CompactCursor = m_OldEndOffset;
+
+		return;
+	}
+
+	// only copy the record if it's still the latest one for its key
+	auto indexIt = m_Index.find( header.m_Key );
+	if ( ! header.m_IsTombstone && indexIt != m_Index.end() && indexIt->second.m_Half == oldHalf
+			&& indexIt->second.m_OffsetInHalf == m_CompactCursor )
+	{
+		SharedData<uint8_t> value = m_Media.readFromMedia64( header.m_ValueSize, this->getHalfOffset(oldHalf) + m_CompactCursor
+									+ RECORD_HEADER_SIZE );
+		this->appendRecord( header.m_Key, value, false );
+	}
+
+	m_CompactCursor += RECORD_HEADER_SIZE + header.m_ValueSize;
+}
+
+void LogKeyValueStore::finishCompaction()
+{
+	if ( ! m_Compacting ) return;
+
+	this->eraseHalfHeader( 1 - m_ActiveHalf );
+
+	// nothing in the old half is needed anymore, so the media can erase it before the half is reused
+	m_Media.discard64( this->getHalfOffset(1 - m_ActiveHalf) + HALF_HEADER_SIZE, m_HalfSize - HALF_HEADER_SIZE );
+
+	m_Compacting = false;
+	m_OldLiveBytes = 0;
+}
+
+void LogKeyValueStore::forgetLocation (const RecordLocation& location)
+{
+	const uint64_t recordSize = RECORD_HEADER_SIZE + location.m_ValueSize;
+
+	m_LiveBytes -= recordSize;
+	if ( m_Compacting && location.m_Half != m_ActiveHalf ) m_OldLiveBytes -= recordSize;
+}
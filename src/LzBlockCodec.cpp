@@ -0,0 +1,201 @@
+#include "LzBlockCodec.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#define MIN_MATCH_LENGTH 4
+// the format requires the last 5 bytes to be literals and the last match to start at least 12 bytes before the end
+#define LAST_LITERALS 5
+#define MATCH_FIND_LIMIT 12
+#define MAX_MATCH_OFFSET 65535
+#define TOKEN_LENGTH_MASK 0x0F
+
+static uint32_t readUInt32 (const uint8_t* src)
+{
+	uint32_t value;
+	std::memcpy( &value, src, sizeof(value) );
+
+	return value;
+}
+
+// writes a length that didn't fit in the token's nibble as a run of 255s and a remainder, returns false if it won't fit
+static bool writeExtraLength (unsigned int length, uint8_t*& destPtr, const uint8_t* destEnd)
+{
+	while ( length >= 255 )
+	{
+		if ( destPtr >= destEnd ) return false;
+
+		*destPtr++ = 255;
+		length -= 255;
+	}
+
+	if ( destPtr >= destEnd ) return false;
+	*destPtr++ = length;
+
+	return true;
+}
+
+static bool readExtraLength (unsigned int& length, const uint8_t*& srcPtr, const uint8_t* srcEnd)
+{
+	uint8_t byte = 255;
+	while ( byte == 255 )
+	{
+		if ( srcPtr >= srcEnd ) return false;
+
+		byte = *srcPtr++;
+		length += byte;
+	}
+
+	return true;
+}
+
+static bool writeSequence (const uint8_t* literals, unsigned int numLiterals, unsigned int matchOffset, unsigned int matchLength,
+				uint8_t*& destPtr, const uint8_t* destEnd)
+{
+	// a match length of 0 marks the final sequence, which only has literals
+	const unsigned int extraMatchLength = ( matchLength > 0 ) ? matchLength - MIN_MATCH_LENGTH : 0;
+
+	if ( destPtr >= destEnd ) return false;
+	uint8_t* tokenPtr = destPtr++;
+	*tokenPtr = ( std::min<unsigned int>(numLiterals, TOKEN_LENGTH_MASK) << 4 ) | std::min<unsigned int>( extraMatchLength, TOKEN_LENGTH_MASK );
+
+	if ( numLiterals >= TOKEN_LENGTH_MASK && ! writeExtraLength(numLiterals - TOKEN_LENGTH_MASK, destPtr, destEnd) ) return false;
+
+	if ( static_cast<unsigned int>(destEnd - destPtr) < numLiterals ) return false;
+	std::memcpy( destPtr, literals, numLiterals );
+	destPtr += numLiterals;
+
+	if ( matchLength == 0 ) return true;
+
+	if ( destEnd - destPtr < 2 ) return false;
+	*destPtr++ = matchOffset & 0xFF;
+	*destPtr++ = matchOffset >> 8;
+
+	if ( extraMatchLength >= TOKEN_LENGTH_MASK && ! writeExtraLength(extraMatchLength - TOKEN_LENGTH_MASK, destPtr, destEnd) ) return false;
+
+	return true;
+}
+
+LzBlockCodec::LzBlockCodec (unsigned int hashTableBits) :
+	m_HashTableBits( std::min<unsigned int>(std::max<unsigned int>(hashTableBits, 8), 16) ),
+	m_HashTable( 1 << m_HashTableBits )
+{
+}
+
+LzBlockCodec::~LzBlockCodec()
+{
+}
+
+unsigned int LzBlockCodec::hash (const uint8_t* src) const
+{
+	return ( readUInt32(src) * 2654435761U ) >> ( 32 - m_HashTableBits );
+}
+
+unsigned int LzBlockCodec::compress (const uint8_t* src, unsigned int srcSize, uint8_t* dest, unsigned int destCapacity)
+{
+	if ( srcSize > LZ_BLOCK_CODEC_MAX_BLOCK_SIZE ) return 0;
+
+	uint8_t* destPtr = dest;
+	const uint8_t* destEnd = dest + destCapacity;
+	unsigned int literalStart = 0;
+
+	if ( srcSize > MATCH_FIND_LIMIT )
+	{
+		std::fill( m_HashTable.begin(), m_HashTable.end(), 0 );
+
+		const unsigned int matchFindEnd = srcSize - MATCH_FIND_LIMIT;
+		const unsigned int matchEnd = srcSize - LAST_LITERALS;
+		unsigned int position = 1;
+		m_HashTable[this->hash(src)] = 0;
+
+		while ( position < matchFindEnd )
+		{
+			const unsigned int hashValue = this->hash( src + position );
+			const unsigned int candidate = m_HashTable[hashValue];
+			m_HashTable[hashValue] = position;
+
+			if ( position - candidate > MAX_MATCH_OFFSET || readUInt32(src + candidate) != readUInt32(src + position) )
+			{
+				position++;
+				continue;
+			}
+
+			// extend the match backwards over any pending literals, then forwards as far as the format allows
+			unsigned int matchStart = position;
+			unsigned int matchSource = candidate;
+			while ( matchStart > literalStart && matchSource > 0 && src[matchStart - 1] == src[matchSource - 1] )
+			{
+				matchStart--;
+				matchSource--;
+			}
+
+			unsigned int matchLength = ( position - matchStart ) + MIN_MATCH_LENGTH;
+			while ( matchStart + matchLength < matchEnd && src[matchStart + matchLength] == src[matchSource + matchLength] )
+			{
+				matchLength++;
+			}
+
+			if ( ! writeSequence(src + literalStart, matchStart - literalStart, matchStart - matchSource, matchLength, destPtr, destEnd) )
+			{
+				return 0;
+			}
+
+			position = matchStart + matchLength;
+			literalStart = position;
+
+			// remember a position inside the match too, it helps with long runs
+			if ( position - 2 < matchFindEnd ) m_HashTable[this->hash(src + position - 2)] = position - 2;
+		}
+	}
+
+	if ( ! writeSequence(src + literalStart, srcSize - literalStart, 0, 0, destPtr, destEnd) ) return 0;
+
+	return destPtr - dest;
+}
+
+bool LzBlockCodec::decompress (const uint8_t* src, unsigned int srcSize, uint8_t* dest, unsigned int destSize)
+{
+	const uint8_t* srcPtr = src;
+	const uint8_t* srcEnd = src + srcSize;
+	uint8_t* destPtr = dest;
+	const uint8_t* destEnd = dest + destSize;
+
+	while ( srcPtr < srcEnd )
+	{
+		const uint8_t token = *srcPtr++;
+
+		unsigned int numLiterals = token >> 4;
+		if ( numLiterals == TOKEN_LENGTH_MASK && ! readExtraLength(numLiterals, srcPtr, srcEnd) ) return false;
+
+		if ( static_cast<unsigned int>(srcEnd - srcPtr) < numLiterals || static_cast<unsigned int>(destEnd - destPtr) < numLiterals ) return false;
+		std::memcpy( destPtr, srcPtr, numLiterals );
+		srcPtr += numLiterals;
+		destPtr += numLiterals;
+
+		// the final sequence has no match
+		if ( srcPtr == srcEnd ) break;
+
+		if ( srcEnd - srcPtr < 2 ) return false;
+		const unsigned int matchOffset = srcPtr[0] | ( srcPtr[1] << 8 );
+		srcPtr += 2;
+
+		unsigned int matchLength = token & TOKEN_LENGTH_MASK;
+		if ( matchLength == TOKEN_LENGTH_MASK && ! readExtraLength(matchLength, srcPtr, srcEnd) ) return false;
+		matchLength += MIN_MATCH_LENGTH;
+
+		if ( matchOffset == 0 || matchOffset > static_cast<unsigned int>(destPtr - dest)
+				|| static_cast<unsigned int>(destEnd - destPtr) < matchLength )
+		{
+			return false;
+		}
+
+		// matches may overlap what they're writing (runs), so copy byte by byte
+		const uint8_t* matchPtr = destPtr - matchOffset;
+		for ( unsigned int byte = 0; byte < matchLength; byte++ )
+		{
+			*destPtr++ = *matchPtr++;
+		}
+	}
+
+	return destPtr == destEnd;
+}
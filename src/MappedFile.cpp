@@ -0,0 +1,160 @@
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile (const std::string& fileName, uint64_t sizeInBytes) :
+	m_FileName( fileName ),
+	m_FileDescriptor( -1 ),
+	m_Mapping( nullptr ),
+	m_SizeInBytes( 0 ),
+	m_PageSizeInBytes( static_cast<unsigned int>(sysconf(_SC_PAGESIZE)) )
+{
+	const int flags = ( sizeInBytes > 0 ) ? O_RDWR | O_CREAT : O_RDWR;
+	m_FileDescriptor = open( ("./" + m_FileName).c_str(), flags, 0644 );
+	if ( m_FileDescriptor < 0 ) return;
+
+	struct stat fileStat;
+	if ( fstat(m_FileDescriptor, &fileStat) != 0 ) return;
+
+	m_SizeInBytes = static_cast<uint64_t>( fileStat.st_size );
+
+	// the new space is sparse, it only takes up disk space once it's written
+	if ( sizeInBytes > m_SizeInBytes )
+	{
+		if ( ftruncate(m_FileDescriptor, static_cast<off_t>(sizeInBytes)) != 0 ) return;
+
+		m_SizeInBytes = sizeInBytes;
+	}
+
+	if ( m_SizeInBytes == 0 ) return;
+
+	void* mapping = mmap( nullptr, m_SizeInBytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_FileDescriptor, 0 );
+	if ( mapping == MAP_FAILED )
+	{
+		m_SizeInBytes = 0;
+
+		return;
+	}
+
+	m_Mapping = static_cast<uint8_t*>( mapping );
+}
+
+MappedFile::~MappedFile()
+{
+	// dirty pages are still written back by the kernel after the unmap, flush() is only needed to know when
+	if ( m_Mapping ) munmap( m_Mapping, m_SizeInBytes );
+	if ( m_FileDescriptor >= 0 ) close( m_FileDescriptor );
+}
+
+void MappedFile::writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes)
+{
+	this->writeToMedia64( data, offsetInBytes );
+}
+
+SharedData<uint8_t> MappedFile::readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes)
+{
+	return this->readFromMedia64( sizeInBytes, offsetInBytes );
+}
+
+void MappedFile::readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data)
+{
+	this->readFromMedia64( static_cast<uint64_t>(offsetInBytes), data );
+}
+
+void MappedFile::writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes)
+{
+	if ( ! m_Mapping || ! this->isInRange(offsetInBytes, data.getSizeInBytes()) ) return;
+
+	std::memcpy( m_Mapping + offsetInBytes, data.getPtr(), data.getSizeInBytes() );
+}
+
+SharedData<uint8_t> MappedFile::readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes)
+{
+	if ( ! m_Mapping || ! this->isInRange(offsetInBytes, sizeInBytes) ) return SharedData<uint8_t>::MakeSharedDataNull();
+
+	// a view into the mapping, the page cache is the only copy
+	return SharedData<uint8_t>::MakeSharedData( sizeInBytes, m_Mapping + offsetInBytes );
+}
+
+void MappedFile::readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data)
+{
+	if ( ! m_Mapping || ! this->isInRange(offsetInBytes, data.getSizeInBytes()) ) return;
+
+	std::memcpy( data.getPtr(), m_Mapping + offsetInBytes, data.getSizeInBytes() );
+}
+
+void MappedFile::discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes)
+{
+	this->discard64( static_cast<uint64_t>(offsetInBytes), static_cast<uint64_t>(sizeInBytes) );
+}
+
+void MappedFile::discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes)
+{
+	if ( ! m_Mapping || offsetInBytes >= m_SizeInBytes ) return;
+
+	// punching a hole frees the disk space, the range reads back as zeros through the mapping as well
+	fallocate( m_FileDescriptor, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offsetInBytes),
+			static_cast<off_t>(std::min(sizeInBytes, m_SizeInBytes - offsetInBytes)) );
+}
+
+IStorageMediaInfo MappedFile::getMediaInfo()
+{
+	// any offset works, but whole pages avoid faulting in a page only to overwrite part of it
+	return IStorageMediaInfo( m_SizeInBytes, m_PageSizeInBytes, 1, 1, 1, false );
+}
+
+bool MappedFile::flush (bool waitForCompletion)
+{
+	return this->flush( 0, m_SizeInBytes, waitForCompletion );
+}
+
+bool MappedFile::flush (const uint64_t offsetInBytes, const uint64_t sizeInBytes, bool waitForCompletion)
+{
+	if ( ! m_Mapping || ! this->isInRange(offsetInBytes, sizeInBytes) ) return false;
+
+	// msync needs a page aligned address
+	const uint64_t alignedOffset = offsetInBytes - ( offsetInBytes % m_PageSizeInBytes );
+
+	return msync( m_Mapping + alignedOffset, sizeInBytes + (offsetInBytes - alignedOffset), (waitForCompletion) ? MS_SYNC : MS_ASYNC ) == 0;
+}
+
+void MappedFile::setAccessPattern (const MAPPED_FILE_ACCESS& accessPattern)
+{
+	int advice = MADV_NORMAL;
+
+	switch ( accessPattern )
+	{
+		case MAPPED_FILE_ACCESS::SEQUENTIAL:
+			advice = MADV_SEQUENTIAL;
+
+			break;
+		case MAPPED_FILE_ACCESS::RANDOM:
+			advice = MADV_RANDOM;
+
+			break;
+		default:
+			break;
+	}
+
+	this->adviseRange( 0, m_SizeInBytes, advice );
+}
+
+void MappedFile::prefetch (const uint64_t offsetInBytes, const uint64_t sizeInBytes)
+{
+	this->adviseRange( offsetInBytes, sizeInBytes, MADV_WILLNEED );
+}
+
+bool MappedFile::adviseRange (const uint64_t offsetInBytes, const uint64_t sizeInBytes, int advice)
+{
+	if ( ! m_Mapping || ! this->isInRange(offsetInBytes, sizeInBytes) ) return false;
+
+	// like msync, madvise needs a page aligned address
+	const uint64_t alignedOffset = offsetInBytes - ( offsetInBytes % m_PageSizeInBytes );
+
+	return madvise( m_Mapping + alignedOffset, sizeInBytes + (offsetInBytes - alignedOffset), advice ) == 0;
+}
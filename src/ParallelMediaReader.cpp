@@ -0,0 +1,132 @@
+#include "ParallelMediaReader.hpp"
+
+#include <algorithm>
+
+// all of the chunk buffers are one SharedData, so their total can't go past what its size can hold
+#define MAX_CHUNK_BUFFERS_SIZE 0xFFFFFFFF
+
+ParallelMediaReader::ParallelMediaReader (IStorageMedia& media, unsigned int numThreads, unsigned int chunkSizeInBytes,
+						uint64_t memoryBudgetInBytes, IAllocator* allocator) :
+	m_Media( media ),
+	m_ChunkSizeInBytes( std::max<unsigned int>(chunkSizeInBytes, 1) ),
+	m_NumChunkBuffers( static_cast<unsigned int>(std::max<uint64_t>(
+				std::min<uint64_t>(memoryBudgetInBytes, MAX_CHUNK_BUFFERS_SIZE) / m_ChunkSizeInBytes, 1)) ),
+	m_ChunkBuffers( SharedData<uint8_t>::MakeSharedData(static_cast<unsigned int>(static_cast<uint64_t>(m_ChunkSizeInBytes) * m_NumChunkBuffers),
+				allocator) ),
+	m_ChunkBufferReady( m_NumChunkBuffers, false ),
+	m_Threads(),
+	m_Mutex(),
+	m_WorkAvailable(),
+	m_ChunkReady(),
+	m_ShuttingDown( false ),
+	m_OffsetInBytes( 0 ),
+	m_SizeInBytes( 0 ),
+	m_NumChunks( 0 ),
+	m_NextChunk( 0 ),
+	m_NumChunksConsumed( 0 ),
+	m_NumChunksBeingRead( 0 )
+{
+	if ( numThreads == 0 ) numThreads = std::max<unsigned int>( std::thread::hardware_concurrency(), 1 );
+
+	// more threads than buffers would only ever sit waiting
+	numThreads = std::min( numThreads, m_NumChunkBuffers );
+
+	for ( unsigned int threadNum = 0; threadNum < numThreads; threadNum++ )
+	{
+		m_Threads.emplace_back( &ParallelMediaReader::worker, this );
+	}
+}
+
+ParallelMediaReader::~ParallelMediaReader()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_Mutex );
+		m_ShuttingDown = true;
+	}
+
+	m_WorkAvailable.notify_all();
+
+	for ( std::thread& thread : m_Threads )
+	{
+		thread.join();
+	}
+}
+
+bool ParallelMediaReader::read (uint64_t offsetInBytes, uint64_t sizeInBytes, const ParallelMediaReaderConsumer& consumer)
+{
+	std::unique_lock<std::mutex> lock( m_Mutex );
+
+	m_OffsetInBytes = offsetInBytes;
+	m_SizeInBytes = sizeInBytes;
+	m_NumChunks = ( sizeInBytes + m_ChunkSizeInBytes - 1 ) / m_ChunkSizeInBytes;
+	m_NextChunk = 0;
+	m_NumChunksConsumed = 0;
+	std::fill( m_ChunkBufferReady.begin(), m_ChunkBufferReady.end(), false );
+
+	m_WorkAvailable.notify_all();
+
+	bool finished = true;
+	while ( m_NumChunksConsumed < m_NumChunks )
+	{
+		const unsigned int bufferNum = m_NumChunksConsumed % m_NumChunkBuffers;
+		m_ChunkReady.wait( lock, [this, bufferNum]() { return m_ChunkBufferReady[bufferNum]; } );
+
+		// the workers only touch other buffers while the consumer has this one
+		lock.unlock();
+		const bool keepGoing = consumer( m_OffsetInBytes + m_NumChunksConsumed * m_ChunkSizeInBytes, this->getChunk(m_NumChunksConsumed) );
+		lock.lock();
+
+		m_ChunkBufferReady[bufferNum] = false;
+		m_NumChunksConsumed++;
+
+		if ( ! keepGoing )
+		{
+			finished = false;
+
+			break;
+		}
+
+		m_WorkAvailable.notify_one();
+	}
+
+	// no new chunks get picked up, but the buffers can't be reused until the ones being read are done
+	m_NumChunks = 0;
+	m_ChunkReady.wait( lock, [this]() { return m_NumChunksBeingRead == 0; } );
+
+	return finished;
+}
+
+void ParallelMediaReader::worker()
+{
+	std::unique_lock<std::mutex> lock( m_Mutex );
+
+	while ( true )
+	{
+		// a chunk can only be read once the consumer is done with the chunk that last used its buffer
+		m_WorkAvailable.wait( lock, [this]() {
+				return m_ShuttingDown || ( m_NextChunk < m_NumChunks && m_NextChunk < m_NumChunksConsumed + m_NumChunkBuffers ); } );
+
+		if ( m_ShuttingDown ) return;
+
+		const uint64_t chunkNum = m_NextChunk++;
+		m_NumChunksBeingRead++;
+
+		lock.unlock();
+		m_Media.readFromMedia64( m_OffsetInBytes + chunkNum * m_ChunkSizeInBytes, this->getChunk(chunkNum) );
+		lock.lock();
+
+		m_ChunkBufferReady[chunkNum % m_NumChunkBuffers] = true;
+		m_NumChunksBeingRead--;
+
+		m_ChunkReady.notify_all();
+	}
+}
+
+SharedData<uint8_t> ParallelMediaReader::getChunk (uint64_t chunkNum)
+{
+	const unsigned int bufferNum = chunkNum % m_NumChunkBuffers;
+	const unsigned int sizeInBytes = static_cast<unsigned int>( std::min<uint64_t>(m_ChunkSizeInBytes, m_SizeInBytes - chunkNum * m_ChunkSizeInBytes) );
+
+	// a view, so worker threads never touch the allocation counts
+	return SharedData<uint8_t>::MakeSharedData( sizeInBytes, m_ChunkBuffers.getPtr(bufferNum * m_ChunkSizeInBytes) );
+}
@@ -0,0 +1,82 @@
+#include "PartitionStorageMedia.hpp"
+
+#include <algorithm>
+
+PartitionStorageMedia::PartitionStorageMedia (IStorageMedia& parent, uint64_t offsetInBytes, uint64_t sizeInBytes) :
+	m_Parent( parent ),
+	m_OffsetInBytes( offsetInBytes ),
+	m_SizeInBytes( sizeInBytes )
+{
+}
+
+PartitionStorageMedia::PartitionStorageMedia (IStorageMedia& parent, const PartitionInfo& partition) :
+	PartitionStorageMedia( parent, partition.m_OffsetInBytes, partition.m_SizeInBytes )
+{
+}
+
+PartitionStorageMedia::~PartitionStorageMedia()
+{
+}
+
+void PartitionStorageMedia::writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes)
+{
+	this->writeToMedia64( data, offsetInBytes );
+}
+
+SharedData<uint8_t> PartitionStorageMedia::readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes)
+{
+	return this->readFromMedia64( sizeInBytes, offsetInBytes );
+}
+
+void PartitionStorageMedia::readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data)
+{
+	this->readFromMedia64( static_cast<uint64_t>(offsetInBytes), data );
+}
+
+void PartitionStorageMedia::writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes)
+{
+	if ( ! this->isInRange(offsetInBytes, data.getSizeInBytes()) ) return;
+
+	m_Parent.writeToMedia64( data, m_OffsetInBytes + offsetInBytes );
+}
+
+SharedData<uint8_t> PartitionStorageMedia::readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes)
+{
+	if ( ! this->isInRange(offsetInBytes, sizeInBytes) ) return SharedData<uint8_t>::MakeSharedDataNull();
+
+	return m_Parent.readFromMedia64( sizeInBytes, m_OffsetInBytes + offsetInBytes );
+}
+
+void PartitionStorageMedia::readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data)
+{
+	if ( ! this->isInRange(offsetInBytes, data.getSizeInBytes()) ) return;
+
+	m_Parent.readFromMedia64( m_OffsetInBytes + offsetInBytes, data );
+}
+
+void PartitionStorageMedia::discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes)
+{
+	this->discard64( static_cast<uint64_t>(offsetInBytes), static_cast<uint64_t>(sizeInBytes) );
+}
+
+void PartitionStorageMedia::discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes)
+{
+	if ( offsetInBytes >= m_SizeInBytes ) return;
+
+	// never let a discard reach past the end of the partition into the next one
+	m_Parent.discard64( m_OffsetInBytes + offsetInBytes, std::min(sizeInBytes, m_SizeInBytes - offsetInBytes) );
+}
+
+IStorageMediaInfo PartitionStorageMedia::getMediaInfo()
+{
+	IStorageMediaInfo info = m_Parent.getMediaInfo();
+	info.m_CapacityInBytes = m_SizeInBytes;
+
+	// a partition that doesn't start on an alignment boundary makes every access unaligned on the parent
+	while ( info.m_AlignmentInBytes > 1 && m_OffsetInBytes % info.m_AlignmentInBytes != 0 )
+	{
+		info.m_AlignmentInBytes /= 2;
+	}
+
+	return info;
+}
@@ -0,0 +1,238 @@
+#include "PartitionTable.hpp"
+
+#include "Checksum.hpp"
+
+#include <algorithm>
+
+#define MBR_PARTITION_TABLE_OFFSET 0x1BE
+#define MBR_PARTITION_ENTRY_SIZE 16
+#define MBR_NUM_PRIMARY_PARTITIONS 4
+#define MBR_SIGNATURE_OFFSET 0x1FE
+// guards against a corrupt extended partition chain that loops back on itself
+#define MBR_MAX_LOGICAL_PARTITIONS 128
+
+#define GPT_HEADER_LBA 1
+#define GPT_HEADER_MIN_SIZE 92
+#define GPT_MIN_ENTRY_SIZE 128
+#define GPT_MAX_ENTRY_SIZE 4096
+#define GPT_MAX_NUM_ENTRIES 1024
+#define GPT_NAME_OFFSET 56
+#define GPT_NAME_LENGTH 36
+
+static uint32_t readUInt32 (const uint8_t* src)
+{
+	return static_cast<uint32_t>( src[0] ) | ( static_cast<uint32_t>(src[1]) << 8 )
+		| ( static_cast<uint32_t>(src[2]) << 16 ) | ( static_cast<uint32_t>(src[3]) << 24 );
+}
+
+static uint64_t readUInt64 (const uint8_t* src)
+{
+	return static_cast<uint64_t>( readUInt32(src) ) | ( static_cast<uint64_t>(readUInt32(src + 4)) << 32 );
+}
+
+PartitionTable::PartitionTable (IStorageMedia& media, unsigned int sectorSizeInBytes) :
+	m_Media( media ),
+	m_SectorSizeInBytes( (sectorSizeInBytes >= 512) ? sectorSizeInBytes : 512 ),
+	m_Type( PARTITION_TABLE_TYPE::NONE ),
+	m_Partitions()
+{
+}
+
+PartitionTable::~PartitionTable()
+{
+}
+
+bool PartitionTable::read()
+{
+	m_Type = PARTITION_TABLE_TYPE::NONE;
+	m_Partitions.clear();
+
+	return this->readMbr();
+}
+
+SharedData<uint8_t> PartitionTable::readSector (uint64_t lba)
+{
+	return m_Media.readFromMedia64( m_SectorSizeInBytes, lba * m_SectorSizeInBytes );
+}
+
+bool PartitionTable::readMbr()
+{
+	SharedData<uint8_t> mbr = this->readSector( 0 );
+	if ( mbr.getSizeInBytes() != m_SectorSizeInBytes ) return false;
+
+	const uint8_t* mbrPtr = mbr.getPtr();
+	if ( mbrPtr[MBR_SIGNATURE_OFFSET] != 0x55 || mbrPtr[MBR_SIGNATURE_OFFSET + 1] != 0xAA ) return false;
+
+	// a fat boot sector also ends in 0x55AA, but its partition table area holds boot code, so reject entries with a bad status byte
+	for ( unsigned int entryNum = 0; entryNum < MBR_NUM_PRIMARY_PARTITIONS; entryNum++ )
+	{
+		const uint8_t status = mbrPtr[MBR_PARTITION_TABLE_OFFSET + entryNum * MBR_PARTITION_ENTRY_SIZE];
+		if ( status != 0x00 && status != 0x80 ) return false;
+	}
+
+	for ( unsigned int entryNum = 0; entryNum < MBR_NUM_PRIMARY_PARTITIONS; entryNum++ )
+	{
+		if ( mbrPtr[MBR_PARTITION_TABLE_OFFSET + entryNum * MBR_PARTITION_ENTRY_SIZE + 4] == MBR_PARTITION_TYPE_GPT_PROTECTIVE )
+		{
+			return this->readGpt();
+		}
+	}
+
+	for ( unsigned int entryNum = 0; entryNum < MBR_NUM_PRIMARY_PARTITIONS; entryNum++ )
+	{
+		const uint8_t* entryPtr = mbrPtr + MBR_PARTITION_TABLE_OFFSET + entryNum * MBR_PARTITION_ENTRY_SIZE;
+		const uint8_t type = entryPtr[4];
+		const uint64_t startLba = readUInt32( entryPtr + 8 );
+		const uint64_t numSectors = readUInt32( entryPtr + 12 );
+
+		if ( type == MBR_PARTITION_TYPE_EMPTY || numSectors == 0 ) continue;
+
+		if ( PartitionTable::isExtendedType(type) )
+		{
+			this->readExtendedPartition( startLba, numSectors );
+		}
+		else
+		{
+			PartitionInfo partition;
+			partition.m_OffsetInBytes = startLba * m_SectorSizeInBytes;
+			partition.m_SizeInBytes = numSectors * m_SectorSizeInBytes;
+			partition.m_MbrType = type;
+
+			m_Partitions.push_back( partition );
+		}
+	}
+
+	// logical partitions were added as their extended partition was found, keep the list in disk order
+	std::stable_sort( m_Partitions.begin(), m_Partitions.end(),
+			[](const PartitionInfo& first, const PartitionInfo& second) { return first.m_OffsetInBytes < second.m_OffsetInBytes; } );
+
+	m_Type = PARTITION_TABLE_TYPE::MBR;
+
+	return true;
+}
+
+void PartitionTable::readExtendedPartition (uint64_t extendedStartLba, uint64_t extendedNumSectors)
+{
+	// each extended boot record holds one logical partition (relative to the ebr) and a link to the next ebr (relative to the extended partition)
+	uint64_t ebrLba = extendedStartLba;
+
+	for ( unsigned int logicalNum = 0; logicalNum < MBR_MAX_LOGICAL_PARTITIONS; logicalNum++ )
+	{
+		SharedData<uint8_t> ebr = this->readSector( ebrLba );
+		if ( ebr.getSizeInBytes() != m_SectorSizeInBytes ) return;
+
+		const uint8_t* ebrPtr = ebr.getPtr();
+		if ( ebrPtr[MBR_SIGNATURE_OFFSET] != 0x55 || ebrPtr[MBR_SIGNATURE_OFFSET + 1] != 0xAA ) return;
+
+		const uint8_t* logicalPtr = ebrPtr + MBR_PARTITION_TABLE_OFFSET;
+		const uint8_t logicalType = logicalPtr[4];
+		const uint64_t logicalStartLba = ebrLba + readUInt32( logicalPtr + 8 );
+		const uint64_t logicalNumSectors = readUInt32( logicalPtr + 12 );
+
+		if ( logicalType != MBR_PARTITION_TYPE_EMPTY && logicalNumSectors != 0
+				&& logicalStartLba + logicalNumSectors <= extendedStartLba + extendedNumSectors )
+		{
+			PartitionInfo partition;
+			partition.m_OffsetInBytes = logicalStartLba * m_SectorSizeInBytes;
+			partition.m_SizeInBytes = logicalNumSectors * m_SectorSizeInBytes;
+			partition.m_MbrType = logicalType;
+			partition.m_IsLogical = true;
+
+			m_Partitions.push_back( partition );
+		}
+
+		const uint8_t* nextPtr = ebrPtr + MBR_PARTITION_TABLE_OFFSET + MBR_PARTITION_ENTRY_SIZE;
+		const uint64_t nextEbrOffset = readUInt32( nextPtr + 8 );
+
+		// the chain must stay inside the extended partition and always move forward
+		if ( ! PartitionTable::isExtendedType(nextPtr[4]) || nextEbrOffset == 0 || nextEbrOffset >= extendedNumSectors
+				|| extendedStartLba + nextEbrOffset <= ebrLba )
+		{
+			return;
+		}
+
+		ebrLba = extendedStartLba + nextEbrOffset;
+	}
+}
+
+bool PartitionTable::readGpt()
+{
+	uint64_t entriesLba = 0;
+	uint32_t numEntries = 0;
+	uint32_t entrySize = 0;
+	uint32_t entriesCrc = 0;
+
+	// fall back to the backup header at the end of the media if the primary one is damaged
+	const uint64_t capacity = m_Media.getMediaInfo().m_CapacityInBytes;
+	const bool haveHeader = this->readGptHeader( GPT_HEADER_LBA, entriesLba, numEntries, entrySize, entriesCrc )
+				|| ( capacity >= m_SectorSizeInBytes * 2
+					&& this->readGptHeader(capacity / m_SectorSizeInBytes - 1, entriesLba, numEntries, entrySize, entriesCrc) );
+	if ( ! haveHeader ) return false;
+
+	const uint64_t entriesSize = static_cast<uint64_t>( numEntries ) * entrySize;
+	SharedData<uint8_t> entries = m_Media.readFromMedia64( entriesSize, entriesLba * m_SectorSizeInBytes );
+	if ( entries.getSizeInBytes() != entriesSize || Checksum::Crc32(entries.getPtr(), entriesSize) != entriesCrc ) return false;
+
+	for ( uint32_t entryNum = 0; entryNum < numEntries; entryNum++ )
+	{
+		const uint8_t* entryPtr = entries.getPtr( entryNum * entrySize );
+
+		// an all zero type guid marks an unused entry
+		if ( std::all_of(entryPtr, entryPtr + 16, [](uint8_t byte) { return byte == 0; }) ) continue;
+
+		const uint64_t firstLba = readUInt64( entryPtr + 32 );
+		const uint64_t lastLba = readUInt64( entryPtr + 40 ); // inclusive
+		if ( lastLba < firstLba ) continue;
+
+		PartitionInfo partition;
+		partition.m_OffsetInBytes = firstLba * m_SectorSizeInBytes;
+		partition.m_SizeInBytes = ( lastLba - firstLba + 1 ) * m_SectorSizeInBytes;
+		std::copy( entryPtr, entryPtr + 16, partition.m_GptTypeGuid );
+
+		// names are utf-16, anything outside of ascii is replaced
+		for ( unsigned int character = 0; character < GPT_NAME_LENGTH; character++ )
+		{
+			const uint16_t nameChar = entryPtr[GPT_NAME_OFFSET + character * 2] | ( entryPtr[GPT_NAME_OFFSET + character * 2 + 1] << 8 );
+			if ( nameChar == 0 ) break;
+
+			partition.m_Name += ( nameChar < 0x80 ) ? static_cast<char>( nameChar ) : '?';
+		}
+
+		m_Partitions.push_back( partition );
+	}
+
+	m_Type = PARTITION_TABLE_TYPE::GPT;
+
+	return true;
+}
+
+bool PartitionTable::readGptHeader (uint64_t lba, uint64_t& entriesLba, uint32_t& numEntries, uint32_t& entrySize, uint32_t& entriesCrc)
+{
+	SharedData<uint8_t> header = this->readSector( lba );
+	if ( header.getSizeInBytes() != m_SectorSizeInBytes ) return false;
+
+	uint8_t* headerPtr = header.getPtr();
+	static const uint8_t signature[8] = { 'E', 'F', 'I', ' ', 'P', 'A', 'R', 'T' };
+	if ( ! std::equal(signature, signature + 8, headerPtr) ) return false;
+
+	const uint32_t headerSize = readUInt32( headerPtr + 12 );
+	if ( headerSize < GPT_HEADER_MIN_SIZE || headerSize > m_SectorSizeInBytes ) return false;
+
+	// the header crc is calculated with the crc field itself zeroed
+	const uint32_t headerCrc = readUInt32( headerPtr + 16 );
+	std::fill( headerPtr + 16, headerPtr + 20, 0 );
+	if ( Checksum::Crc32(headerPtr, headerSize) != headerCrc ) return false;
+
+	entriesLba = readUInt64( headerPtr + 72 );
+	numEntries = readUInt32( headerPtr + 80 );
+	entrySize = readUInt32( headerPtr + 84 );
+	entriesCrc = readUInt32( headerPtr + 88 );
+
+	return entrySize >= GPT_MIN_ENTRY_SIZE && entrySize <= GPT_MAX_ENTRY_SIZE && entrySize % 8 == 0 && numEntries > 0 && numEntries <= GPT_MAX_NUM_ENTRIES;
+}
+
+bool PartitionTable::isExtendedType (uint8_t mbrType)
+{
+	return mbrType == MBR_PARTITION_TYPE_EXTENDED_CHS || mbrType == MBR_PARTITION_TYPE_EXTENDED_LBA
+		|| mbrType == MBR_PARTITION_TYPE_EXTENDED_LINUX;
+}
@@ -1,8 +1,15 @@
 #include "SDCard.hpp"
 
+#include "Checksum.hpp"
+
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 
 #define VALID_R1_RESPONSE 0x00
+#define DATA_ACCEPTED_RESPONSE 0x05
+// how many times a block is transferred again after a crc error before giving up
+#define CRC_ERROR_RETRIES 3
 
 SDCard::SDCard (const SPI_NUM& spiNum, const GPIO_PORT& csPort, const GPIO_PIN& csPin) :
 	m_SpiNum( spiNum ),
@@ -10,7 +17,10 @@ SDCard::SDCard (const SPI_NUM& spiNum, const GPIO_PORT& csPort, const GPIO_PIN&
 	m_CSPin( csPin ),
 	m_BlockSize( 512 ),
 	m_UsingBlockAddressing( false ),
-	m_ByteAddressingMultiplier( 1 )
+	m_ByteAddressingMultiplier( 1 ),
+	m_CapacityInBytes( 0 ),
+	m_EraseSizeInBytes( 512 ),
+	m_NumCrcErrors( 0 )
 {
 }
 
@@ -19,132 +29,128 @@ SDCard::~SDCard()
 }
 
 void SDCard::writeToMedia (const SharedData<uint8_t>& data, const unsigned int address)
+{
+	this->writeToMedia64( data, address );
+}
+
+SharedData<uint8_t> SDCard::readFromMedia (const unsigned int sizeInBytes, const unsigned int address)
+{
+	return this->readFromMedia64( sizeInBytes, address );
+}
+
+void SDCard::readFromMedia (const unsigned int address, const SharedData<uint8_t>& data)
+{
+	this->readFromMedia64( static_cast<uint64_t>(address), data );
+}
+
+void SDCard::writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t address)
 {
 	unsigned int dataSize = data.getSizeInBytes();
 
-	unsigned int startBlock = address / m_BlockSize;
-	unsigned int endBlock = ( address + dataSize - 1 ) / m_BlockSize;
+	if ( dataSize == 0 || ! this->isInRange(address, dataSize) ) return;
 
-	// no need to read a block if we're writing an entire single block, note: this only speeds things up for writing single blocks
-	if ( (dataSize % m_BlockSize == 0) && (startBlock == endBlock) )
+	unsigned int block = address / m_BlockSize;
+	unsigned int bytesToSkip = address % m_BlockSize;
+	uint8_t* dataToWrite = data.getPtr();
+	unsigned int bytesLeft = dataSize;
+
+	// a partial first block has to be read so the rest of it is kept
+	if ( bytesToSkip != 0 || bytesLeft < m_BlockSize )
 	{
-		this->writeSingleBlock( data, startBlock );
+		SharedData<uint8_t> blockToWrite = this->readSingleBlock( block );
 
-		return;
+		// never write back a block we couldn't read
+		if ( blockToWrite.getSize() != m_BlockSize ) return;
+
+		const unsigned int bytesToCopy = std::min( m_BlockSize - bytesToSkip, bytesLeft );
+		std::memcpy( blockToWrite.getPtr(bytesToSkip), dataToWrite, bytesToCopy );
+
+		if ( ! this->writeSingleBlock(blockToWrite, block) ) return;
+
+		dataToWrite += bytesToCopy;
+		bytesLeft -= bytesToCopy;
+		block++;
 	}
 
-	// get the number of bytes we'll need to keep from the beginning of the first block
-	unsigned int bytesToSkip = address % m_BlockSize;
+	// whole blocks are entirely overwritten, so they go straight from the callers buffer without being read, a run of them with a
+	// single command that carries on from the rejected block if one is rejected
+	unsigned int numWholeBlocks = bytesLeft / m_BlockSize;
+	unsigned int attempt = 0;
+	while ( numWholeBlocks > 1 )
+	{
+		unsigned int numBlocksWritten = 0;
+		const SharedData<uint8_t> wholeBlocks = SharedData<uint8_t>::MakeSharedData( numWholeBlocks * m_BlockSize, dataToWrite );
+		const bool written = this->writeMultipleBlocks( wholeBlocks, block, &numBlocksWritten );
 
-	unsigned int bytesSkipped = 0;
-	unsigned int bytesWritten = 0;
+		dataToWrite += numBlocksWritten * m_BlockSize;
+		bytesLeft -= numBlocksWritten * m_BlockSize;
+		block += numBlocksWritten;
+		numWholeBlocks -= numBlocksWritten;
 
-	for ( unsigned int block = startBlock; block <= endBlock; block++ )
+		if ( written ) break;
+
+		if ( numBlocksWritten > 0 ) attempt = 0;
+		if ( ++attempt > CRC_ERROR_RETRIES ) return;
+	}
+
+	// a single block doesn't need the multiple block overhead
+	if ( numWholeBlocks == 1 )
+	{
+		if ( ! this->writeSingleBlock(SharedData<uint8_t>::MakeSharedData(m_BlockSize, dataToWrite), block) ) return;
+
+		dataToWrite += m_BlockSize;
+		bytesLeft -= m_BlockSize;
+		block++;
+	}
+
+	// and so does a partial last block
+	if ( bytesLeft > 0 )
 	{
-		// get the original block from the sd card
 		SharedData<uint8_t> blockToWrite = this->readSingleBlock( block );
 
-		// make modifications to the original block
-		for ( unsigned int byte = 0; byte < m_BlockSize; byte++ )
-		{
-			if ( bytesWritten == dataSize )
-			{
-				break;
-			}
-			else if ( bytesSkipped == bytesToSkip )
-			{
-				blockToWrite[byte] = data[bytesWritten];
-				bytesWritten++;
-			}
-			else
-			{
-				bytesSkipped++;
-			}
-		}
+		if ( blockToWrite.getSize() != m_BlockSize ) return;
+
+		std::memcpy( blockToWrite.getPtr(), dataToWrite, bytesLeft );
 
 		this->writeSingleBlock( blockToWrite, block );
 	}
 }
 
-SharedData<uint8_t> SDCard::readFromMedia (const unsigned int sizeInBytes, const unsigned int address)
+SharedData<uint8_t> SDCard::readFromMedia64 (const unsigned int sizeInBytes, const uint64_t address)
 {
-	SharedData<uint8_t> dataToRead = SharedData<uint8_t>::MakeSharedData( sizeInBytes );
+	if ( sizeInBytes == 0 || ! this->isInRange(address, sizeInBytes) ) return SharedData<uint8_t>::MakeSharedDataNull();
 
-	unsigned int startBlock = address / m_BlockSize;
-	unsigned int endBlock = ( address + sizeInBytes - 1 ) / m_BlockSize;
-
-	// get the number of bytes we'll need to skip from the beginning of the first block
-	unsigned int bytesToSkip = address % m_BlockSize;
-
-	unsigned int bytesSkipped = 0;
-	unsigned int bytesRead = 0;
-
-	for ( unsigned int block = startBlock; block <= endBlock; block++ )
-	{
-		SharedData<uint8_t> blockData = this->readSingleBlock( block );
+	SharedData<uint8_t> dataToRead = SharedData<uint8_t>::MakeSharedData( sizeInBytes );
 
-		// make modifications to the original block
-		for ( unsigned int byte = 0; byte < m_BlockSize; byte++ )
-		{
-			if ( bytesRead == sizeInBytes )
-			{
-				// we've finished reading
-				break;
-			}
-			else if ( bytesSkipped == bytesToSkip )
-			{
-				dataToRead[bytesRead] = blockData[byte];
-				bytesRead++;
-			}
-			else
-			{
-				// these bytes aren't of interest to us
-				bytesSkipped++;
-			}
-		}
-	}
+	if ( ! this->readRange(address, dataToRead.getPtr(), sizeInBytes) ) return SharedData<uint8_t>::MakeSharedDataNull();
 
 	return dataToRead;
 }
 
-void SDCard::readFromMedia (const unsigned int address, const SharedData<uint8_t>& data)
+void SDCard::readFromMedia64 (const uint64_t address, const SharedData<uint8_t>& data)
 {
-	uint8_t* dataToReadPtr = data.getPtr();
-	unsigned int sizeInBytes = data.getSizeInBytes();
+	if ( data.getSizeInBytes() == 0 || ! this->isInRange(address, data.getSizeInBytes()) ) return;
 
-	unsigned int startBlock = address / m_BlockSize;
-	unsigned int endBlock = ( address + sizeInBytes - 1 ) / m_BlockSize;
+	this->readRange( address, data.getPtr(), data.getSizeInBytes() );
+}
 
-	// get the number of bytes we'll need to skip from the beginning of the first block
-	unsigned int bytesToSkip = address % m_BlockSize;
+void SDCard::discard (const unsigned int address, const unsigned int sizeInBytes)
+{
+	this->discard64( static_cast<uint64_t>(address), static_cast<uint64_t>(sizeInBytes) );
+}
 
-	unsigned int bytesSkipped = 0;
-	unsigned int bytesRead = 0;
+void SDCard::discard64 (const uint64_t address, const uint64_t sizeInBytes)
+{
+	// the card can only erase whole blocks
+	uint64_t endAddress = address + sizeInBytes;
+	if ( m_CapacityInBytes != 0 && endAddress > m_CapacityInBytes ) endAddress = m_CapacityInBytes;
 
-	for ( unsigned int block = startBlock; block <= endBlock; block++ )
-	{
-		SharedData<uint8_t> blockData = this->readSingleBlock( block );
+	const uint64_t startBlock = ( address + m_BlockSize - 1 ) / m_BlockSize;
+	const uint64_t endBlock = endAddress / m_BlockSize; // one past the last block
 
-		// make modifications to the original block
-		for ( unsigned int byte = 0; byte < m_BlockSize; byte++ )
-		{
-			if ( bytesRead == sizeInBytes )
-			{
-				// we've finished reading
-				break;
-			}
-			else if ( bytesSkipped == bytesToSkip )
-			{
-				dataToReadPtr[bytesRead] = blockData[byte];
-				bytesRead++;
-			}
-			else
-			{
-				// these bytes aren't of interest to us
-				bytesSkipped++;
-			}
-		}
-	}
+	if ( startBlock >= endBlock || endBlock - 1 > 0xFFFFFFFF ) return;
+
+	this->eraseBlocks( startBlock, endBlock - 1 );
 }
 
 void SDCard::setBlockSize (const unsigned int blockSize)
@@ -172,6 +178,76 @@ unsigned int SDCard::getBlockSize()
 	return m_BlockSize;
 }
 
+bool SDCard::isInRange (const uint64_t address, const unsigned int sizeInBytes)
+{
+	// capacity is unknown until initialize has read the csd
+	if ( m_CapacityInBytes == 0 ) return true;
+
+	return ( address + sizeInBytes ) <= m_CapacityInBytes;
+}
+
+bool SDCard::readRange (const uint64_t address, uint8_t* data, const unsigned int sizeInBytes)
+{
+	unsigned int block = address / m_BlockSize;
+	unsigned int bytesToSkip = address % m_BlockSize;
+	unsigned int bytesLeft = sizeInBytes;
+
+	// a partial first block has to go through a block buffer
+	if ( bytesToSkip != 0 || bytesLeft < m_BlockSize )
+	{
+		SharedData<uint8_t> blockData = this->readSingleBlock( block );
+		if ( blockData.getSize() != m_BlockSize ) return false;
+
+		const unsigned int bytesToCopy = std::min( m_BlockSize - bytesToSkip, bytesLeft );
+		std::memcpy( data, blockData.getPtr(bytesToSkip), bytesToCopy );
+
+		data += bytesToCopy;
+		bytesLeft -= bytesToCopy;
+		block++;
+	}
+
+	// whole blocks go straight into the callers buffer, a run of them with a single command
+	const unsigned int numWholeBlocks = bytesLeft / m_BlockSize;
+	if ( numWholeBlocks > 1 )
+	{
+		if ( ! this->readMultipleBlocks(SharedData<uint8_t>::MakeSharedData(numWholeBlocks * m_BlockSize, data), block) ) return false;
+	}
+	else if ( numWholeBlocks == 1 )
+	{
+		SharedData<uint8_t> blockData = this->readSingleBlock( block );
+		if ( blockData.getSize() != m_BlockSize ) return false;
+
+		std::memcpy( data, blockData.getPtr(), m_BlockSize );
+	}
+
+	data += numWholeBlocks * m_BlockSize;
+	bytesLeft -= numWholeBlocks * m_BlockSize;
+	block += numWholeBlocks;
+
+	// and so does a partial last block
+	if ( bytesLeft > 0 )
+	{
+		SharedData<uint8_t> blockData = this->readSingleBlock( block );
+		if ( blockData.getSize() != m_BlockSize ) return false;
+
+		std::memcpy( data, blockData.getPtr(), bytesLeft );
+	}
+
+	return true;
+}
+
+bool SDCard::getCommandAddress (const unsigned int blockNum, uint32_t& address)
+{
+	// if byte addressing, we need to multiply by the block size, done in 64 bits so we can catch addresses that would wrap
+	const uint64_t fullAddress = static_cast<uint64_t>( blockNum ) * m_ByteAddressingMultiplier;
+
+	if ( fullAddress > 0xFFFFFFFF ) return false;
+
+	address = static_cast<uint32_t>( fullAddress );
+
+	return true;
+}
+
 void SDCard::initialize()
 {
 	LLPD::gpio_output_set( m_CSPort, m_CSPin, true );
@@ -193,11 +269,11 @@ void SDCard::initialize()
 	R1CommandResult result;
 
 	// send software reset command (CMD0)
-	resultByte = this->sendCommand( 0, 0, 0, 0, 0, 0x94 );
+	resultByte = this->sendCommand( 0, 0, 0, 0, 0 );
 	result = this->interpretR1CommandResultByte( resultByte );
 	while ( result.IllegalCommand || ! result.IsInIdleState )
 	{
-		resultByte = this->sendCommand( 0, 0, 0, 0, 0, 0x94 );
+		resultByte = this->sendCommand( 0, 0, 0, 0, 0 );
 		result = this->interpretR1CommandResultByte( resultByte );
 		LLPD::tim6_delay( 10000 );
 	}
@@ -213,12 +289,12 @@ void SDCard::initialize()
 	{
 		// ensure the card is out of the idle state (ACMD41)
 		unsigned int attempts = 100;
-		resultByte = this->sendCommand( 55, 0, 0, 0, 0, 0x65 );
-		resultByte = this->sendCommand( 41, 0x40, 0, 0, 0, 0x77 );
+		resultByte = this->sendCommand( 55, 0, 0, 0, 0 );
+		resultByte = this->sendCommand( 41, 0x40, 0, 0, 0 );
 		while ( resultByte != VALID_R1_RESPONSE && attempts > 0 )
 		{
-			resultByte = this->sendCommand( 55, 0, 0, 0, 0, 0x65 );
-			resultByte = this->sendCommand( 41, 0x40, 0, 0, 0, 0x77 );
+			resultByte = this->sendCommand( 55, 0, 0, 0, 0 );
+			resultByte = this->sendCommand( 41, 0x40, 0, 0, 0 );
 			attempts--;
 			LLPD::tim6_delay( 10000 );
 		}
@@ -227,10 +303,10 @@ void SDCard::initialize()
 		if ( attempts == 0 )
 		{
 			// ensure the card is out of the idle state (CMD1)
-			resultByte = this->sendCommand( 1, 0, 0, 0, 0, 0xF9 );
+			resultByte = this->sendCommand( 1, 0, 0, 0, 0 );
 			while ( resultByte != VALID_R1_RESPONSE )
 			{
-				resultByte = this->sendCommand( 1, 0, 0, 0, 0, 0xF9 );
+				resultByte = this->sendCommand( 1, 0, 0, 0, 0 );
 				LLPD::tim6_delay( 10000 );
 			}
 		}
@@ -238,10 +314,10 @@ void SDCard::initialize()
 	else
 	{
 		// ensure the card is out of the idle state (CMD1)
-		resultByte = this->sendCommand( 1, 0, 0, 0, 0, 0xF9 );
+		resultByte = this->sendCommand( 1, 0, 0, 0, 0 );
 		while ( resultByte != VALID_R1_RESPONSE )
 		{
-			resultByte = this->sendCommand( 1, 0, 0, 0, 0, 0xF9 );
+			resultByte = this->sendCommand( 1, 0, 0, 0, 0 );
 			LLPD::tim6_delay( 10000 );
 		}
 	}
@@ -250,29 +326,47 @@ void SDCard::initialize()
 	SharedData<uint8_t> ocr = this->readOCR();
 	m_UsingBlockAddressing = ocr[0] & 0b01000000;
 
+	// turn on crc checking (CMD59), from here on commands and data blocks are checked in both directions
+	resultByte = this->sendCommand( 59, 0x01, 0, 0, 0 );
+	while ( resultByte != VALID_R1_RESPONSE )
+	{
+		resultByte = this->sendCommand( 59, 0x01, 0, 0, 0 );
+		LLPD::tim6_delay( 10000 );
+	}
+
 	// set initial block size to 512
 	this->setBlockSize( 512 );
+
+	// CMD9 so that upper layers can query the geometry of the card
+	this->readCapacityAndEraseSize();
+}
+
+IStorageMediaInfo SDCard::getMediaInfo()
+{
+	// any write smaller than a block requires a read-modify-write
+	return IStorageMediaInfo( m_CapacityInBytes, m_BlockSize, m_BlockSize, m_BlockSize, m_EraseSizeInBytes, false );
 }
 
-uint8_t SDCard::sendCommand (uint8_t commandNum, uint8_t arg1, uint8_t arg2, uint8_t arg3, uint8_t arg4, uint8_t crc, bool leaveCSLow)
+uint8_t SDCard::sendCommand (uint8_t commandNum, uint8_t arg1, uint8_t arg2, uint8_t arg3, uint8_t arg4, bool leaveCSLow)
 {
+	const uint8_t command[5] = { static_cast<uint8_t>(commandNum | 0x40), arg4, arg3, arg2, arg1 };
+
 	// pull cs low
 	LLPD::gpio_output_set( m_CSPort, m_CSPin, false );
 
 	// dummy byte
 	LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
 
-	LLPD::spi_master_send_and_recieve( m_SpiNum, (commandNum | 0x40) );
-
-	LLPD::spi_master_send_and_recieve( m_SpiNum, arg4 );
-
-	LLPD::spi_master_send_and_recieve( m_SpiNum, arg3 );
-
-	LLPD::spi_master_send_and_recieve( m_SpiNum, arg2 );
+	for ( unsigned int byte = 0; byte < sizeof(command); byte++ )
+	{
+		LLPD::spi_master_send_and_recieve( m_SpiNum, command[byte] );
+	}
 
-	LLPD::spi_master_send_and_recieve( m_SpiNum, arg1 );
+	// the card checks this once crc checking is turned on in initialize
+	LLPD::spi_master_send_and_recieve( m_SpiNum, Checksum::Crc7(command, sizeof(command)) );
 
-	LLPD::spi_master_send_and_recieve( m_SpiNum, (crc | 0x01) ); // TODO CRC byte, should we do something with this?
+	// stop transmission (CMD12) is followed by a stuff byte that could look like a response
+	if ( commandNum == 12 ) LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
 
 	// keep recieving bytes until the response flag is set
 	uint8_t response = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
@@ -416,7 +510,8 @@ SDCard::R1CommandResult SDCard::interpretR1CommandResultByte (uint8_t commandRes
 bool SDCard::writeSingleBlock (const SharedData<uint8_t>& data, const unsigned int blockNum)
 {
 	// if byte addressing, we need to multiply by the block size
-	const unsigned int address = blockNum * m_ByteAddressingMultiplier;
+	uint32_t address = 0;
+	if ( ! this->getCommandAddress(blockNum, address) ) return false;
 
 	// unsure the data is block sized
 	if ( data.getSize() != m_BlockSize ) return false;
@@ -427,53 +522,69 @@ bool SDCard::writeSingleBlock (const SharedData<uint8_t>& data, const unsigned i
 	uint8_t baByte3 = ( address & 0xFF0000   ) >> 16;
 	uint8_t baByte4 = ( address & 0xFF000000 ) >> 24;
 
-	// start single block write with CMD24
-	uint8_t resultByte = this->sendCommand( 24, baByte1, baByte2, baByte3, baByte4, 0xFF, true );
-	while ( resultByte != VALID_R1_RESPONSE )
+	const uint16_t crc = Checksum::Crc16( data.getPtr(), m_BlockSize );
+
+	for ( unsigned int attempt = 0; attempt <= CRC_ERROR_RETRIES; attempt++ )
 	{
-		resultByte = this->sendCommand( 24, baByte1, baByte2, baByte3, baByte4, 0xFF, true );
-	}
+		// start single block write with CMD24
+		uint8_t resultByte = this->sendCommand( 24, baByte1, baByte2, baByte3, baByte4, true );
+		while ( resultByte != VALID_R1_RESPONSE )
+		{
+			resultByte = this->sendCommand( 24, baByte1, baByte2, baByte3, baByte4, true );
+		}
 
-	// send two dummy bytes (at least one is required, but we'll be safe)
-	LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
-	LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+		// send two dummy bytes (at least one is required, but we'll be safe)
+		LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+		LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
 
-	// send the start token (0xFE) for single block write
-	LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFE );
+		// send the start token (0xFE) for single block write
+		LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFE );
 
-	for ( unsigned int byte = 0; byte < m_BlockSize; byte++ )
-	{
-		LLPD::spi_master_send_and_recieve( m_SpiNum, data[byte] );
-	}
+		for ( unsigned int byte = 0; byte < m_BlockSize; byte++ )
+		{
+			LLPD::spi_master_send_and_recieve( m_SpiNum, data[byte] );
+		}
 
-	// wait for response
-	resultByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
-	while ( (resultByte & 0x1F) != 0x05 )
-	{
+		// the card checks the data against this crc
+		LLPD::spi_master_send_and_recieve( m_SpiNum, crc >> 8 );
+		LLPD::spi_master_send_and_recieve( m_SpiNum, crc & 0xFF );
+
+		// wait for the data response token
 		resultByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
-	}
+		while ( resultByte == 0xFF )
+		{
+			resultByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+		}
+		const bool accepted = ( resultByte & 0x1F ) == DATA_ACCEPTED_RESPONSE;
 
-	// wait until no longer busy (finished writing)
-	resultByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
-	while ( resultByte != 0xFF )
-	{
+		// wait until no longer busy (finished writing)
 		resultByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
-	}
+		while ( resultByte != 0xFF )
+		{
+			resultByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+		}
 
-	// send two dummy bytes for safety
-	LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
-	LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+		// send two dummy bytes for safety
+		LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+		LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
 
-	// the full block is transferred, so we can bring cs pin high
-	LLPD::gpio_output_set( m_CSPort, m_CSPin, true );
+		// the full block is transferred, so we can bring cs pin high
+		LLPD::gpio_output_set( m_CSPort, m_CSPin, true );
 
-	return true;
+		if ( accepted ) return true;
+
+		// rejected because of a crc error (or a write error), so send it again
+		m_NumCrcErrors++;
+	}
+
+	return false;
 }
 
 SharedData<uint8_t> SDCard::readSingleBlock (unsigned int blockNum)
 {
 	// if byte addressing, we need to multiply by the block size
-	const unsigned int address = blockNum * m_ByteAddressingMultiplier;
+	uint32_t address = 0;
+	if ( ! this->getCommandAddress(blockNum, address) ) return SharedData<uint8_t>::MakeSharedDataNull();
 
 	SharedData<uint8_t> readBlockData = SharedData<uint8_t>::MakeSharedData( m_BlockSize );
 
@@ -483,45 +594,137 @@ SharedData<uint8_t> SDCard::readSingleBlock (unsigned int blockNum)
 	uint8_t baByte3 = ( address & 0xFF0000   ) >> 16;
 	uint8_t baByte4 = ( address & 0xFF000000 ) >> 24;
 
-	// start single block read with CMD17
-	uint8_t resultByte = this->sendCommand( 17, baByte1, baByte2, baByte3, baByte4, 0xFF, true );
-	while ( resultByte != VALID_R1_RESPONSE )
+	for ( unsigned int attempt = 0; attempt <= CRC_ERROR_RETRIES; attempt++ )
 	{
-		resultByte = this->sendCommand( 17, baByte1, baByte2, baByte3, baByte4, 0xFF, true );
-	}
+		// start single block read with CMD17
+		uint8_t resultByte = this->sendCommand( 17, baByte1, baByte2, baByte3, baByte4, true );
+		while ( resultByte != VALID_R1_RESPONSE )
+		{
+			resultByte = this->sendCommand( 17, baByte1, baByte2, baByte3, baByte4, true );
+		}
 
-	// wait for transmission start byte (0xFE)
-	uint8_t transmissionStartByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
-	while ( transmissionStartByte != 0xFE )
-	{
-		transmissionStartByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+		// wait for transmission start byte (0xFE)
+		uint8_t transmissionStartByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+		while ( transmissionStartByte != 0xFE )
+		{
+			transmissionStartByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+		}
+
+		// read data into buffer
+		for ( unsigned int byte = 0; byte < m_BlockSize; byte++ )
+		{
+			readBlockData[byte] = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+		}
+
+		// read the crc of the block
+		uint16_t crc = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF ) << 8;
+		crc |= LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+
+		// bring cs pin high since the entire block is read
+		LLPD::gpio_output_set( m_CSPort, m_CSPin, true );
+
+		if ( crc == Checksum::Crc16(readBlockData.getPtr(), m_BlockSize) ) return readBlockData;
+
+		m_NumCrcErrors++;
 	}
 
-	// read data into buffer
-	for ( unsigned int byte = 0; byte < m_BlockSize; byte++ )
+	return SharedData<uint8_t>::MakeSharedDataNull();
+}
+
+bool SDCard::readMultipleBlocks (const SharedData<uint8_t>& data, const unsigned int startBlockNum)
+{
+	// unsure the data is block sized
+	if ( data.getSize() % m_BlockSize != 0 ) return false;
+
+	const unsigned int numBlocksToRead = data.getSize() / m_BlockSize;
+	unsigned int blocksRead = 0;
+	unsigned int attempt = 0;
+
+	while ( blocksRead < numBlocksToRead )
 	{
-		readBlockData[byte] = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
-	}
+		// if byte addressing, we need to multiply by the block size
+		uint32_t address = 0;
+		if ( ! this->getCommandAddress(startBlockNum + blocksRead, address) ) return false;
 
-	// send two dummy bytes (actually to read CRC, but we don't care)
-	LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
-	LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+		// break block address into individual bytes
+		uint8_t baByte1 = address & 0xFF;
+		uint8_t baByte2 = ( address & 0xFF00     ) >> 8;
+		uint8_t baByte3 = ( address & 0xFF0000   ) >> 16;
+		uint8_t baByte4 = ( address & 0xFF000000 ) >> 24;
 
-	// bring cs pin high since the entire block is read
-	LLPD::gpio_output_set( m_CSPort, m_CSPin, true );
+		// start multiple block read with CMD18, the card then sends block after block until told to stop
+		uint8_t resultByte = this->sendCommand( 18, baByte1, baByte2, baByte3, baByte4, true );
+		while ( resultByte != VALID_R1_RESPONSE )
+		{
+			resultByte = this->sendCommand( 18, baByte1, baByte2, baByte3, baByte4, true );
+		}
+
+		bool crcError = false;
+		for ( ; blocksRead < numBlocksToRead; blocksRead++ )
+		{
+			uint8_t* blockData = data.getPtr( m_BlockSize * blocksRead );
 
-	return readBlockData;
+			// wait for transmission start byte (0xFE)
+			uint8_t transmissionStartByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+			while ( transmissionStartByte != 0xFE )
+			{
+				transmissionStartByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+			}
+
+			// read data straight into the callers buffer
+			for ( unsigned int byte = 0; byte < m_BlockSize; byte++ )
+			{
+				blockData[byte] = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+			}
+
+			// read the crc of the block
+			uint16_t crc = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF ) << 8;
+			crc |= LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+
+			// a bad block ends this transfer, the next one starts again from it
+			if ( crc != Checksum::Crc16(blockData, m_BlockSize) )
+			{
+				m_NumCrcErrors++;
+				crcError = true;
+
+				break;
+			}
+
+			attempt = 0;
+		}
+
+		// stop transmission with CMD12
+		this->sendCommand( 12, 0, 0, 0, 0, true );
+
+		// wait until no longer busy (finished stopping)
+		resultByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+		while ( resultByte != 0xFF )
+		{
+			resultByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+		}
+
+		// the transfer is stopped, so we can bring cs pin high
+		LLPD::gpio_output_set( m_CSPort, m_CSPin, true );
+
+		if ( crcError && ++attempt > CRC_ERROR_RETRIES ) return false;
+	}
+
+	return true;
 }
 
-bool SDCard::writeMultipleBlocks (const SharedData<uint8_t>& data, const unsigned int startBlockNum)
+bool SDCard::writeMultipleBlocks (const SharedData<uint8_t>& data, const unsigned int startBlockNum, unsigned int* numBlocksWritten)
 {
+	if ( numBlocksWritten ) *numBlocksWritten = 0;
+
 	// if byte addressing, we need to multiply by the block size
-	const unsigned int address = startBlockNum * m_ByteAddressingMultiplier;
+	uint32_t address = 0;
+	if ( ! this->getCommandAddress(startBlockNum, address) ) return false;
 
 	// unsure the data is block sized
 	if ( data.getSize() % m_BlockSize != 0 ) return false;
 
 	const unsigned int numBlocksToWrite = data.getSize() / m_BlockSize;
+	bool allAccepted = true;
 
 	// break block address into individual bytes
 	uint8_t baByte1 = address & 0xFF;
@@ -530,10 +733,10 @@ bool SDCard::writeMultipleBlocks (const SharedData<uint8_t>& data, const unsigne
 	uint8_t baByte4 = ( address & 0xFF000000 ) >> 24;
 
 	// start multiple block write with CMD25
-	uint8_t resultByte = this->sendCommand( 25, baByte1, baByte2, baByte3, baByte4, 0xFF, true );
+	uint8_t resultByte = this->sendCommand( 25, baByte1, baByte2, baByte3, baByte4, true );
 	while ( resultByte != VALID_R1_RESPONSE )
 	{
-		resultByte = this->sendCommand( 25, baByte1, baByte2, baByte3, baByte4, 0xFF, true );
+		resultByte = this->sendCommand( 25, baByte1, baByte2, baByte3, baByte4, true );
 	}
 
 	for ( unsigned int block = 0; block < numBlocksToWrite; block++ )
@@ -551,16 +754,18 @@ bool SDCard::writeMultipleBlocks (const SharedData<uint8_t>& data, const unsigne
 			LLPD::spi_master_send_and_recieve( m_SpiNum, data[(m_BlockSize * block) + byte] );
 		}
 
-		// two dummy bytes for crc
-		LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
-		LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+		// the card checks the data against this crc
+		const uint16_t crc = Checksum::Crc16( data.getPtr(m_BlockSize * block), m_BlockSize );
+		LLPD::spi_master_send_and_recieve( m_SpiNum, crc >> 8 );
+		LLPD::spi_master_send_and_recieve( m_SpiNum, crc & 0xFF );
 
-		// wait for response
+		// wait for the data response token
 		resultByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
-		while ( (resultByte & 0x1F) != 0x05 )
+		while ( resultByte == 0xFF )
 		{
 			resultByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
 		}
+		const bool accepted = ( resultByte & 0x1F ) == DATA_ACCEPTED_RESPONSE;
 
 		// wait until no longer busy (finished writing)
 		resultByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
@@ -568,6 +773,17 @@ bool SDCard::writeMultipleBlocks (const SharedData<uint8_t>& data, const unsigne
 		{
 			resultByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
 		}
+
+		// a rejected block ends the transfer, the caller has to write the data again
+		if ( ! accepted )
+		{
+			m_NumCrcErrors++;
+			allAccepted = false;
+
+			break;
+		}
+
+		if ( numBlocksWritten ) (*numBlocksWritten)++;
 	}
 
 	// send stop transmission token (0xFD)
@@ -590,7 +806,49 @@ bool SDCard::writeMultipleBlocks (const SharedData<uint8_t>& data, const unsigne
 	// the full block is transferred, so we can bring cs pin high
 	LLPD::gpio_output_set( m_CSPort, m_CSPin, true );
 
-	return true;
+	return allAccepted;
+}
+
+bool SDCard::eraseBlocks (const unsigned int startBlockNum, const unsigned int endBlockNum)
+{
+	// if byte addressing, we need to multiply by the block size
+	uint32_t startAddress = 0;
+	uint32_t endAddress = 0;
+	if ( startBlockNum > endBlockNum || ! this->getCommandAddress(startBlockNum, startAddress)
+			|| ! this->getCommandAddress(endBlockNum, endAddress) )
+	{
+		return false;
+	}
+
+	// set the first block to erase with CMD32
+	uint8_t resultByte = this->sendCommand( 32, startAddress & 0xFF, (startAddress & 0xFF00) >> 8, (startAddress & 0xFF0000) >> 16,
+						(startAddress & 0xFF000000) >> 24 );
+	if ( resultByte != VALID_R1_RESPONSE ) return false;
+
+	// set the last block to erase with CMD33
+	resultByte = this->sendCommand( 33, endAddress & 0xFF, (endAddress & 0xFF00) >> 8, (endAddress & 0xFF0000) >> 16,
+					(endAddress & 0xFF000000) >> 24 );
+	if ( resultByte != VALID_R1_RESPONSE ) return false;
+
+	// start the erase with CMD38, the card holds the data line low until it's done
+	resultByte = this->sendCommand( 38, 0, 0, 0, 0, true );
+	const bool started = ( resultByte == VALID_R1_RESPONSE );
+
+	// wait until no longer busy (finished erasing)
+	resultByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+	while ( resultByte != 0xFF )
+	{
+		resultByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+	}
+
+	// send two dummy bytes for safety
+	LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+	LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+
+	// the erase is finished, so we can bring cs pin high
+	LLPD::gpio_output_set( m_CSPort, m_CSPin, true );
+
+	return started;
 }
 
 SharedData<uint8_t> SDCard::readOCR()
@@ -600,10 +858,10 @@ SharedData<uint8_t> SDCard::readOCR()
 	SharedData<uint8_t> ocrContents = SharedData<uint8_t>::MakeSharedData( ocrSize );
 
 	// start ocr read with CMD58
-	uint8_t resultByte = this->sendCommand( 58, 0, 0, 0, 0, 0x00, true );
+	uint8_t resultByte = this->sendCommand( 58, 0, 0, 0, 0, true );
 	while ( resultByte != VALID_R1_RESPONSE )
 	{
-		resultByte = this->sendCommand( 58, 0, 0, 0, 0, 0x00, true );
+		resultByte = this->sendCommand( 58, 0, 0, 0, 0, true );
 	}
 
 	// read data into buffer
@@ -621,3 +879,84 @@ SharedData<uint8_t> SDCard::readOCR()
 
 	return ocrContents;
 }
+
+SharedData<uint8_t> SDCard::readCSD()
+{
+	constexpr unsigned int csdSize = 16;
+
+	SharedData<uint8_t> csdContents = SharedData<uint8_t>::MakeSharedData( csdSize );
+
+	// start csd read with CMD9
+	uint8_t resultByte = this->sendCommand( 9, 0, 0, 0, 0, true );
+	while ( resultByte != VALID_R1_RESPONSE )
+	{
+		resultByte = this->sendCommand( 9, 0, 0, 0, 0, true );
+	}
+
+	// the csd is sent like a data block, so wait for transmission start byte (0xFE)
+	uint8_t transmissionStartByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+	while ( transmissionStartByte != 0xFE )
+	{
+		transmissionStartByte = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+	}
+
+	// read data into buffer
+	for ( unsigned int byte = 0; byte < csdSize; byte++ )
+	{
+		csdContents[byte] = LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+	}
+
+	// send two dummy bytes (actually to read CRC, but we don't care)
+	LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+	LLPD::spi_master_send_and_recieve( m_SpiNum, 0xFF );
+
+	// bring cs pin high since the entire csd is read
+	LLPD::gpio_output_set( m_CSPort, m_CSPin, true );
+
+	return csdContents;
+}
+
+unsigned int SDCard::getCSDBits (const SharedData<uint8_t>& csd, unsigned int msb, unsigned int lsb)
+{
+	// the csd is 128 bits sent msb first, so bit 127 is the top bit of the first byte
+	unsigned int value = 0;
+	for ( unsigned int bit = msb + 1; bit > lsb; bit-- )
+	{
+		const unsigned int bitNum = bit - 1;
+		const uint8_t byte = csd[15 - ( bitNum / 8 )];
+
+		value = ( value << 1 ) | ( (byte >> (bitNum % 8)) & 0b1 );
+	}
+
+	return value;
+}
+
+void SDCard::readCapacityAndEraseSize()
+{
+	SharedData<uint8_t> csd = this->readCSD();
+
+	const unsigned int csdStructure = this->getCSDBits( csd, 127, 126 );
+	if ( csdStructure == 0 )
+	{
+		// csd version 1.0 (standard capacity)
+		const unsigned int readBlLen = this->getCSDBits( csd, 83, 80 );
+		const unsigned int cSize = this->getCSDBits( csd, 73, 62 );
+		const unsigned int cSizeMult = this->getCSDBits( csd, 49, 47 );
+
+		m_CapacityInBytes = static_cast<uint64_t>( cSize + 1 ) << ( cSizeMult + 2 + readBlLen );
+	}
+	else
+	{
+		// csd version 2.0 (high and extended capacity), capacity is in units of 512KB
+		const unsigned int cSize = this->getCSDBits( csd, 69, 48 );
+
+		m_CapacityInBytes = static_cast<uint64_t>( cSize + 1 ) * 512 * 1024;
+	}
+
+	// if single block erase isn't enabled, erasing happens in units of sectors
+	const unsigned int eraseBlkEn = this->getCSDBits( csd, 46, 46 );
+	const unsigned int sectorSize = this->getCSDBits( csd, 45, 39 );
+	const unsigned int writeBlLen = this->getCSDBits( csd, 25, 22 );
+
+	m_EraseSizeInBytes = ( eraseBlkEn ) ? m_BlockSize : ( sectorSize + 1 ) * ( 1 << writeBlLen );
+}
@@ -285,6 +285,14 @@ void Sram_23K256::readFromMedia (const unsigned int address, const SharedData<ui
 	}
 }
 
+IStorageMediaInfo Sram_23K256::getMediaInfo()
+{
+	// in byte mode every byte is a separate instruction, in sequential mode the whole chip can be streamed in one go
+	const unsigned int optimalIOSize = ( m_SequentialMode ) ? SRAM_SIZE : 1;
+
+	return IStorageMediaInfo( SRAM_SIZE, optimalIOSize, 1, SRAM_PAGE_SIZE, 1, false );
+}
+
 Sram_23K256_Manager::Sram_23K256_Manager (const SPI_NUM& spiNum, const std::vector<Sram_23K256_GPIO_Config>& gpioConfigs) :
 	m_Srams(),
 	m_DmaMode( false ),
@@ -446,6 +454,14 @@ void Sram_23K256_Manager::readFromMedia (const unsigned int address, const Share
 	}
 }
 
+IStorageMediaInfo Sram_23K256_Manager::getMediaInfo()
+{
+	const uint64_t capacity = static_cast<uint64_t>( Sram_23K256::SRAM_SIZE ) * m_Srams.size();
+	const unsigned int optimalIOSize = ( ! m_Srams.empty() && m_Srams[0].getSequentialMode() ) ? Sram_23K256::SRAM_SIZE : 1;
+
+	return IStorageMediaInfo( capacity, optimalIOSize, 1, Sram_23K256::SRAM_PAGE_SIZE, 1, m_DmaMode );
+}
+
 unsigned int Sram_23K256_Manager::clipStartAddress (unsigned int startAddress, unsigned int sizeInBytes, unsigned int sramNum)
 {
 	const unsigned int sramSize = Sram_23K256::SRAM_SIZE; // just to shorten variable names
@@ -0,0 +1,105 @@
+#include "StorageStreamReader.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+StorageStreamReader::StorageStreamReader (IStorageMedia& media, uint64_t startOffsetInBytes, uint64_t sizeInBytes,
+						unsigned int bufferSizeInBytes, unsigned int numBuffers, bool loop, IAllocator* allocator) :
+	m_Media( media ),
+	m_StartOffsetInBytes( startOffsetInBytes ),
+	m_SizeInBytes( sizeInBytes ),
+	m_BufferSizeInBytes( std::max<unsigned int>(bufferSizeInBytes, 1) ),
+	m_NumBuffers( std::max<unsigned int>(numBuffers, 2) ),
+	m_Loop( loop ),
+	m_Buffers( SharedData<uint8_t>::MakeSharedData(m_BufferSizeInBytes * m_NumBuffers, allocator) ),
+	m_FillSizes( SharedData<unsigned int>::MakeSharedData(m_NumBuffers, allocator) ),
+	m_MediaPosition( 0 ),
+	m_BufferPosition( 0 ),
+	m_WriteIndex( 0 ),
+	m_ReadIndex( 0 ),
+	m_MediaFinished( sizeInBytes == 0 ),
+	m_NumUnderruns( 0 )
+{
+}
+
+StorageStreamReader::~StorageStreamReader()
+{
+}
+
+unsigned int StorageStreamReader::service()
+{
+	unsigned int numFilled = 0;
+	unsigned int writeIndex = m_WriteIndex.load( std::memory_order_relaxed );
+
+	while ( ! m_MediaFinished.load(std::memory_order_relaxed)
+			&& this->getNumFullBuffers(writeIndex, m_ReadIndex.load(std::memory_order_acquire)) < m_NumBuffers )
+	{
+		const unsigned int bufferNum = writeIndex % m_NumBuffers;
+		const unsigned int fillSize = static_cast<unsigned int>( std::min<uint64_t>(m_BufferSizeInBytes, m_SizeInBytes - m_MediaPosition) );
+
+		// straight from the media into the ring
+		const SharedData<uint8_t> buffer = SharedData<uint8_t>::MakeSharedData( fillSize, m_Buffers.getPtr(bufferNum * m_BufferSizeInBytes) );
+		m_Media.readFromMedia64( m_StartOffsetInBytes + m_MediaPosition, buffer );
+		m_FillSizes[bufferNum] = fillSize;
+
+		m_MediaPosition += fillSize;
+		const bool reachedEnd = ( m_MediaPosition == m_SizeInBytes );
+		if ( reachedEnd && m_Loop ) m_MediaPosition = 0;
+
+		// the release makes the data and fill size visible to the consumer before the index
+		writeIndex = this->nextIndex( writeIndex );
+		m_WriteIndex.store( writeIndex, std::memory_order_release );
+
+		// and the last buffer visible before the finished flag
+		if ( reachedEnd && ! m_Loop ) m_MediaFinished.store( true, std::memory_order_release );
+
+		numFilled++;
+	}
+
+	return numFilled;
+}
+
+unsigned int StorageStreamReader::read (uint8_t* destination, unsigned int sizeInBytes)
+{
+	unsigned int numCopied = 0;
+	unsigned int readIndex = m_ReadIndex.load( std::memory_order_relaxed );
+
+	while ( numCopied < sizeInBytes )
+	{
+		// checking for the end first, a finished flag always comes with the last buffer
+		const bool mediaFinished = m_MediaFinished.load( std::memory_order_acquire );
+		if ( this->getNumFullBuffers(m_WriteIndex.load(std::memory_order_acquire), readIndex) == 0 )
+		{
+			if ( ! mediaFinished ) m_NumUnderruns.fetch_add( 1, std::memory_order_relaxed );
+
+			break;
+		}
+
+		const unsigned int bufferNum = readIndex % m_NumBuffers;
+		const unsigned int pieceSize = std::min( m_FillSizes[bufferNum] - m_BufferPosition, sizeInBytes - numCopied );
+
+		std::memcpy( destination + numCopied, m_Buffers.getPtr(bufferNum * m_BufferSizeInBytes + m_BufferPosition), pieceSize );
+		numCopied += pieceSize;
+		m_BufferPosition += pieceSize;
+
+		// hand the empty buffer back to service()
+		if ( m_BufferPosition == m_FillSizes[bufferNum] )
+		{
+			m_BufferPosition = 0;
+			readIndex = this->nextIndex( readIndex );
+			m_ReadIndex.store( readIndex, std::memory_order_release );
+		}
+	}
+
+	return numCopied;
+}
+
+bool StorageStreamReader::isFinished()
+{
+	return m_MediaFinished.load( std::memory_order_acquire ) && this->getNumFullBuffers() == 0;
+}
+
+unsigned int StorageStreamReader::getNumFullBuffers()
+{
+	return this->getNumFullBuffers( m_WriteIndex.load(std::memory_order_acquire), m_ReadIndex.load(std::memory_order_acquire) );
+}
@@ -0,0 +1,113 @@
+#include "StorageStreamWriter.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+StorageStreamWriter::StorageStreamWriter (IStorageMedia& media, uint64_t startOffsetInBytes, uint64_t sizeInBytes,
+						unsigned int bufferSizeInBytes, unsigned int numBuffers, IAllocator* allocator) :
+	m_Media( media ),
+	m_StartOffsetInBytes( startOffsetInBytes ),
+	m_SizeInBytes( sizeInBytes ),
+	m_BufferSizeInBytes( std::max<unsigned int>(bufferSizeInBytes, 1) ),
+	m_NumBuffers( std::max<unsigned int>(numBuffers, 2) ),
+	m_Buffers( SharedData<uint8_t>::MakeSharedData(m_BufferSizeInBytes * m_NumBuffers, allocator) ),
+	m_FillSizes( SharedData<unsigned int>::MakeSharedData(m_NumBuffers, allocator) ),
+	m_MediaPosition( 0 ),
+	m_BufferPosition( 0 ),
+	m_NumBytesTaken( 0 ),
+	m_WriteIndex( 0 ),
+	m_ReadIndex( 0 ),
+	m_NumOverruns( 0 )
+{
+}
+
+StorageStreamWriter::~StorageStreamWriter()
+{
+}
+
+unsigned int StorageStreamWriter::service()
+{
+	unsigned int numWritten = 0;
+	unsigned int readIndex = m_ReadIndex.load( std::memory_order_relaxed );
+
+	while ( this->getNumFullBuffers(m_WriteIndex.load(std::memory_order_acquire), readIndex) > 0 )
+	{
+		const unsigned int bufferNum = readIndex % m_NumBuffers;
+		const unsigned int fillSize = m_FillSizes[bufferNum];
+
+		// straight from the ring to the media
+		const SharedData<uint8_t> buffer = SharedData<uint8_t>::MakeSharedData( fillSize, m_Buffers.getPtr(bufferNum * m_BufferSizeInBytes) );
+		m_Media.writeToMedia64( buffer, m_StartOffsetInBytes + m_MediaPosition );
+		m_MediaPosition += fillSize;
+
+		// the release makes sure the producer can't refill the buffer while the media may still be reading it
+		readIndex = this->nextIndex( readIndex );
+		m_ReadIndex.store( readIndex, std::memory_order_release );
+
+		numWritten++;
+	}
+
+	return numWritten;
+}
+
+void StorageStreamWriter::finish()
+{
+	if ( m_BufferPosition > 0 )
+	{
+		// the buffer being filled is only ever the empty one, so there's always room to hand it over
+		this->publishBuffer();
+	}
+
+	this->service();
+}
+
+unsigned int StorageStreamWriter::write (const uint8_t* source, unsigned int sizeInBytes)
+{
+	unsigned int numTaken = 0;
+
+	while ( numTaken < sizeInBytes && ! this->isFull() )
+	{
+		const unsigned int writeIndex = m_WriteIndex.load( std::memory_order_relaxed );
+		if ( this->getNumFullBuffers(writeIndex, m_ReadIndex.load(std::memory_order_acquire)) == m_NumBuffers )
+		{
+			// every buffer is waiting on the media, so the rest is lost
+			m_NumOverruns.fetch_add( 1, std::memory_order_relaxed );
+
+			break;
+		}
+
+		const unsigned int bufferNum = writeIndex % m_NumBuffers;
+		const unsigned int pieceSize = static_cast<unsigned int>( std::min<uint64_t>(std::min(m_BufferSizeInBytes - m_BufferPosition,
+										sizeInBytes - numTaken), m_SizeInBytes - m_NumBytesTaken) );
+
+		std::memcpy( m_Buffers.getPtr(bufferNum * m_BufferSizeInBytes + m_BufferPosition), source + numTaken, pieceSize );
+		numTaken += pieceSize;
+		m_BufferPosition += pieceSize;
+		m_NumBytesTaken += pieceSize;
+
+		// the end of the region may leave the last buffer short
+		if ( m_BufferPosition == m_BufferSizeInBytes || this->isFull() ) this->publishBuffer();
+	}
+
+	return numTaken;
+}
+
+bool StorageStreamWriter::isFull()
+{
+	return m_NumBytesTaken == m_SizeInBytes;
+}
+
+unsigned int StorageStreamWriter::getNumFullBuffers()
+{
+	return this->getNumFullBuffers( m_WriteIndex.load(std::memory_order_acquire), m_ReadIndex.load(std::memory_order_acquire) );
+}
+
+void StorageStreamWriter::publishBuffer()
+{
+	const unsigned int writeIndex = m_WriteIndex.load( std::memory_order_relaxed );
+	m_FillSizes[writeIndex % m_NumBuffers] = m_BufferPosition;
+	m_BufferPosition = 0;
+
+	// the release makes the data and fill size visible to service() before the index
+	m_WriteIndex.store( this->nextIndex(writeIndex), std::memory_order_release );
+}
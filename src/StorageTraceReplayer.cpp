@@ -0,0 +1,111 @@
+#include "StorageTraceReplayer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+static uint64_t steadyClockNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+StorageTraceReplayer::StorageTraceReplayer (IStorageMedia& media, StorageTraceClock clock) :
+	m_Media( media ),
+	m_Clock( (clock) ? clock : steadyClockNow ),
+	m_Latencies()
+{
+}
+
+StorageTraceReplayer::~StorageTraceReplayer()
+{
+}
+
+bool StorageTraceReplayer::replay (const uint8_t* trace, unsigned int sizeInBytes, StorageTraceReplayResult& result)
+{
+	std::vector<StorageTraceRecord> records;
+	if ( ! TracingStorageMedia::DecodeTrace(trace, sizeInBytes, records) ) return false;
+
+	this->replay( records, result );
+
+	return true;
+}
+
+void StorageTraceReplayer::replay (const std::vector<StorageTraceRecord>& records, StorageTraceReplayResult& result)
+{
+	result = StorageTraceReplayResult();
+	m_Latencies.clear();
+	m_Latencies.reserve( records.size() );
+
+	// one buffer big enough for any transfer, the views into it never allocate during the replay
+	uint64_t bufferSize = 0;
+	for ( const StorageTraceRecord& record : records )
+	{
+		if ( record.m_Op != STORAGE_TRACE_OP::DISCARD && record.m_SizeInBytes <= 0xFFFFFFFF ) bufferSize = std::max( bufferSize, record.m_SizeInBytes );
+	}
+
+	SharedData<uint8_t> buffer = SharedData<uint8_t>::MakeSharedData( static_cast<unsigned int>(bufferSize) );
+	for ( unsigned int byte = 0; byte < bufferSize; byte++ )
+	{
+		buffer[byte] = static_cast<uint8_t>( byte * 131 + 17 );
+	}
+
+	const uint64_t startTime = m_Clock();
+
+	for ( const StorageTraceRecord& record : records )
+	{
+		// transfers too big for a SharedData can't have come from one
+		if ( record.m_Op != STORAGE_TRACE_OP::DISCARD && record.m_SizeInBytes > 0xFFFFFFFF ) continue;
+
+		const SharedData<uint8_t> data = SharedData<uint8_t>::MakeSharedData( static_cast<unsigned int>(record.m_SizeInBytes), buffer.getPtr() );
+		const uint64_t operationStartTime = m_Clock();
+
+		switch ( record.m_Op )
+		{
+			case STORAGE_TRACE_OP::READ:
+				m_Media.readFromMedia64( record.m_OffsetInBytes, data );
+				result.m_NumReads++;
+				result.m_BytesRead += record.m_SizeInBytes;
+
+				break;
+			case STORAGE_TRACE_OP::WRITE:
+				m_Media.writeToMedia64( data, record.m_OffsetInBytes );
+				result.m_NumWrites++;
+				result.m_BytesWritten += record.m_SizeInBytes;
+
+				break;
+			case STORAGE_TRACE_OP::DISCARD:
+				m_Media.discard64( record.m_OffsetInBytes, record.m_SizeInBytes );
+				result.m_NumDiscards++;
+
+				break;
+			default:
+				break;
+		}
+
+		m_Latencies.push_back( m_Clock() - operationStartTime );
+	}
+
+	result.m_TotalTimeInNs = m_Clock() - startTime;
+	if ( result.m_TotalTimeInNs > 0 )
+	{
+		result.m_BytesPerSecond = static_cast<double>( result.m_BytesRead + result.m_BytesWritten ) * 1e9 / result.m_TotalTimeInNs;
+	}
+
+	std::sort( m_Latencies.begin(), m_Latencies.end() );
+	result.m_MedianLatencyInNs = this->getLatencyPercentile( 50.0 );
+	result.m_P90LatencyInNs = this->getLatencyPercentile( 90.0 );
+	result.m_P99LatencyInNs = this->getLatencyPercentile( 99.0 );
+	result.m_P999LatencyInNs = this->getLatencyPercentile( 99.9 );
+	result.m_MaxLatencyInNs = this->getLatencyPercentile( 100.0 );
+}
+
+uint64_t StorageTraceReplayer::getLatencyPercentile (double percentile)
+{
+	if ( m_Latencies.empty() ) return 0;
+
+	// nearest rank, so every percentile is a latency that was actually measured
+	const double rank = std::ceil( std::min(std::max(percentile, 0.0), 100.0) / 100.0 * m_Latencies.size() );
+	const size_t index = ( rank < 1.0 ) ? 0 : static_cast<size_t>( rank ) - 1;
+
+	return m_Latencies[std::min( index, m_Latencies.size() - 1 )];
+}
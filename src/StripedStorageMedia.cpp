@@ -0,0 +1,301 @@
+#include "StripedStorageMedia.hpp"
+
+#include <algorithm>
+
+StripedStorageMedia::StripedStorageMedia (const std::vector<StripedStorageMediaMember>& members, unsigned int stripeUnitInBytes) :
+	m_Members( members ),
+	m_StripeUnitInBytes( (stripeUnitInBytes > 0) ? stripeUnitInBytes : 1 ),
+	m_Dispatcher( nullptr )
+{
+}
+
+StripedStorageMedia::~StripedStorageMedia()
+{
+}
+
+void StripedStorageMedia::writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes)
+{
+	this->writeToMedia64( data, offsetInBytes );
+}
+
+SharedData<uint8_t> StripedStorageMedia::readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes)
+{
+	return this->readFromMedia64( sizeInBytes, offsetInBytes );
+}
+
+void StripedStorageMedia::readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data)
+{
+	this->readFromMedia64( static_cast<uint64_t>(offsetInBytes), data );
+}
+
+void StripedStorageMedia::writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes)
+{
+	if ( m_Members.empty() || data.getSizeInBytes() == 0 ) return;
+
+	std::vector<MemberTransfer> transfers;
+	const bool singleMember = this->planTransfers( offsetInBytes, data.getSizeInBytes(), transfers );
+
+	if ( singleMember )
+	{
+		// the whole request lands on one member, so no need to gather anything
+		for ( MemberTransfer& transfer : transfers )
+		{
+			if ( transfer.m_SizeInBytes > 0 ) transfer.m_Data = data;
+		}
+	}
+	else
+	{
+		this->copyStripes( offsetInBytes, data, transfers, true );
+	}
+
+	this->runTransfers( transfers, true );
+}
+
+SharedData<uint8_t> StripedStorageMedia::readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes)
+{
+	SharedData<uint8_t> data = SharedData<uint8_t>::MakeSharedData( sizeInBytes );
+
+	this->readFromMedia64( offsetInBytes, data );
+
+	return data;
+}
+
+void StripedStorageMedia::readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data)
+{
+	if ( m_Members.empty() || data.getSizeInBytes() == 0 ) return;
+
+	std::vector<MemberTransfer> transfers;
+	const bool singleMember = this->planTransfers( offsetInBytes, data.getSizeInBytes(), transfers );
+
+	if ( singleMember )
+	{
+		// the whole request lands on one member, so it can read straight into the callers buffer
+		for ( MemberTransfer& transfer : transfers )
+		{
+			if ( transfer.m_SizeInBytes > 0 ) transfer.m_Data = data;
+		}
+
+		this->runTransfers( transfers, false );
+	}
+	else
+	{
+		for ( MemberTransfer& transfer : transfers )
+		{
+			if ( transfer.m_SizeInBytes > 0 ) transfer.m_Data = SharedData<uint8_t>::MakeSharedData( transfer.m_SizeInBytes );
+		}
+
+		this->runTransfers( transfers, false );
+		this->copyStripes( offsetInBytes, data, transfers, false );
+	}
+}
+
+void StripedStorageMedia::discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes)
+{
+	this->discard64( static_cast<uint64_t>(offsetInBytes), static_cast<uint64_t>(sizeInBytes) );
+}
+
+void StripedStorageMedia::discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes)
+{
+	if ( m_Members.empty() ) return;
+
+	// in pieces that fit a transfer plan, each piece is one contiguous discard per member
+	uint64_t bytesDone = 0;
+
+	while ( bytesDone < sizeInBytes )
+	{
+		const unsigned int pieceSize = static_cast<unsigned int>( std::min<uint64_t>(sizeInBytes - bytesDone, 0x80000000) );
+
+		std::vector<MemberTransfer> transfers;
+		this->planTransfers( offsetInBytes + bytesDone, pieceSize, transfers );
+
+		for ( unsigned int memberNum = 0; memberNum < m_Members.size(); memberNum++ )
+		{
+			const MemberTransfer& transfer = transfers[memberNum];
+			if ( transfer.m_SizeInBytes > 0 ) m_Members[memberNum].m_Media->discard64( transfer.m_MemberOffset, transfer.m_SizeInBytes );
+		}
+
+		bytesDone += pieceSize;
+	}
+}
+
+bool StripedStorageMedia::needsInitialization()
+{
+	for ( StripedStorageMediaMember& member : m_Members )
+	{
+		if ( member.m_Media->needsInitialization() ) return true;
+	}
+
+	return false;
+}
+
+void StripedStorageMedia::initialize()
+{
+	for ( StripedStorageMediaMember& member : m_Members )
+	{
+		if ( member.m_Media->needsInitialization() ) member.m_Media->initialize();
+	}
+}
+
+void StripedStorageMedia::afterInitialize()
+{
+	for ( StripedStorageMediaMember& member : m_Members )
+	{
+		member.m_Media->afterInitialize();
+	}
+}
+
+IStorageMediaInfo StripedStorageMedia::getMediaInfo()
+{
+	const unsigned int numMembers = m_Members.size();
+
+	IStorageMediaInfo info( 0, m_StripeUnitInBytes * numMembers, 1, 1, 1, numMembers > 0 );
+	uint64_t smallestCapacity = 0;
+
+	for ( unsigned int memberNum = 0; memberNum < numMembers; memberNum++ )
+	{
+		const IStorageMediaInfo memberInfo = m_Members[memberNum].m_Media->getMediaInfo();
+
+		if ( memberNum == 0 || memberInfo.m_CapacityInBytes < smallestCapacity ) smallestCapacity = memberInfo.m_CapacityInBytes;
+		if ( memberInfo.m_AlignmentInBytes > info.m_AlignmentInBytes ) info.m_AlignmentInBytes = memberInfo.m_AlignmentInBytes;
+		if ( memberInfo.m_PageSizeInBytes > info.m_PageSizeInBytes ) info.m_PageSizeInBytes = memberInfo.m_PageSizeInBytes;
+		if ( memberInfo.m_EraseSizeInBytes > info.m_EraseSizeInBytes ) info.m_EraseSizeInBytes = memberInfo.m_EraseSizeInBytes;
+		if ( ! memberInfo.m_SupportsAsync ) info.m_SupportsAsync = false;
+	}
+
+	// only whole stripe units on the smallest member are usable, and an unknown member capacity makes the total unknown
+	info.m_CapacityInBytes = ( smallestCapacity / m_StripeUnitInBytes ) * m_StripeUnitInBytes * numMembers;
+
+	return info;
+}
+
+bool StripedStorageMedia::planTransfers (const uint64_t offsetInBytes, const unsigned int sizeInBytes, std::vector<MemberTransfer>& transfers)
+{
+	const unsigned int numMembers = m_Members.size();
+	transfers.resize( numMembers );
+
+	uint64_t position = offsetInBytes;
+	unsigned int bytesLeft = sizeInBytes;
+	unsigned int membersTouched = 0;
+
+	while ( bytesLeft > 0 )
+	{
+		const uint64_t stripeNum = position / m_StripeUnitInBytes;
+		const unsigned int offsetInStripe = position % m_StripeUnitInBytes;
+		const unsigned int memberNum = stripeNum % numMembers;
+		const unsigned int pieceSize = std::min( m_StripeUnitInBytes - offsetInStripe, bytesLeft );
+
+		// consecutive stripes on the same member are adjacent on that member, so only the first piece sets the offset
+		MemberTransfer& transfer = transfers[memberNum];
+		if ( transfer.m_SizeInBytes == 0 )
+		{
+			transfer.m_MemberOffset = ( stripeNum / numMembers ) * m_StripeUnitInBytes + offsetInStripe;
+			membersTouched++;
+		}
+		transfer.m_SizeInBytes += pieceSize;
+
+		position += pieceSize;
+		bytesLeft -= pieceSize;
+	}
+
+	return membersTouched == 1;
+}
+
+void StripedStorageMedia::copyStripes (const uint64_t offsetInBytes, const SharedData<uint8_t>& data, std::vector<MemberTransfer>& transfers,
+					bool toMembers)
+{
+	const unsigned int numMembers = m_Members.size();
+	std::vector<unsigned int> memberIndices( numMembers, 0 );
+
+	if ( toMembers )
+	{
+		for ( MemberTransfer& transfer : transfers )
+		{
+			if ( transfer.m_SizeInBytes > 0 ) transfer.m_Data = SharedData<uint8_t>::MakeSharedData( transfer.m_SizeInBytes );
+		}
+	}
+
+	uint64_t position = offsetInBytes;
+	unsigned int dataIndex = 0;
+
+	while ( dataIndex < data.getSizeInBytes() )
+	{
+		const uint64_t stripeNum = position / m_StripeUnitInBytes;
+		const unsigned int offsetInStripe = position % m_StripeUnitInBytes;
+		const unsigned int memberNum = stripeNum % numMembers;
+		const unsigned int pieceSize = std::min( m_StripeUnitInBytes - offsetInStripe, data.getSizeInBytes() - dataIndex );
+
+		uint8_t* memberPtr = transfers[memberNum].m_Data.getPtr( memberIndices[memberNum] );
+		uint8_t* dataPtr = data.getPtr( dataIndex );
+
+		if ( toMembers )
+		{
+			std::copy( dataPtr, dataPtr + pieceSize, memberPtr );
+		}
+		else
+		{
+			std::copy( memberPtr, memberPtr + pieceSize, dataPtr );
+		}
+
+		memberIndices[memberNum] += pieceSize;
+		position += pieceSize;
+		dataIndex += pieceSize;
+	}
+}
+
+void StripedStorageMedia::runTransfers (std::vector<MemberTransfer>& transfers, bool writing)
+{
+	// members sharing a bus have to be accessed one after another, so each bus gets a single job
+	std::vector<unsigned int> busNums;
+	std::vector<std::vector<unsigned int>> memberNumsPerBus;
+
+	for ( unsigned int memberNum = 0; memberNum < transfers.size(); memberNum++ )
+	{
+		if ( transfers[memberNum].m_SizeInBytes == 0 ) continue;
+
+		const unsigned int busNum = m_Members[memberNum].m_BusNum;
+		unsigned int busIndex = 0;
+		while ( busIndex < busNums.size() && busNums[busIndex] != busNum ) busIndex++;
+
+		if ( busIndex == busNums.size() )
+		{
+			busNums.push_back( busNum );
+			memberNumsPerBus.emplace_back();
+		}
+
+		memberNumsPerBus[busIndex].push_back( memberNum );
+	}
+
+	std::vector<std::function<void()>> jobs;
+	for ( const std::vector<unsigned int>& memberNums : memberNumsPerBus )
+	{
+		jobs.push_back( [this, &transfers, &memberNums, writing]()
+		{
+			for ( const unsigned int memberNum : memberNums )
+			{
+				MemberTransfer& transfer = transfers[memberNum];
+				IStorageMedia* media = m_Members[memberNum].m_Media;
+
+				if ( writing )
+				{
+					media->writeToMedia64( transfer.m_Data, transfer.m_MemberOffset );
+				}
+				else
+				{
+					media->readFromMedia64( transfer.m_MemberOffset, transfer.m_Data );
+				}
+			}
+		} );
+	}
+
+	if ( m_Dispatcher && jobs.size() > 1 )
+	{
+		m_Dispatcher( jobs );
+	}
+	else
+	{
+		for ( std::function<void()>& job : jobs )
+		{
+			job();
+		}
+	}
+}
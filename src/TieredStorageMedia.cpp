@@ -0,0 +1,308 @@
+#include "TieredStorageMedia.hpp"
+
+#include <algorithm>
+
+// heat is halved after this many accesses per fast tier slot, so that extents which used to be hot cool down over time
+#define DECAY_INTERVAL_PER_SLOT 16
+// the slow tier heat table is also decayed if it tracks more than this many extents per fast tier slot
+#define MAX_TRACKED_EXTENTS_PER_SLOT 4
+
+TieredStorageMedia::TieredStorageMedia (IStorageMedia& fastTier, IStorageMedia& slowTier, unsigned int extentSizeInBytes,
+					unsigned int promotionThreshold) :
+	m_FastTier( fastTier ),
+	m_SlowTier( slowTier ),
+	m_ExtentSizeInBytes( (extentSizeInBytes > 0) ? extentSizeInBytes : 1 ),
+	m_PromotionThreshold( promotionThreshold ),
+	m_SlowTierCapacityInBytes( slowTier.getMediaInfo().m_CapacityInBytes ),
+	m_Slots( fastTier.getMediaInfo().m_CapacityInBytes / m_ExtentSizeInBytes ),
+	m_ResidentExtents(),
+	m_SlowExtentHeat(),
+	m_AccessesSinceDecay( 0 ),
+	m_FastTierHits( 0 ),
+	m_SlowTierHits( 0 )
+{
+}
+
+TieredStorageMedia::~TieredStorageMedia()
+{
+}
+
+void TieredStorageMedia::writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes)
+{
+	this->writeToMedia64( data, offsetInBytes );
+}
+
+SharedData<uint8_t> TieredStorageMedia::readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes)
+{
+	return this->readFromMedia64( sizeInBytes, offsetInBytes );
+}
+
+void TieredStorageMedia::readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data)
+{
+	this->readFromMedia64( static_cast<uint64_t>(offsetInBytes), data );
+}
+
+void TieredStorageMedia::writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes)
+{
+	unsigned int dataIndex = 0;
+
+	while ( dataIndex < data.getSizeInBytes() )
+	{
+		const uint64_t position = offsetInBytes + dataIndex;
+		const unsigned int offsetInExtent = position % m_ExtentSizeInBytes;
+		const unsigned int pieceSize = std::min( m_ExtentSizeInBytes - offsetInExtent, data.getSizeInBytes() - dataIndex );
+
+		const SharedData<uint8_t> piece = SharedData<uint8_t>::MakeSharedData( pieceSize, data.getPtr(dataIndex) );
+		this->accessExtent( position / m_ExtentSizeInBytes, offsetInExtent, piece, true );
+
+		dataIndex += pieceSize;
+	}
+}
+
+SharedData<uint8_t> TieredStorageMedia::readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes)
+{
+	SharedData<uint8_t> data = SharedData<uint8_t>::MakeSharedData( sizeInBytes );
+
+	this->readFromMedia64( offsetInBytes, data );
+
+	return data;
+}
+
+void TieredStorageMedia::readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data)
+{
+	unsigned int dataIndex = 0;
+
+	while ( dataIndex < data.getSizeInBytes() )
+	{
+		const uint64_t position = offsetInBytes + dataIndex;
+		const unsigned int offsetInExtent = position % m_ExtentSizeInBytes;
+		const unsigned int pieceSize = std::min( m_ExtentSizeInBytes - offsetInExtent, data.getSizeInBytes() - dataIndex );
+
+		// read straight into the callers buffer
+		const SharedData<uint8_t> piece = SharedData<uint8_t>::MakeSharedData( pieceSize, data.getPtr(dataIndex) );
+		this->accessExtent( position / m_ExtentSizeInBytes, offsetInExtent, piece, false );
+
+		dataIndex += pieceSize;
+	}
+}
+
+void TieredStorageMedia::discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes)
+{
+	this->discard64( static_cast<uint64_t>(offsetInBytes), static_cast<uint64_t>(sizeInBytes) );
+}
+
+void TieredStorageMedia::discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes)
+{
+	const uint64_t endInBytes = offsetInBytes + sizeInBytes;
+
+	// resident extents that are entirely discarded give up their slot without being written back
+	for ( unsigned int slotNum = 0; slotNum < m_Slots.size(); slotNum++ )
+	{
+		ExtentSlot& slot = m_Slots[slotNum];
+		const uint64_t extentStart = slot.m_ExtentNum * m_ExtentSizeInBytes;
+
+		if ( slot.m_InUse && extentStart >= offsetInBytes && extentStart + this->getExtentSize(slot.m_ExtentNum) <= endInBytes )
+		{
+			m_ResidentExtents.erase( slot.m_ExtentNum );
+			slot = ExtentSlot();
+		}
+	}
+
+	m_SlowTier.discard64( offsetInBytes, sizeInBytes );
+}
+
+bool TieredStorageMedia::needsInitialization()
+{
+	return m_FastTier.needsInitialization() || m_SlowTier.needsInitialization();
+}
+
+void TieredStorageMedia::initialize()
+{
+	if ( m_FastTier.needsInitialization() ) m_FastTier.initialize();
+	if ( m_SlowTier.needsInitialization() ) m_SlowTier.initialize();
+}
+
+void TieredStorageMedia::afterInitialize()
+{
+	m_FastTier.afterInitialize();
+	m_SlowTier.afterInitialize();
+
+	m_SlowTierCapacityInBytes = m_SlowTier.getMediaInfo().m_CapacityInBytes;
+}
+
+IStorageMediaInfo TieredStorageMedia::getMediaInfo()
+{
+	// the address space and geometry are the slow tier's, but transfers within an extent are what get promoted
+	IStorageMediaInfo info = m_SlowTier.getMediaInfo();
+	info.m_OptimalIOSizeInBytes = std::max( info.m_OptimalIOSizeInBytes, m_ExtentSizeInBytes );
+	info.m_SupportsAsync = false;
+
+	return info;
+}
+
+void TieredStorageMedia::flush()
+{
+	for ( unsigned int slotNum = 0; slotNum < m_Slots.size(); slotNum++ )
+	{
+		ExtentSlot& slot = m_Slots[slotNum];
+
+		if ( slot.m_InUse && slot.m_Dirty ) this->writeBackSlot( slot, slotNum );
+	}
+}
+
+void TieredStorageMedia::accessExtent (const uint64_t extentNum, const unsigned int offsetInExtent, const SharedData<uint8_t>& data, bool writing)
+{
+	m_AccessesSinceDecay++;
+	if ( m_AccessesSinceDecay >= (m_Slots.size() + 1) * DECAY_INTERVAL_PER_SLOT
+			|| m_SlowExtentHeat.size() > (m_Slots.size() + 1) * MAX_TRACKED_EXTENTS_PER_SLOT )
+	{
+		this->decayHeat();
+	}
+
+	unsigned int slotNum = 0;
+	bool resident = false;
+
+	auto residentIt = m_ResidentExtents.find( extentNum );
+	if ( residentIt != m_ResidentExtents.end() )
+	{
+		slotNum = residentIt->second;
+		m_Slots[slotNum].m_Heat++;
+		resident = true;
+	}
+	else
+	{
+		// a write covering the whole extent doesn't need the old contents loaded from the slow tier
+		const bool overwritesExtent = writing && data.getSizeInBytes() == this->getExtentSize( extentNum );
+		resident = this->promoteExtent( extentNum, slotNum, ! overwritesExtent );
+	}
+
+	if ( resident )
+	{
+		const uint64_t fastOffset = static_cast<uint64_t>( slotNum ) * m_ExtentSizeInBytes + offsetInExtent;
+
+		if ( writing )
+		{
+			m_FastTier.writeToMedia64( data, fastOffset );
+			m_Slots[slotNum].m_Dirty = true;
+		}
+		else
+		{
+			m_FastTier.readFromMedia64( fastOffset, data );
+		}
+
+		m_FastTierHits++;
+	}
+	else
+	{
+		const uint64_t slowOffset = extentNum * m_ExtentSizeInBytes + offsetInExtent;
+
+		if ( writing )
+		{
+			m_SlowTier.writeToMedia64( data, slowOffset );
+		}
+		else
+		{
+			m_SlowTier.readFromMedia64( slowOffset, data );
+		}
+
+		m_SlowTierHits++;
+	}
+}
+
+bool TieredStorageMedia::promoteExtent (const uint64_t extentNum, unsigned int& slotNum, bool loadFromSlowTier)
+{
+	if ( m_Slots.empty() ) return false;
+
+	const unsigned int heat = ++m_SlowExtentHeat[extentNum];
+	if ( heat < m_PromotionThreshold ) return false;
+
+	// use a free slot if there is one, otherwise the coldest resident extent
+	unsigned int victimNum = 0;
+	for ( unsigned int slotIndex = 0; slotIndex < m_Slots.size(); slotIndex++ )
+	{
+		if ( ! m_Slots[slotIndex].m_InUse )
+		{
+			victimNum = slotIndex;
+			break;
+		}
+		else if ( m_Slots[slotIndex].m_Heat < m_Slots[victimNum].m_Heat )
+		{
+			victimNum = slotIndex;
+		}
+	}
+
+	ExtentSlot& victim = m_Slots[victimNum];
+	if ( victim.m_InUse )
+	{
+		// only displace a resident extent if this one is hotter
+		if ( victim.m_Heat >= heat ) return false;
+
+		if ( victim.m_Dirty ) this->writeBackSlot( victim, victimNum );
+
+		m_ResidentExtents.erase( victim.m_ExtentNum );
+		m_SlowExtentHeat[victim.m_ExtentNum] = victim.m_Heat / 2;
+	}
+
+	const uint64_t fastOffset = static_cast<uint64_t>( victimNum ) * m_ExtentSizeInBytes;
+	if ( loadFromSlowTier )
+	{
+		SharedData<uint8_t> extentData = m_SlowTier.readFromMedia64( this->getExtentSize(extentNum), extentNum * m_ExtentSizeInBytes );
+		m_FastTier.writeToMedia64( extentData, fastOffset );
+	}
+
+	victim.m_ExtentNum = extentNum;
+	victim.m_Heat = heat;
+	victim.m_InUse = true;
+	victim.m_Dirty = false;
+
+	m_ResidentExtents[extentNum] = victimNum;
+	m_SlowExtentHeat.erase( extentNum );
+
+	slotNum = victimNum;
+
+	return true;
+}
+
+void TieredStorageMedia::writeBackSlot (ExtentSlot& slot, unsigned int slotNum)
+{
+	const uint64_t fastOffset = static_cast<uint64_t>( slotNum ) * m_ExtentSizeInBytes;
+	SharedData<uint8_t> extentData = m_FastTier.readFromMedia64( this->getExtentSize(slot.m_ExtentNum), fastOffset );
+
+	m_SlowTier.writeToMedia64( extentData, slot.m_ExtentNum * m_ExtentSizeInBytes );
+	slot.m_Dirty = false;
+}
+
+unsigned int TieredStorageMedia::getExtentSize (const uint64_t extentNum)
+{
+	const uint64_t extentStart = extentNum * m_ExtentSizeInBytes;
+
+	// an unknown capacity means we can't do any better than a full extent
+	if ( m_SlowTierCapacityInBytes == 0 || extentStart + m_ExtentSizeInBytes <= m_SlowTierCapacityInBytes ) return m_ExtentSizeInBytes;
+	if ( extentStart >= m_SlowTierCapacityInBytes ) return 0;
+
+	return m_SlowTierCapacityInBytes - extentStart;
+}
+
+void TieredStorageMedia::decayHeat()
+{
+	for ( ExtentSlot& slot : m_Slots )
+	{
+		slot.m_Heat /= 2;
+	}
+
+	for ( auto heatIt = m_SlowExtentHeat.begin(); heatIt != m_SlowExtentHeat.end(); )
+	{
+		heatIt->second /= 2;
+
+		if ( heatIt->second == 0 )
+		{
+			heatIt = m_SlowExtentHeat.erase( heatIt );
+		}
+		else
+		{
+			heatIt++;
+		}
+	}
+
+	m_AccessesSinceDecay = 0;
+}
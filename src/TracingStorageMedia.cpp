@@ -0,0 +1,188 @@
+#include "TracingStorageMedia.hpp"
+
+#include <chrono>
+
+#define TRACE_MAGIC 0x43525453 // "STRC" little endian
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 5
+
+static void writeVarint (std::vector<uint8_t>& trace, uint64_t value)
+{
+	while ( value >= 0x80 )
+	{
+		trace.push_back( static_cast<uint8_t>(value | 0x80) );
+		value >>= 7;
+	}
+
+	trace.push_back( static_cast<uint8_t>(value) );
+}
+
+static bool readVarint (const uint8_t* trace, unsigned int sizeInBytes, unsigned int& position, uint64_t& value)
+{
+	value = 0;
+
+	for ( unsigned int shift = 0; shift < 64; shift += 7 )
+	{
+		if ( position >= sizeInBytes ) return false;
+
+		const uint8_t byte = trace[position++];
+		value |= static_cast<uint64_t>( byte & 0x7F ) << shift;
+
+		if ( ! (byte & 0x80) ) return true;
+	}
+
+	return false;
+}
+
+// small jumps either way encode small
+static uint64_t zigzagEncode (int64_t value)
+{
+	return ( static_cast<uint64_t>(value) << 1 ) ^ static_cast<uint64_t>( value >> 63 );
+}
+
+static int64_t zigzagDecode (uint64_t value)
+{
+	return static_cast<int64_t>( value >> 1 ) ^ -static_cast<int64_t>( value & 1 );
+}
+
+static uint64_t steadyClockNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+TracingStorageMedia::TracingStorageMedia (IStorageMedia& child, StorageTraceClock clock) :
+	m_Child( child ),
+	m_Clock( (clock) ? clock : steadyClockNow ),
+	m_Trace(),
+	m_NumRecords( 0 ),
+	m_StartTimeInNs( 0 ),
+	m_LastTimestampInNs( 0 ),
+	m_LastEndOffsetInBytes( 0 )
+{
+	this->clearTrace();
+}
+
+TracingStorageMedia::~TracingStorageMedia()
+{
+}
+
+void TracingStorageMedia::writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes)
+{
+	this->writeToMedia64( data, offsetInBytes );
+}
+
+SharedData<uint8_t> TracingStorageMedia::readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes)
+{
+	return this->readFromMedia64( sizeInBytes, offsetInBytes );
+}
+
+void TracingStorageMedia::readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data)
+{
+	this->readFromMedia64( static_cast<uint64_t>(offsetInBytes), data );
+}
+
+void TracingStorageMedia::writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes)
+{
+	const uint64_t startTime = this->now();
+	m_Child.writeToMedia64( data, offsetInBytes );
+	this->addRecord( STORAGE_TRACE_OP::WRITE, startTime, offsetInBytes, data.getSizeInBytes() );
+}
+
+SharedData<uint8_t> TracingStorageMedia::readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes)
+{
+	const uint64_t startTime = this->now();
+	SharedData<uint8_t> data = m_Child.readFromMedia64( sizeInBytes, offsetInBytes );
+	this->addRecord( STORAGE_TRACE_OP::READ, startTime, offsetInBytes, sizeInBytes );
+
+	return data;
+}
+
+void TracingStorageMedia::readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data)
+{
+	const uint64_t startTime = this->now();
+	m_Child.readFromMedia64( offsetInBytes, data );
+	this->addRecord( STORAGE_TRACE_OP::READ, startTime, offsetInBytes, data.getSizeInBytes() );
+}
+
+void TracingStorageMedia::discard (const unsigned int offsetInBytes, const unsigned int sizeInBytes)
+{
+	this->discard64( static_cast<uint64_t>(offsetInBytes), static_cast<uint64_t>(sizeInBytes) );
+}
+
+void TracingStorageMedia::discard64 (const uint64_t offsetInBytes, const uint64_t sizeInBytes)
+{
+	const uint64_t startTime = this->now();
+	m_Child.discard64( offsetInBytes, sizeInBytes );
+	this->addRecord( STORAGE_TRACE_OP::DISCARD, startTime, offsetInBytes, sizeInBytes );
+}
+
+void TracingStorageMedia::clearTrace()
+{
+	m_Trace.clear();
+	m_NumRecords = 0;
+	m_StartTimeInNs = this->now();
+	m_LastTimestampInNs = 0;
+	m_LastEndOffsetInBytes = 0;
+
+	for ( unsigned int byte = 0; byte < 4; byte++ )
+	{
+		m_Trace.push_back( static_cast<uint8_t>((TRACE_MAGIC >> (byte * 8)) & 0xFF) );
+	}
+	m_Trace.push_back( TRACE_VERSION );
+}
+
+bool TracingStorageMedia::DecodeTrace (const uint8_t* trace, unsigned int sizeInBytes, std::vector<StorageTraceRecord>& records)
+{
+	if ( sizeInBytes < TRACE_HEADER_SIZE ) return false;
+
+	const uint32_t magic = trace[0] | ( trace[1] << 8 ) | ( trace[2] << 16 ) | ( static_cast<uint32_t>(trace[3]) << 24 );
+	if ( magic != TRACE_MAGIC || trace[4] != TRACE_VERSION ) return false;
+
+	unsigned int position = TRACE_HEADER_SIZE;
+	uint64_t timestamp = 0;
+	uint64_t lastEndOffset = 0;
+
+	while ( position < sizeInBytes )
+	{
+		StorageTraceRecord record;
+		uint64_t timeDelta = 0;
+		uint64_t offsetDelta = 0;
+
+		const uint8_t op = trace[position++];
+		if ( op > static_cast<uint8_t>(STORAGE_TRACE_OP::DISCARD) ) return false;
+
+		if ( ! readVarint(trace, sizeInBytes, position, timeDelta)
+				|| ! readVarint(trace, sizeInBytes, position, record.m_DurationInNs)
+				|| ! readVarint(trace, sizeInBytes, position, offsetDelta)
+				|| ! readVarint(trace, sizeInBytes, position, record.m_SizeInBytes) )
+		{
+			return false;
+		}
+
+		timestamp += timeDelta;
+		record.m_Op = static_cast<STORAGE_TRACE_OP>( op );
+		record.m_TimestampInNs = timestamp;
+		record.m_OffsetInBytes = lastEndOffset + zigzagDecode( offsetDelta );
+		lastEndOffset = record.m_OffsetInBytes + record.m_SizeInBytes;
+
+		records.push_back( record );
+	}
+
+	return true;
+}
+
+void TracingStorageMedia::addRecord (const STORAGE_TRACE_OP& op, uint64_t startTimeInNs, uint64_t offsetInBytes, uint64_t sizeInBytes)
+{
+	const uint64_t endTime = this->now();
+	const uint64_t timestamp = startTimeInNs - m_StartTimeInNs;
+
+	m_Trace.push_back( static_cast<uint8_t>(op) );
+	writeVarint( m_Trace, timestamp - m_LastTimestampInNs );
+	writeVarint( m_Trace, endTime - startTimeInNs );
+	writeVarint( m_Trace, zigzagEncode(static_cast<int64_t>(offsetInBytes - m_LastEndOffsetInBytes)) );
+	writeVarint( m_Trace, sizeInBytes );
+
+	m_NumRecords++;
+	m_LastTimestampInNs = timestamp;
+	m_LastEndOffsetInBytes = offsetInBytes + sizeInBytes;
+}
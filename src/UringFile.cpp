@@ -0,0 +1,352 @@
+#include "UringFile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// the kernel rounds the queue depth up to a power of two, this caps it
+#define MAX_QUEUE_DEPTH 4096
+
+UringFile::UringFile (const std::string& fileName, unsigned int queueDepth) :
+	m_FileName( fileName ),
+	m_FileDescriptor( -1 ),
+	m_RingFileDescriptor( -1 ),
+	m_SubmissionRing( nullptr ),
+	m_SubmissionRingSize( 0 ),
+	m_CompletionRing( nullptr ),
+	m_CompletionRingSize( 0 ),
+	m_SubmissionEntries( nullptr ),
+	m_SubmissionEntriesSize( 0 ),
+	m_SubmissionTail( nullptr ),
+	m_SubmissionMask( 0 ),
+	m_SubmissionArray( nullptr ),
+	m_CompletionHead( nullptr ),
+	m_CompletionTail( nullptr ),
+	m_CompletionMask( 0 ),
+	m_CompletionEntries( nullptr ),
+	m_Transfers(),
+	m_FreeTransfers(),
+	m_NumUnsubmitted( 0 ),
+	m_RegisteredBuffers()
+{
+	m_FileDescriptor = open( ("./" + m_FileName).c_str(), O_RDWR | O_CREAT, 0644 );
+	if ( m_FileDescriptor < 0 ) return;
+
+	if ( queueDepth == 0 ) queueDepth = 1;
+	if ( queueDepth > MAX_QUEUE_DEPTH ) queueDepth = MAX_QUEUE_DEPTH;
+
+	if ( ! this->setupRings(queueDepth) )
+	{
+		close( m_FileDescriptor );
+		m_FileDescriptor = -1;
+	}
+}
+
+UringFile::~UringFile()
+{
+	// the kernel may still be writing into buffers the pending transfers hold on to
+	if ( this->isOpen() ) this->waitForAll();
+
+	if ( m_SubmissionEntries ) munmap( m_SubmissionEntries, m_SubmissionEntriesSize );
+	if ( m_CompletionRing && m_CompletionRing != m_SubmissionRing ) munmap( m_CompletionRing, m_CompletionRingSize );
+	if ( m_SubmissionRing ) munmap( m_SubmissionRing, m_SubmissionRingSize );
+	if ( m_RingFileDescriptor >= 0 ) close( m_RingFileDescriptor );
+	if ( m_FileDescriptor >= 0 ) close( m_FileDescriptor );
+}
+
+void UringFile::writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes)
+{
+	this->writeToMedia64( data, offsetInBytes );
+}
+
+SharedData<uint8_t> UringFile::readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes)
+{
+	return this->readFromMedia64( sizeInBytes, offsetInBytes );
+}
+
+void UringFile::readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data)
+{
+	this->readFromMedia64( static_cast<uint64_t>(offsetInBytes), data );
+}
+
+void UringFile::writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes)
+{
+	this->transferAndWait( true, offsetInBytes, data );
+}
+
+SharedData<uint8_t> UringFile::readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes)
+{
+	SharedData<uint8_t> data = SharedData<uint8_t>::MakeSharedData( sizeInBytes );
+
+	if ( ! this->transferAndWait(false, offsetInBytes, data) ) return SharedData<uint8_t>::MakeSharedDataNull();
+
+	return data;
+}
+
+void UringFile::readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data)
+{
+	this->transferAndWait( false, offsetInBytes, data );
+}
+
+IStorageMediaInfo UringFile::getMediaInfo()
+{
+	uint64_t fileSize = 0;
+	struct stat fileStat;
+
+	if ( m_FileDescriptor >= 0 && fstat(m_FileDescriptor, &fileStat) == 0 ) fileSize = static_cast<uint64_t>( fileStat.st_size );
+
+	return IStorageMediaInfo( fileSize, 4096, 1, 1, 1, true );
+}
+
+bool UringFile::readAsync (const uint64_t offsetInBytes, const SharedData<uint8_t>& data, UringFileCallback callback)
+{
+	return this->queueTransfer( false, offsetInBytes, data, callback );
+}
+
+bool UringFile::writeAsync (const uint64_t offsetInBytes, const SharedData<uint8_t>& data, UringFileCallback callback)
+{
+	return this->queueTransfer( true, offsetInBytes, data, callback );
+}
+
+unsigned int UringFile::submit()
+{
+	if ( m_NumUnsubmitted == 0 ) return 0;
+
+	return this->enter( 0 );
+}
+
+unsigned int UringFile::poll()
+{
+	unsigned int numCompleted = 0;
+
+	// the head is re-read every time since a callback can call poll() itself
+	unsigned int head = *m_CompletionHead;
+	while ( head != __atomic_load_n(m_CompletionTail, __ATOMIC_ACQUIRE) )
+	{
+		const io_uring_cqe& entry = m_CompletionEntries[head & m_CompletionMask];
+		const unsigned int transferIndex = static_cast<unsigned int>( entry.user_data );
+		const int result = entry.res;
+		__atomic_store_n( m_CompletionHead, head + 1, __ATOMIC_RELEASE );
+
+		// the slot is freed before the callback, so the callback can queue another transfer straight away
+		PendingTransfer& transfer = m_Transfers[transferIndex];
+		UringFileCallback callback = std::move( transfer.m_Callback );
+		SharedData<uint8_t> data = transfer.m_Data;
+		transfer.m_Callback = nullptr;
+		transfer.m_Data = SharedData<uint8_t>::MakeSharedDataNull();
+		m_FreeTransfers.push_back( transferIndex );
+
+		if ( callback ) callback( result );
+		numCompleted++;
+
+		head = *m_CompletionHead;
+	}
+
+	return numCompleted;
+}
+
+void UringFile::wait (unsigned int minCompletions)
+{
+	if ( ! this->isOpen() ) return;
+
+	this->submit();
+
+	unsigned int numCompleted = this->poll();
+	while ( numCompleted < minCompletions && this->getNumInFlight() > 0 )
+	{
+		const unsigned int numLeft = std::min( minCompletions - numCompleted, this->getNumInFlight() );
+		if ( this->enter(numLeft) == 0 && m_NumUnsubmitted > 0 ) continue; // interrupted before anything was submitted
+
+		numCompleted += this->poll();
+	}
+}
+
+void UringFile::waitForAll()
+{
+	while ( this->isOpen() && this->getNumInFlight() > 0 )
+	{
+		this->wait( this->getNumInFlight() );
+	}
+}
+
+bool UringFile::registerBuffers (const std::vector<SharedData<uint8_t>>& buffers)
+{
+	if ( ! this->isOpen() ) return false;
+
+	this->unregisterBuffers();
+	this->waitForAll();
+
+	std::vector<iovec> vectors;
+	for ( const SharedData<uint8_t>& buffer : buffers )
+	{
+		vectors.push_back( {buffer.getPtr(), buffer.getSizeInBytes()} );
+	}
+
+	if ( syscall(__NR_io_uring_register, m_RingFileDescriptor, IORING_REGISTER_BUFFERS, vectors.data(), vectors.size()) != 0 ) return false;
+
+	m_RegisteredBuffers = buffers;
+
+	return true;
+}
+
+void UringFile::unregisterBuffers()
+{
+	if ( m_RegisteredBuffers.empty() ) return;
+
+	// a transfer in flight may be using one of them
+	this->waitForAll();
+
+	syscall( __NR_io_uring_register, m_RingFileDescriptor, IORING_UNREGISTER_BUFFERS, nullptr, 0 );
+	m_RegisteredBuffers.clear();
+}
+
+bool UringFile::setupRings (unsigned int queueDepth)
+{
+	io_uring_params params;
+	std::memset( &params, 0, sizeof(params) );
+
+	m_RingFileDescriptor = static_cast<int>( syscall(__NR_io_uring_setup, queueDepth, &params) );
+	if ( m_RingFileDescriptor < 0 ) return false;
+
+	m_SubmissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	m_CompletionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+	// newer kernels let both rings share one mapping
+	if ( params.features & IORING_FEAT_SINGLE_MMAP )
+	{
+		if ( m_CompletionRingSize > m_SubmissionRingSize ) m_SubmissionRingSize = m_CompletionRingSize;
+		m_CompletionRingSize = m_SubmissionRingSize;
+	}
+
+	void* submissionRing = mmap( nullptr, m_SubmissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					m_RingFileDescriptor, IORING_OFF_SQ_RING );
+	if ( submissionRing == MAP_FAILED ) return false;
+	m_SubmissionRing = submissionRing;
+
+	if ( params.features & IORING_FEAT_SINGLE_MMAP )
+	{
+		m_CompletionRing = m_SubmissionRing;
+	}
+	else
+	{
+		void* completionRing = mmap( nullptr, m_CompletionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+						m_RingFileDescriptor, IORING_OFF_CQ_RING );
+		if ( completionRing == MAP_FAILED ) return false;
+		m_CompletionRing = completionRing;
+	}
+
+	m_SubmissionEntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+	void* submissionEntries = mmap( nullptr, m_SubmissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					m_RingFileDescriptor, IORING_OFF_SQES );
+	if ( submissionEntries == MAP_FAILED ) return false;
+	m_SubmissionEntries = static_cast<io_uring_sqe*>( submissionEntries );
+
+	uint8_t* submissionRingBytes = static_cast<uint8_t*>( m_SubmissionRing );
+	m_SubmissionTail = reinterpret_cast<unsigned int*>( submissionRingBytes + params.sq_off.tail );
+	m_SubmissionMask = *reinterpret_cast<unsigned int*>( submissionRingBytes + params.sq_off.ring_mask );
+	m_SubmissionArray = reinterpret_cast<unsigned int*>( submissionRingBytes + params.sq_off.array );
+
+	uint8_t* completionRingBytes = static_cast<uint8_t*>( m_CompletionRing );
+	m_CompletionHead = reinterpret_cast<unsigned int*>( completionRingBytes + params.cq_off.head );
+	m_CompletionTail = reinterpret_cast<unsigned int*>( completionRingBytes + params.cq_off.tail );
+	m_CompletionMask = *reinterpret_cast<unsigned int*>( completionRingBytes + params.cq_off.ring_mask );
+	m_CompletionEntries = reinterpret_cast<io_uring_cqe*>( completionRingBytes + params.cq_off.cqes );
+
+	// no more transfers than submission entries can be in flight, which also keeps the larger completion ring from overflowing
+	m_Transfers.resize( params.sq_entries );
+	for ( unsigned int transferIndex = params.sq_entries; transferIndex > 0; transferIndex-- )
+	{
+		m_FreeTransfers.push_back( transferIndex - 1 );
+	}
+
+	return true;
+}
+
+bool UringFile::queueTransfer (bool writing, const uint64_t offsetInBytes, const SharedData<uint8_t>& data, UringFileCallback callback)
+{
+	if ( ! this->isOpen() ) return false;
+
+	// every slot is in flight, so wait for the oldest
+	if ( m_FreeTransfers.empty() ) this->wait( 1 );
+	if ( m_FreeTransfers.empty() ) return false;
+
+	const unsigned int transferIndex = m_FreeTransfers.back();
+	m_FreeTransfers.pop_back();
+	m_Transfers[transferIndex].m_Data = data;
+	m_Transfers[transferIndex].m_Callback = callback;
+
+	const unsigned int tail = *m_SubmissionTail;
+	const unsigned int entryIndex = tail & m_SubmissionMask;
+	io_uring_sqe& entry = m_SubmissionEntries[entryIndex];
+	std::memset( &entry, 0, sizeof(entry) );
+
+	entry.opcode = ( writing ) ? IORING_OP_WRITE : IORING_OP_READ;
+	entry.fd = m_FileDescriptor;
+	entry.off = offsetInBytes;
+	entry.addr = reinterpret_cast<uint64_t>( data.getPtr() );
+	entry.len = data.getSizeInBytes();
+	entry.user_data = transferIndex;
+
+	// the fixed variants skip pinning the pages, but only if the whole transfer is inside one registered buffer
+	for ( unsigned int bufferIndex = 0; bufferIndex < m_RegisteredBuffers.size(); bufferIndex++ )
+	{
+		const SharedData<uint8_t>& buffer = m_RegisteredBuffers[bufferIndex];
+		if ( data.getPtr() >= buffer.getPtr() && data.getPtr() + data.getSizeInBytes() <= buffer.getPtr() + buffer.getSizeInBytes() )
+		{
+			entry.opcode = ( writing ) ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+			entry.buf_index = bufferIndex;
+
+			break;
+		}
+	}
+
+	m_SubmissionArray[entryIndex] = entryIndex;
+	__atomic_store_n( m_SubmissionTail, tail + 1, __ATOMIC_RELEASE );
+	m_NumUnsubmitted++;
+
+	return true;
+}
+
+bool UringFile::transferAndWait (bool writing, const uint64_t offsetInBytes, const SharedData<uint8_t>& data)
+{
+	uint64_t numDone = 0;
+
+	// like pread and pwrite, a transfer can come back short, so the rest is queued again
+	while ( numDone < data.getSizeInBytes() )
+	{
+		SharedData<uint8_t> remaining = SharedData<uint8_t>::MakeSharedData( data.getSizeInBytes() - numDone, data.getPtr() + numDone );
+		bool finished = false;
+		int result = 0;
+
+		if ( ! this->queueTransfer(writing, offsetInBytes + numDone, remaining, [&finished, &result](int transferResult) {
+					finished = true;
+					result = transferResult; }) ) return false;
+
+		while ( ! finished ) this->wait( 1 );
+
+		if ( result <= 0 ) return false;
+
+		numDone += result;
+	}
+
+	return true;
+}
+
+unsigned int UringFile::enter (unsigned int minCompletions)
+{
+	const unsigned int flags = ( minCompletions > 0 ) ? IORING_ENTER_GETEVENTS : 0;
+	const long numSubmitted = syscall( __NR_io_uring_enter, m_RingFileDescriptor, m_NumUnsubmitted, minCompletions, flags, nullptr, 0 );
+
+	// interrupted by a signal, the caller just tries again
+	if ( numSubmitted < 0 ) return 0;
+
+	m_NumUnsubmitted -= numSubmitted;
+
+	return numSubmitted;
+}
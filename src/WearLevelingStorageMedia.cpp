@@ -0,0 +1,243 @@
+#include "WearLevelingStorageMedia.hpp"
+
+#include "Checksum.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#define NO_PHYSICAL_PAGE 0xFFFFFFFF
+// the crc starts from 0xFFFF so that an all zero page doesn't pass as valid
+#define CRC_INITIAL_VALUE 0xFFFF
+
+struct WearLevelingCandidate
+{
+	uint16_t 	m_LogicalPageNum;
+	uint32_t 	m_SequenceNum;
+	uint32_t 	m_SlotNum;
+};
+
+static uint16_t calculatePageCrc (const uint8_t* pagePtr, unsigned int pageSizeInBytes)
+{
+	// covers the logical page and sequence numbers as well as the data, but not the crc itself
+	const uint16_t headerCrc = Checksum::Crc16( pagePtr, 6, CRC_INITIAL_VALUE );
+
+	return Checksum::Crc16( pagePtr + WEAR_LEVELING_HEADER_SIZE, pageSizeInBytes - WEAR_LEVELING_HEADER_SIZE, headerCrc );
+}
+
+WearLevelingStorageMedia::WearLevelingStorageMedia (IStorageMedia& child, unsigned int numLogicalPages, unsigned int physicalPageSizeInBytes) :
+	m_Child( child ),
+	m_PhysicalPageSizeInBytes( std::max<unsigned int>(physicalPageSizeInBytes, WEAR_LEVELING_HEADER_SIZE + 1) ),
+	m_LogicalPageSizeInBytes( m_PhysicalPageSizeInBytes - WEAR_LEVELING_HEADER_SIZE ),
+	m_LogicalToPhysical( std::min<unsigned int>(numLogicalPages, 0xFFFF), NO_PHYSICAL_PAGE ),
+	m_LiveSlots( child.getMediaInfo().m_CapacityInBytes / m_PhysicalPageSizeInBytes, false ),
+	m_NextSlot( 0 ),
+	m_NextSequenceNum( 0 ),
+	m_PageBuffer( SharedData<uint8_t>::MakeSharedData(m_PhysicalPageSizeInBytes) )
+{
+	// without a spare physical page there would be nowhere to write a new copy
+	if ( m_LogicalToPhysical.size() >= m_LiveSlots.size() ) m_LogicalToPhysical.resize( (m_LiveSlots.empty()) ? 0 : m_LiveSlots.size() - 1 );
+}
+
+WearLevelingStorageMedia::~WearLevelingStorageMedia()
+{
+}
+
+void WearLevelingStorageMedia::writeToMedia (const SharedData<uint8_t>& data, const unsigned int offsetInBytes)
+{
+	this->writeToMedia64( data, offsetInBytes );
+}
+
+SharedData<uint8_t> WearLevelingStorageMedia::readFromMedia (const unsigned int sizeInBytes, const unsigned int offsetInBytes)
+{
+	return this->readFromMedia64( sizeInBytes, offsetInBytes );
+}
+
+void WearLevelingStorageMedia::readFromMedia (const unsigned int offsetInBytes, const SharedData<uint8_t>& data)
+{
+	this->readFromMedia64( static_cast<uint64_t>(offsetInBytes), data );
+}
+
+void WearLevelingStorageMedia::writeToMedia64 (const SharedData<uint8_t>& data, const uint64_t offsetInBytes)
+{
+	if ( offsetInBytes > this->getCapacityInBytes() || data.getSizeInBytes() > this->getCapacityInBytes() - offsetInBytes ) return;
+
+	unsigned int dataIndex = 0;
+
+	while ( dataIndex < data.getSizeInBytes() )
+	{
+		const uint64_t position = offsetInBytes + dataIndex;
+		const unsigned int logicalPageNum = position / m_LogicalPageSizeInBytes;
+		const unsigned int offsetInPage = position % m_LogicalPageSizeInBytes;
+		const unsigned int pieceSize = std::min( m_LogicalPageSizeInBytes - offsetInPage, data.getSizeInBytes() - dataIndex );
+
+		// a partial update needs the rest of the page from the latest copy
+		if ( pieceSize != m_LogicalPageSizeInBytes )
+		{
+			const SharedData<uint8_t> pageData = SharedData<uint8_t>::MakeSharedData( m_LogicalPageSizeInBytes,
+													m_PageBuffer.getPtr(WEAR_LEVELING_HEADER_SIZE) );
+			this->readLogicalPage( logicalPageNum, 0, pageData );
+		}
+
+		std::memcpy( m_PageBuffer.getPtr(WEAR_LEVELING_HEADER_SIZE + offsetInPage), data.getPtr(dataIndex), pieceSize );
+		this->writeLogicalPage( logicalPageNum );
+
+		dataIndex += pieceSize;
+	}
+}
+
+SharedData<uint8_t> WearLevelingStorageMedia::readFromMedia64 (const unsigned int sizeInBytes, const uint64_t offsetInBytes)
+{
+	if ( offsetInBytes > this->getCapacityInBytes() || sizeInBytes > this->getCapacityInBytes() - offsetInBytes )
+	{
+		return SharedData<uint8_t>::MakeSharedDataNull();
+	}
+
+	SharedData<uint8_t> data = SharedData<uint8_t>::MakeSharedData( sizeInBytes );
+
+	this->readFromMedia64( offsetInBytes, data );
+
+	return data;
+}
+
+void WearLevelingStorageMedia::readFromMedia64 (const uint64_t offsetInBytes, const SharedData<uint8_t>& data)
+{
+	if ( offsetInBytes > this->getCapacityInBytes() || data.getSizeInBytes() > this->getCapacityInBytes() - offsetInBytes ) return;
+
+	unsigned int dataIndex = 0;
+
+	while ( dataIndex < data.getSizeInBytes() )
+	{
+		const uint64_t position = offsetInBytes + dataIndex;
+		const unsigned int offsetInPage = position % m_LogicalPageSizeInBytes;
+		const unsigned int pieceSize = std::min( m_LogicalPageSizeInBytes - offsetInPage, data.getSizeInBytes() - dataIndex );
+
+		// read straight into the callers buffer
+		const SharedData<uint8_t> piece = SharedData<uint8_t>::MakeSharedData( pieceSize, data.getPtr(dataIndex) );
+		this->readLogicalPage( position / m_LogicalPageSizeInBytes, offsetInPage, piece );
+
+		dataIndex += pieceSize;
+	}
+}
+
+void WearLevelingStorageMedia::afterInitialize()
+{
+	m_Child.afterInitialize();
+
+	this->mount();
+}
+
+IStorageMediaInfo WearLevelingStorageMedia::getMediaInfo()
+{
+	// anything smaller than a logical page has to be merged with the latest copy
+	return IStorageMediaInfo( this->getCapacityInBytes(), m_LogicalPageSizeInBytes, m_LogicalPageSizeInBytes, m_LogicalPageSizeInBytes, 1, false );
+}
+
+void WearLevelingStorageMedia::mount()
+{
+	std::fill( m_LogicalToPhysical.begin(), m_LogicalToPhysical.end(), NO_PHYSICAL_PAGE );
+	std::fill( m_LiveSlots.begin(), m_LiveSlots.end(), false );
+	m_NextSlot = 0;
+	m_NextSequenceNum = 0;
+
+	// only the headers are read to start with
+	std::vector<WearLevelingCandidate> candidates;
+	uint32_t lastSlotNum = NO_PHYSICAL_PAGE;
+	const SharedData<uint8_t> header = SharedData<uint8_t>::MakeSharedData( WEAR_LEVELING_HEADER_SIZE, m_PageBuffer.getPtr() );
+
+	for ( uint32_t slotNum = 0; slotNum < m_LiveSlots.size(); slotNum++ )
+	{
+		m_Child.readFromMedia64( this->getSlotOffset(slotNum), header );
+
+		const uint16_t logicalPageNum = header[0] | ( header[1] << 8 );
+		const uint32_t sequenceNum = static_cast<uint32_t>( header[2] ) | ( static_cast<uint32_t>(header[3]) << 8 )
+						| ( static_cast<uint32_t>(header[4]) << 16 ) | ( static_cast<uint32_t>(header[5]) << 24 );
+		if ( logicalPageNum >= m_LogicalToPhysical.size() ) continue;
+
+		candidates.push_back( WearLevelingCandidate{logicalPageNum, sequenceNum, slotNum} );
+
+		// new copies must come after anything on the media, even copies that turn out to be torn
+		if ( lastSlotNum == NO_PHYSICAL_PAGE || sequenceNum >= m_NextSequenceNum )
+		{
+			m_NextSequenceNum = sequenceNum + 1;
+			lastSlotNum = slotNum;
+		}
+	}
+
+	// newest copies first, then only the crc of the copies that are actually used needs checking
+	std::sort( candidates.begin(), candidates.end(), [](const WearLevelingCandidate& first, const WearLevelingCandidate& second)
+			{
+				if ( first.m_LogicalPageNum != second.m_LogicalPageNum ) return first.m_LogicalPageNum < second.m_LogicalPageNum;
+
+				return first.m_SequenceNum > second.m_SequenceNum;
+			} );
+
+	for ( const WearLevelingCandidate& candidate : candidates )
+	{
+		if ( m_LogicalToPhysical[candidate.m_LogicalPageNum] != NO_PHYSICAL_PAGE ) continue;
+
+		if ( this->verifySlot(candidate.m_SlotNum) )
+		{
+			m_LogicalToPhysical[candidate.m_LogicalPageNum] = candidate.m_SlotNum;
+			m_LiveSlots[candidate.m_SlotNum] = true;
+		}
+	}
+
+	// carry on round-robin from the last page written
+	if ( lastSlotNum != NO_PHYSICAL_PAGE ) m_NextSlot = ( lastSlotNum + 1 ) % m_LiveSlots.size();
+}
+
+void WearLevelingStorageMedia::readLogicalPage (unsigned int logicalPageNum, unsigned int offsetInPage, const SharedData<uint8_t>& data)
+{
+	const uint32_t slotNum = m_LogicalToPhysical[logicalPageNum];
+
+	if ( slotNum == NO_PHYSICAL_PAGE )
+	{
+		std::fill( data.getPtr(), data.getPtr() + data.getSizeInBytes(), 0 );
+
+		return;
+	}
+
+	m_Child.readFromMedia64( this->getSlotOffset(slotNum) + WEAR_LEVELING_HEADER_SIZE + offsetInPage, data );
+}
+
+void WearLevelingStorageMedia::writeLogicalPage (unsigned int logicalPageNum)
+{
+	// the next physical page that doesn't hold a latest copy, there is always at least one spare
+	uint32_t slotNum = m_NextSlot;
+	while ( m_LiveSlots[slotNum] )
+	{
+		slotNum = ( slotNum + 1 ) % m_LiveSlots.size();
+	}
+
+	uint8_t* pagePtr = m_PageBuffer.getPtr();
+	pagePtr[0] = logicalPageNum & 0xFF;
+	pagePtr[1] = logicalPageNum >> 8;
+	pagePtr[2] = ( m_NextSequenceNum       ) & 0xFF;
+	pagePtr[3] = ( m_NextSequenceNum >> 8  ) & 0xFF;
+	pagePtr[4] = ( m_NextSequenceNum >> 16 ) & 0xFF;
+	pagePtr[5] = ( m_NextSequenceNum >> 24 ) & 0xFF;
+
+	const uint16_t crc = calculatePageCrc( pagePtr, m_PhysicalPageSizeInBytes );
+	pagePtr[6] = crc & 0xFF;
+	pagePtr[7] = crc >> 8;
+
+	m_Child.writeToMedia64( m_PageBuffer, this->getSlotOffset(slotNum) );
+
+	// the old copy is left as it is, it'll be reused once the round-robin gets back to it
+	const uint32_t oldSlotNum = m_LogicalToPhysical[logicalPageNum];
+	if ( oldSlotNum != NO_PHYSICAL_PAGE ) m_LiveSlots[oldSlotNum] = false;
+
+	m_LogicalToPhysical[logicalPageNum] = slotNum;
+	m_LiveSlots[slotNum] = true;
+	m_NextSlot = ( slotNum + 1 ) % m_LiveSlots.size();
+	m_NextSequenceNum++;
+}
+
+bool WearLevelingStorageMedia::verifySlot (uint32_t slotNum)
+{
+	m_Child.readFromMedia64( this->getSlotOffset(slotNum), m_PageBuffer );
+
+	const uint16_t storedCrc = m_PageBuffer[6] | ( m_PageBuffer[7] << 8 );
+
+	return storedCrc == calculatePageCrc( m_PageBuffer.getPtr(), m_PhysicalPageSizeInBytes );
+}